@@ -0,0 +1,363 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+/*
+ * Benchmark harness for the Reasoner.
+ *
+ * Every case is a Tbox and a query produced by a parameterised generator. Each
+ * case runs in a forked process so that its peak resident set size can be
+ * measured on its own. Results are printed as one JSON object per line; when a
+ * baseline file (a previous output) is given, every line also carries the
+ * baseline wall time and the ratio against it.
+ *
+ * Usage: bench.elf [--filter <substring>] [--repeat <n>] [--baseline <file>]
+ */
+
+#include "../source/Common.h"
+#include "../source/Concept.h"
+#include "../source/ConceptManager.h"
+#include "../source/SymbolDictionary.h"
+#include "../source/Reasoner.h"
+#include "../source/Model.h"
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace tinyreason;
+
+namespace
+{
+
+struct BenchmarkCase {
+	string name;
+	string tbox;
+	string query;
+	// 'S' satisfiable, 'U' unsatisfiable, '?' not known in advance
+	char expected;
+};
+
+/* Small deterministic generator so that cases are the same on every run */
+class Random {
+public:
+	Random(unsigned long seed) : mState(seed * 2654435761UL + 1) { }
+	unsigned long next(unsigned long bound) {
+		mState = mState * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (unsigned long) (mState >> 33) % bound;
+	}
+private:
+	unsigned long long mState;
+};
+
+string nested(const string& prefix, const string& inner, size_t depth)
+{
+	string s;
+	for (size_t i = 0; i < depth; ++i)
+		s += prefix + " (";
+	s += inner;
+	s += string(depth, ')');
+	return s;
+}
+
+/* R some (R some ... A) and R only (R only ... X), with X = not A when unsatisfiable */
+BenchmarkCase makeExistsForallChain(size_t depth, bool satisfiable)
+{
+	BenchmarkCase c;
+	c.name = "exists_forall_chain/" + toString(depth) + (satisfiable ? "/sat" : "/unsat");
+	c.query = nested("R some", "A", depth) + " and " + nested("R only", satisfiable ? "B" : "not A", depth) +
+	   " and " + nested("R only", "(C or D)", depth / 2);
+	c.expected = satisfiable ? 'S' : 'U';
+	return c;
+}
+
+/* Random 3-literal clauses over atoms as Tbox axioms, checked on a chain of nodes */
+BenchmarkCase makeDisjunctiveTbox(size_t atomCount, size_t clauseCount, unsigned long seed)
+{
+	BenchmarkCase c;
+	c.name = "disjunctive_tbox/" + toString(atomCount) + "x" + toString(clauseCount) + "/seed" + toString(seed);
+	Random random(seed);
+	for (size_t i = 0; i < clauseCount; ++i)
+	{
+		for (size_t j = 0; j < 3; ++j)
+		{
+			if (j > 0)
+				c.tbox += " or ";
+			if (random.next(2))
+				c.tbox += "not ";
+			c.tbox += "A" + toString(random.next(atomCount));
+		}
+		c.tbox += ";\n";
+	}
+	c.query = "R some (R some thing)";
+	c.expected = '?';
+	return c;
+}
+
+/* A cycle of definitions through a transitive role, closed by blocking */
+BenchmarkCase makeTransitiveCycle(size_t length, bool withChoices, bool satisfiable)
+{
+	BenchmarkCase c;
+	c.name = "transitive_cycle/" + toString(length) + (withChoices ? "/choices" : "") + (satisfiable ? "/sat" : "/unsat");
+	c.tbox = "trans R;\n";
+	for (size_t i = 0; i < length; ++i)
+	{
+		c.tbox += "C" + toString(i) + " isa R some C" + toString((i + 1) % length);
+		if (withChoices)
+			c.tbox += " and (E" + toString(i) + " or F" + toString(i) + ")";
+		c.tbox += ";\n";
+	}
+	if (!satisfiable)
+		c.tbox += "C" + toString(length - 1) + " isa not D;\n";
+	c.query = "C0 and R only D";
+	c.expected = satisfiable ? 'S' : 'U';
+	return c;
+}
+
+/*
+ * LWB-style k_branch formulas: every level forces two successors differing on
+ * a fresh proposition which must then persist below, so a model is a complete
+ * binary tree of the given depth. The unsatisfiable variant forbids the last
+ * level.
+ */
+BenchmarkCase makeKBranch(size_t depth, bool satisfiable)
+{
+	BenchmarkCase c;
+	c.name = "k_branch/" + toString(depth) + (satisfiable ? "/sat" : "/unsat");
+	c.query = "P0";
+	for (size_t i = 0; i < depth; ++i)
+	{
+		string level = "(not P" + toString(i) + " or (R some (P" + toString(i + 1) + " and Q" + toString(i + 1) +
+		   ") and R some (P" + toString(i + 1) + " and not Q" + toString(i + 1) + ")))";
+		c.query += " and " + nested("R only", level, i);
+		for (size_t j = 1; j <= i; ++j)
+		{
+			string persistence = "(not Q" + toString(j) + " or R only Q" + toString(j) + ") and (Q" + toString(j) + " or R only not Q" + toString(j) + ")";
+			c.query += " and " + nested("R only", persistence, i);
+		}
+	}
+	if (!satisfiable)
+		c.query += " and " + nested("R only", "not P" + toString(depth), depth);
+	c.expected = satisfiable ? 'S' : 'U';
+	return c;
+}
+
+/* A wide taxonomy of atomic concepts, queried at one of its leaves */
+BenchmarkCase makeFlatTaxonomy(size_t conceptCount, size_t fanout, bool satisfiable)
+{
+	BenchmarkCase c;
+	c.name = "flat_taxonomy/" + toString(conceptCount) + "x" + toString(fanout) + (satisfiable ? "/sat" : "/unsat");
+	for (size_t i = 1; i < conceptCount; ++i)
+		c.tbox += "T" + toString(i) + " isa T" + toString((i - 1) / fanout) + ";\n";
+	string leaf = "T" + toString(conceptCount - 1);
+	c.query = satisfiable ? leaf : leaf + " and not T0";
+	c.expected = satisfiable ? 'S' : 'U';
+	return c;
+}
+
+void makeCases(vector<BenchmarkCase>& cases)
+{
+	cases.push_back(makeExistsForallChain(16, true));
+	cases.push_back(makeExistsForallChain(16, false));
+	cases.push_back(makeExistsForallChain(64, false));
+	cases.push_back(makeDisjunctiveTbox(5, 6, 1));
+	cases.push_back(makeDisjunctiveTbox(6, 8, 2));
+	cases.push_back(makeDisjunctiveTbox(6, 10, 3));
+	cases.push_back(makeTransitiveCycle(3, true, true));
+	cases.push_back(makeTransitiveCycle(4, true, true));
+	cases.push_back(makeTransitiveCycle(2, true, false));
+	cases.push_back(makeTransitiveCycle(2, false, false));
+	cases.push_back(makeKBranch(3, true));
+	cases.push_back(makeKBranch(3, false));
+	cases.push_back(makeKBranch(4, true));
+	cases.push_back(makeFlatTaxonomy(40, 4, true));
+	cases.push_back(makeFlatTaxonomy(8, 2, false));
+	cases.push_back(makeFlatTaxonomy(10, 3, false));
+}
+
+/* Checks that the example model of a satisfiable case reads back as it was written */
+bool roundTripsModel(const BenchmarkCase& c)
+{
+	SymbolDictionary sd;
+	ConceptManager cm(&sd);
+	Reasoner reasoner(&sd, &cm);
+	vector<const Concept*> tbox, concepts;
+	vector<Symbol> transitiveRoles;
+	cm.parseAssertions(c.tbox, tbox, transitiveRoles);
+	cm.parseAssertions(c.query, concepts, transitiveRoles);
+	reasoner.setTboxConcepts(tbox);
+	reasoner.setTransitiveRoles(transitiveRoles);
+	Model model;
+	if (!reasoner.isSatisfiable(concepts, &model))
+		return true;
+
+	ConceptWriter writer(sd);
+	CompactModel written(model, writer);
+	stringstream binary;
+	written.writeBinary(binary);
+	ostringstream writtenJSON, readJSON;
+	written.writeJSON(writtenJSON);
+	CompactModel::read(binary).writeJSON(readJSON);
+	return writtenJSON.str() == readJSON.str();
+}
+
+/* Runs one case in this process and prints its JSON fields but the memory ones */
+string runCase(const BenchmarkCase& c, size_t repeat)
+{
+	unsigned long long bestTime = 0;
+	Reasoner::Statistics statistics;
+	bool satisfiable = false;
+	for (size_t r = 0; r < repeat; ++r)
+	{
+		SymbolDictionary sd;
+		ConceptManager cm(&sd);
+		Reasoner reasoner(&sd, &cm);
+		vector<const Concept*> tbox, concepts;
+		vector<Symbol> transitiveRoles;
+		cm.parseAssertions(c.tbox, tbox, transitiveRoles);
+		cm.parseAssertions(c.query, concepts, transitiveRoles);
+		reasoner.setTboxConcepts(tbox);
+		reasoner.setTransitiveRoles(transitiveRoles);
+
+		unsigned long long startTime = getMicroseconds();
+		satisfiable = reasoner.isSatisfiable(concepts, 0, false, &statistics);
+		unsigned long long time = getMicroseconds() - startTime;
+		if (r == 0 || time < bestTime)
+			bestTime = time;
+	}
+	stringstream ss;
+	ss << "\"wall_us\":" << bestTime << ",\"expansions\":" << statistics.expansionCount << ",\"trees_created\":" << statistics.createdTreeCount <<
+	   ",\"result\":\"" << (satisfiable ? "sat" : "unsat") << "\"";
+	if (c.expected != '?' && (c.expected == 'S') != satisfiable)
+		ss << ",\"error\":\"unexpected result\"";
+	else if (satisfiable && !roundTripsModel(c))
+		ss << ",\"error\":\"model round trip\"";
+	return ss.str();
+}
+
+/* Runs one case in a child process, measuring its peak resident set size */
+string runCaseIsolated(const BenchmarkCase& c, size_t repeat)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		throw Exception("Cannot create pipe.");
+	pid_t pid = fork();
+	if (pid < 0)
+		throw Exception("Cannot fork.");
+	if (pid == 0)
+	{
+		close(fds[0]);
+		string fields;
+		try
+		{
+			fields = runCase(c, repeat);
+		} catch (Exception& e)
+		{
+			fields = string("\"error\":\"") + e.what() + "\"";
+		}
+		ssize_t written = write(fds[1], fields.data(), fields.size());
+		_exit(written == (ssize_t) fields.size() ? 0 : 1);
+	}
+	close(fds[1]);
+	string fields;
+	char buffer[512];
+	ssize_t count;
+	while ((count = read(fds[0], buffer, sizeof (buffer))) > 0)
+		fields.append(buffer, count);
+	close(fds[0]);
+	int status;
+	rusage usage;
+	wait4(pid, &status, 0, &usage);
+	if (fields.empty())
+		fields = "\"error\":\"case crashed\"";
+	return fields + ",\"peak_rss_kb\":" + toString(usage.ru_maxrss);
+}
+
+/* Wall times by case name, taken from a previous output */
+map<string, unsigned long long> loadBaseline(const string& fileName)
+{
+	map<string, unsigned long long> baseline;
+	ifstream file(fileName.c_str());
+	string line;
+	while (getline(file, line))
+	{
+		size_t name = line.find("\"name\":\"");
+		size_t time = line.find("\"wall_us\":");
+		if (name == string::npos || time == string::npos)
+			continue;
+		name += 8;
+		baseline[line.substr(name, line.find('"', name) - name)] = strtoull(line.c_str() + time + 10, 0, 10);
+	}
+	return baseline;
+}
+}
+
+int main(int argc, char** argv)
+{
+	string filter, baselineFileName;
+	size_t repeat = 1;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--filter") == 0)
+			filter = argv[i + 1];
+		else if (strcmp(argv[i], "--repeat") == 0)
+			repeat = max(1, atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--baseline") == 0)
+			baselineFileName = argv[i + 1];
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--filter <substring>] [--repeat <n>] [--baseline <file>]" << endl;
+			return -1;
+		}
+	}
+
+	map<string, unsigned long long> baseline;
+	if (!baselineFileName.empty())
+		baseline = loadBaseline(baselineFileName);
+
+	vector<BenchmarkCase> cases;
+	makeCases(cases);
+	for (size_t i = 0; i < cases.size(); ++i)
+	{
+		if (cases[i].name.find(filter) == string::npos)
+			continue;
+		string fields = runCaseIsolated(cases[i], repeat);
+		cout << "{\"name\":\"" << cases[i].name << "\"," << fields;
+		map<string, unsigned long long>::const_iterator it = baseline.find(cases[i].name);
+		size_t time = fields.find("\"wall_us\":");
+		if (it != baseline.end() && it->second > 0 && time != string::npos)
+		{
+			// A ratio above 1 means slower than the baseline
+			double ratio = (double) strtoull(fields.c_str() + time + 10, 0, 10) / it->second;
+			cout << ",\"baseline_wall_us\":" << it->second << ",\"ratio\":" << ratio;
+		}
+		cout << "}" << endl;
+	}
+	return 0;
+}
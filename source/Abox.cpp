@@ -0,0 +1,63 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "Abox.h"
+
+using namespace std;
+
+namespace tinyreason
+{
+
+size_t Abox::addIndividual(Symbol name)
+{
+	map<Symbol, size_t>::iterator it = mIndexes.find(name);
+	if (it != mIndexes.end())
+		return it->second;
+	mIndexes[name] = mIndividuals.size();
+	mIndividuals.push_back(IndividualAssertions(name));
+	return mIndividuals.size() - 1;
+}
+
+size_t Abox::findIndividual(Symbol name) const
+{
+	map<Symbol, size_t>::const_iterator it = mIndexes.find(name);
+	return it == mIndexes.end() ? (size_t) NO_INDIVIDUAL : it->second;
+}
+
+void Abox::addConceptAssertion(Symbol individual, const Concept* pConcept)
+{
+	mIndividuals[addIndividual(individual)].concepts.push_back(pConcept);
+}
+
+void Abox::addRoleAssertion(Symbol individual, Symbol role, Symbol successor)
+{
+	size_t successorIndex = addIndividual(successor);
+	mIndividuals[addIndividual(individual)].successors.push_back(RoleEdge(role, successorIndex));
+}
+
+}
@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+
+namespace tinyreason
+{
+
+/**
+ * Assertions about named individuals: the concepts each one is an instance of
+ * and the role edges between them. Individuals are numbered in order of
+ * appearance.
+ */
+class Abox {
+public:
+	typedef std::pair<Symbol, size_t> RoleEdge; // role and successor individual
+
+	enum {
+		NO_INDIVIDUAL = (size_t) -1
+	};
+
+	size_t addIndividual(Symbol name);
+	size_t findIndividual(Symbol name) const; // NO_INDIVIDUAL if never asserted
+	void addConceptAssertion(Symbol individual, const Concept* pConcept);
+	void addRoleAssertion(Symbol individual, Symbol role, Symbol successor);
+	bool isEmpty() const {
+		return mIndividuals.empty();
+	}
+	size_t getIndividualCount() const {
+		return mIndividuals.size();
+	}
+	Symbol getName(size_t individual) const {
+		return mIndividuals[individual].name;
+	}
+	const std::vector<const Concept*>& getConcepts(size_t individual) const {
+		return mIndividuals[individual].concepts;
+	}
+	const std::vector<RoleEdge>& getSuccessors(size_t individual) const {
+		return mIndividuals[individual].successors;
+	}
+private:
+
+	struct IndividualAssertions {
+		Symbol name;
+		std::vector<const Concept*> concepts;
+		std::vector<RoleEdge> successors;
+
+		IndividualAssertions(Symbol name) :
+		name(name) { }
+	};
+
+	std::vector<IndividualAssertions> mIndividuals;
+	std::map<Symbol, size_t> mIndexes;
+};
+
+}
@@ -0,0 +1,281 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "BranchingHeuristic.h"
+#include <cmath>
+
+using namespace std;
+
+namespace tinyreason
+{
+
+// Activities grow by an increment that grows itself, so that recent clashes
+// count more than old ones
+static const double ACTIVITY_DECAY = 0.95;
+static const double ACTIVITY_RESCALE_THRESHOLD = 1e100;
+
+BranchingHeuristic::Kind BranchingHeuristic::parseKind(const std::string& name)
+{
+	if (name == "types")
+		return KIND_TYPES;
+	else if (name == "moms")
+		return KIND_OCCURRENCES;
+	else if (name == "vsids")
+		return KIND_ACTIVITIES;
+	throw Exception("Unknown heuristic \"" + name + "\".");
+}
+
+unsigned long long BranchingHeuristic::getTieBreaker(const Concept* pConcept) const
+{
+	// The finalizer of SplitMix64
+	unsigned long long x = ((unsigned long long) mSeed << 32) ^ pConcept->getID();
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+double BranchingHeuristic::sumLiteralScores(const Concept* pDisjunction, const std::vector<double>& scores, size_t& disjunctCount)
+{
+	// Disjunctions nest to the right when parsed, follow both sides anyway,
+	// from a stack of their own as the chains may be long
+	double score = 0;
+	vector<const Concept*> pending(1, pDisjunction);
+	while (!pending.empty())
+	{
+		const Concept* pConcept = pending.back();
+		pending.pop_back();
+		if (pConcept->getType() == Concept::TYPE_DISJUNCTION)
+		{
+			pending.push_back(pConcept->getConcept2());
+			pending.push_back(pConcept->getConcept1());
+		} else
+		{
+			++disjunctCount;
+			if (pConcept->isAtomic() && pConcept->getSymbol() < scores.size())
+				score += scores[pConcept->getSymbol()];
+		}
+	}
+	return score;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+OccurrenceHeuristic::OccurrenceHeuristic(const std::vector<double>& occurrences, const std::vector<const Concept*>& concepts) :
+mOccurrences(occurrences)
+{
+	countOccurrences(concepts, mOccurrences);
+	++mVersion;
+}
+
+double OccurrenceHeuristic::getScore(const Concept* pDisjunction) const
+{
+	size_t disjunctCount = 0;
+	double score = sumLiteralScores(pDisjunction, mOccurrences, disjunctCount);
+	return ldexp(score, -(int) min(disjunctCount, (size_t) 1000));
+}
+
+void OccurrenceHeuristic::countOccurrences(const std::vector<const Concept*>& concepts, std::vector<double>& occurrences)
+{
+	// Every concept is counted once however many times it is shared
+	set<const Concept*> visited;
+	vector<const Concept*> stack(concepts.begin(), concepts.end());
+	vector<const Concept*> disjunctions;
+	while (!stack.empty())
+	{
+		const Concept* pConcept = stack.back();
+		stack.pop_back();
+		if (pConcept->isAtomic() || !visited.insert(pConcept).second)
+			continue;
+		if (pConcept->getType() == Concept::TYPE_CONJUNCTION || pConcept->getType() == Concept::TYPE_DISJUNCTION)
+		{
+			stack.push_back(pConcept->getConcept1());
+			stack.push_back(pConcept->getConcept2());
+		} else
+			stack.push_back(pConcept->getQualificationConcept());
+		if (pConcept->getType() == Concept::TYPE_DISJUNCTION)
+			disjunctions.push_back(pConcept);
+	}
+
+	// Each disjunction gives every literal among its disjuncts a weight
+	// halving with each disjunct. The disjunctions nested in one are
+	// disjunctions too, so rather than walking through the disjuncts of each
+	// (every tail of a long chain again), the weights are passed down from
+	// the outer disjunctions to the inner ones, outer ones first.
+	struct Entry {
+		size_t disjunctCount; // up to 1000, the weight is the same past it
+		size_t parentCount; // operand of that many disjunctions, once per side
+		double weight;
+	};
+	map<const Concept*, Entry> entries;
+	for (size_t i = 0; i < disjunctions.size(); ++i)
+	{
+		Entry entry = {0, 0, 0};
+		entries[disjunctions[i]] = entry;
+	}
+	for (size_t i = 0; i < disjunctions.size(); ++i)
+	{
+		const Concept* pOperands[2] = {disjunctions[i]->getConcept1(), disjunctions[i]->getConcept2()};
+		for (size_t j = 0; j < 2; ++j)
+			if (pOperands[j]->getType() == Concept::TYPE_DISJUNCTION)
+				++entries[pOperands[j]].parentCount;
+	}
+	// Disjunct counts, inner disjunctions first
+	for (size_t i = 0; i < disjunctions.size(); ++i)
+	{
+		stack.assign(1, disjunctions[i]);
+		while (!stack.empty())
+		{
+			const Concept* pDisjunction = stack.back();
+			Entry& entry = entries[pDisjunction];
+			if (entry.disjunctCount)
+			{
+				stack.pop_back();
+				continue;
+			}
+			const Concept* pOperands[2] = {pDisjunction->getConcept1(), pDisjunction->getConcept2()};
+			size_t disjunctCount = 0;
+			for (size_t j = 0; j < 2; ++j)
+			{
+				if (pOperands[j]->getType() != Concept::TYPE_DISJUNCTION)
+					++disjunctCount;
+				else if (entries[pOperands[j]].disjunctCount)
+					disjunctCount += entries[pOperands[j]].disjunctCount;
+				else
+				{
+					stack.push_back(pOperands[j]);
+					disjunctCount = 0;
+					break;
+				}
+			}
+			if (stack.back() != pDisjunction)
+				continue;
+			entry.disjunctCount = min(disjunctCount, (size_t) 1000);
+			entry.weight = ldexp(1.0, 1 - (int) entry.disjunctCount);
+			stack.pop_back();
+		}
+	}
+	// Weights, a disjunction once all the disjunctions it is an operand of are done
+	for (size_t i = 0; i < disjunctions.size(); ++i)
+		if (!entries[disjunctions[i]].parentCount)
+			stack.push_back(disjunctions[i]);
+	while (!stack.empty())
+	{
+		const Concept* pDisjunction = stack.back();
+		stack.pop_back();
+		double weight = entries[pDisjunction].weight;
+		const Concept* pOperands[2] = {pDisjunction->getConcept1(), pDisjunction->getConcept2()};
+		for (size_t j = 0; j < 2; ++j)
+		{
+			const Concept* pOperand = pOperands[j];
+			if (pOperand->getType() == Concept::TYPE_DISJUNCTION)
+			{
+				Entry& entry = entries[pOperand];
+				entry.weight += weight;
+				if (--entry.parentCount == 0)
+					stack.push_back(pOperand);
+			} else if (pOperand->isAtomic() && !pOperand->isTop() && !pOperand->isBottom())
+			{
+				Symbol symbol = pOperand->getSymbol();
+				if (symbol >= occurrences.size())
+					occurrences.resize(symbol + 1, 0);
+				occurrences[symbol] += weight;
+			}
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void ActivityHeuristic::notifyClash(const Concept* pConcept)
+{
+	// Both literals of a symbol share its activity, bottom has none
+	if (!pConcept->isAtomic() || pConcept->isBottom())
+		return;
+	Symbol symbol = pConcept->getSymbol();
+	if (symbol >= mActivities.scores.size())
+		mActivities.scores.resize(symbol + 1, 0);
+	mActivities.scores[symbol] += mActivities.increment;
+	mActivities.increment /= ACTIVITY_DECAY;
+	if (mActivities.increment > ACTIVITY_RESCALE_THRESHOLD)
+	{
+		for (size_t i = 0; i < mActivities.scores.size(); ++i)
+			mActivities.scores[i] /= ACTIVITY_RESCALE_THRESHOLD;
+		mActivities.increment /= ACTIVITY_RESCALE_THRESHOLD;
+	}
+	++mVersion;
+}
+
+ActivityHeuristic::Store::Store()
+{
+	pthread_mutex_init(&mMutex, 0);
+}
+
+ActivityHeuristic::Store::Store(const Store& store)
+{
+	pthread_mutex_init(&mMutex, 0);
+	store.load(mActivities);
+}
+
+ActivityHeuristic::Store& ActivityHeuristic::Store::operator=(const Store& store)
+{
+	if (this != &store)
+	{
+		Activities activities;
+		store.load(activities);
+		save(activities);
+	}
+	return *this;
+}
+
+ActivityHeuristic::Store::~Store()
+{
+	pthread_mutex_destroy(&mMutex);
+}
+
+void ActivityHeuristic::Store::load(Activities& activities) const
+{
+	pthread_mutex_lock(&mMutex);
+	activities = mActivities;
+	pthread_mutex_unlock(&mMutex);
+}
+
+void ActivityHeuristic::Store::save(const Activities& activities)
+{
+	pthread_mutex_lock(&mMutex);
+	mActivities = activities;
+	pthread_mutex_unlock(&mMutex);
+}
+
+void ActivityHeuristic::Store::clear()
+{
+	pthread_mutex_lock(&mMutex);
+	mActivities = Activities();
+	pthread_mutex_unlock(&mMutex);
+}
+
+}
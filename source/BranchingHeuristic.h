@@ -0,0 +1,164 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include "Concept.h"
+#include <pthread.h>
+
+namespace tinyreason
+{
+
+/**
+ * Orders the disjunctions waiting to be expanded in a completion tree, the
+ * other concepts keep their order by type. A higher score is expanded first
+ * and equal scores leave the order to the type ranking. One heuristic serves
+ * a single check, so it needs no locking.
+ */
+class BranchingHeuristic {
+public:
+
+	enum Kind {
+		KIND_TYPES, // the type ranking alone
+		KIND_OCCURRENCES, // MOMS: literals occurring in many short disjunctions
+		KIND_ACTIVITIES // VSIDS: literals taking part in recent clashes
+	};
+
+	BranchingHeuristic() :
+	mVersion(0), mSeed(0) { }
+	virtual ~BranchingHeuristic() { }
+	virtual double getScore(const Concept* pDisjunction) const {
+		return 0;
+	}
+	// pConcept was added to a label it clashes with
+	virtual void notifyClash(const Concept* pConcept) { }
+	// Changes whenever the scores do, so that the queues ordered by the old
+	// ones can be ordered again
+	size_t getVersion() const {
+		return mVersion;
+	}
+	// With a seed, equal scores are ordered by a hash of the concept IDs
+	// instead of arbitrarily, differently for each seed
+	void setSeed(unsigned seed) {
+		mSeed = seed;
+	}
+	unsigned getSeed() const {
+		return mSeed;
+	}
+	unsigned long long getTieBreaker(const Concept* pConcept) const;
+	static Kind parseKind(const std::string& name);
+protected:
+	// Sums the scores, by symbol, of the literals among the disjuncts, counted
+	// in disjunctCount
+	static double sumLiteralScores(const Concept* pDisjunction, const std::vector<double>& scores, size_t& disjunctCount);
+
+	size_t mVersion;
+	unsigned mSeed;
+};
+
+/**
+ * Counts the clashes on each name over the checks made with the same Tbox.
+ * Concurrent checks count without locking, the names are those known when
+ * the counter was reset.
+ */
+class ClashCounter {
+public:
+	void reset(size_t symbolCount) {
+		mCounts.assign(symbolCount, 0);
+	}
+	void count(Symbol symbol) {
+		if (symbol < mCounts.size())
+			__sync_fetch_and_add(&mCounts[symbol], 1);
+	}
+	// Other threads may be counting, so the read is atomic as well
+	size_t getCount(Symbol symbol) const {
+		return symbol < mCounts.size() ? __sync_fetch_and_add(&mCounts[symbol], 0) : 0;
+	}
+private:
+	mutable std::vector<size_t> mCounts;
+};
+
+class OccurrenceHeuristic : public BranchingHeuristic {
+public:
+	// occurrences come from countOccurrences() on the Tbox, the concepts are
+	// those of the check
+	OccurrenceHeuristic(const std::vector<double>& occurrences, const std::vector<const Concept*>& concepts);
+	// Short disjunctions first, as they are the closest to being decided
+	double getScore(const Concept* pDisjunction) const;
+	// Adds up, by symbol, the occurrences of the literals in the disjunctions,
+	// halving their weight for each further disjunct
+	static void countOccurrences(const std::vector<const Concept*>& concepts, std::vector<double>& occurrences);
+private:
+	std::vector<double> mOccurrences;
+};
+
+class ActivityHeuristic : public BranchingHeuristic {
+public:
+
+	/** What the heuristic learned, to be carried over to the next check */
+	struct Activities {
+		std::vector<double> scores; // by symbol
+		double increment;
+
+		Activities() :
+		increment(1) { }
+	};
+
+	/** Keeps the activities between the checks made with the same Tbox, which may run in parallel */
+	class Store {
+	public:
+		Store();
+		Store(const Store& store);
+		~Store();
+		Store& operator=(const Store& store);
+		void load(Activities& activities) const;
+		// The last check to finish wins
+		void save(const Activities& activities);
+		void clear();
+	private:
+		mutable pthread_mutex_t mMutex;
+		Activities mActivities;
+	};
+
+	ActivityHeuristic() { }
+	ActivityHeuristic(const Activities& activities) :
+	mActivities(activities) { }
+	double getScore(const Concept* pDisjunction) const {
+		size_t disjunctCount = 0;
+		return sumLiteralScores(pDisjunction, mActivities.scores, disjunctCount);
+	}
+	void notifyClash(const Concept* pConcept);
+	const Activities& getActivities() const {
+		return mActivities;
+	}
+private:
+	Activities mActivities;
+};
+
+}
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "Classifier.h"
+#include "Concept.h"
+#include "ConceptManager.h"
+#include "Model.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace tinyreason
+{
+
+class Classifier::SatisfiabilityJob : public ThreadPool::Job {
+public:
+	SatisfiabilityJob(Classifier* pClassifier, const Reasoner::Limits& limits) :
+	mpClassifier(pClassifier), mLimits(limits) { }
+	void execute(size_t item);
+private:
+	Classifier* mpClassifier;
+	const Reasoner::Limits& mLimits;
+};
+
+class Classifier::SubsumptionJob : public ThreadPool::Job {
+public:
+	SubsumptionJob(Classifier* pClassifier, const std::vector<Entry*>& entries, const Reasoner::Limits& limits) :
+	mpClassifier(pClassifier), mEntries(entries), mLimits(limits) { }
+	void execute(size_t item) {
+		mpClassifier->testCandidates(*mEntries[item], mLimits);
+	}
+private:
+	Classifier* mpClassifier;
+	const std::vector<Entry*>& mEntries;
+	const Reasoner::Limits& mLimits;
+};
+
+// Each item is a different entry, nothing is shared but the counters
+void Classifier::SatisfiabilityJob::execute(size_t item)
+{
+	Entry& entry = mpClassifier->getEntry(mpClassifier->mNames[item]);
+	vector<const Concept*> concepts(1, mpClassifier->mpConceptManager->getAtomicConcept(true, entry.name));
+	Model model;
+	Reasoner::Result result = mpClassifier->mpReasoner->checkSatisfiability(concepts, mLimits, &model);
+	__sync_fetch_and_add(&mpClassifier->mStatistics.satisfiabilityTestCount, 1);
+
+	if (result == Reasoner::RESULT_UNSATISFIABLE)
+		entry.satisfiable = false;
+	else if (result == Reasoner::RESULT_SATISFIABLE)
+	{
+		// The names true at the root of the model
+		for (size_t i = 0; i < model.getIndividualCount(); ++i)
+			if (model.getIndividual(i)->getNodeID() == 1)
+			{
+				const set<const Concept*>& rootConcepts = model.getIndividual(i)->getConcepts();
+				for (set<const Concept*>::const_iterator it = rootConcepts.begin(); it != rootConcepts.end(); ++it)
+					if ((*it)->getType() == Concept::TYPE_POSITIVE_ATOMIC && (*it)->getSymbol() != entry.name &&
+						mpClassifier->mEntries.find((*it)->getSymbol()) != mpClassifier->mEntries.end())
+						entry.candidates.push_back((*it)->getSymbol());
+			}
+		sort(entry.candidates.begin(), entry.candidates.end());
+		entry.exactCandidates = true;
+	} else
+	{
+		for (size_t i = 0; i < mpClassifier->mNames.size(); ++i)
+			if (mpClassifier->mNames[i] != entry.name)
+				entry.candidates.push_back(mpClassifier->mNames[i]);
+		sort(entry.candidates.begin(), entry.candidates.end());
+		__sync_fetch_and_add(&mpClassifier->mStatistics.unknownTestCount, 1);
+	}
+}
+
+// The most general names first
+struct CompareCandidateCounts {
+	template<class T>
+	bool operator()(const T* pEntry1, const T* pEntry2) const {
+		return pEntry1->candidates.size() < pEntry2->candidates.size();
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+Classifier::Classifier(const Reasoner* pReasoner, const ConceptManager* pConceptManager) :
+mpReasoner(pReasoner), mpConceptManager(pConceptManager)
+{
+	pthread_mutex_init(&mMutex, 0);
+	// Every name the Tbox mentions, the simplified axioms may have lost some
+	pConceptManager->getConceptNames(mNames);
+	for (size_t i = 0; i < mNames.size(); ++i)
+		mEntries[mNames[i]] = new Entry(mNames[i]);
+	mStatistics.nameCount = mNames.size();
+}
+
+Classifier::~Classifier()
+{
+	deleteAll(mEntries);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void Classifier::classify(ThreadPool& threadPool, const Reasoner::Limits& limits)
+{
+	unsigned long long startTime = getMicroseconds();
+	// The checks only look concepts up, so everything they need is interned here
+	for (size_t i = 0; i < mNames.size(); ++i)
+	{
+		mpConceptManager->getAtomicConcept(true, mNames[i]);
+		mpConceptManager->getAtomicConcept(false, mNames[i]);
+	}
+
+	SatisfiabilityJob satisfiabilityJob(this, limits);
+	threadPool.run(satisfiabilityJob, mNames.size());
+
+	vector<Entry*> entries;
+	for (map<Symbol, Entry*>::const_iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+		if (it->second->satisfiable)
+			entries.push_back(it->second);
+	stable_sort(entries.begin(), entries.end(), CompareCandidateCounts());
+	SubsumptionJob subsumptionJob(this, entries, limits);
+	threadPool.run(subsumptionJob, entries.size());
+
+	mStatistics.time = getMicroseconds() - startTime;
+}
+
+bool Classifier::isSatisfiable(Symbol name) const
+{
+	return getEntry(name).satisfiable;
+}
+
+const std::set<Symbol>& Classifier::getSubsumers(Symbol name) const
+{
+	return getEntry(name).subsumers;
+}
+
+Classifier::Entry& Classifier::getEntry(Symbol name)
+{
+	map<Symbol, Entry*>::iterator it = mEntries.find(name);
+	if (it == mEntries.end())
+		throw Exception("Not a concept name of the Tbox.");
+	return *it->second;
+}
+
+const Classifier::Entry& Classifier::getEntry(Symbol name) const
+{
+	map<Symbol, Entry*>::const_iterator it = mEntries.find(name);
+	if (it == mEntries.end())
+		throw Exception("Not a concept name of the Tbox.");
+	return *it->second;
+}
+
+void Classifier::testCandidates(Entry& entry, const Reasoner::Limits& limits)
+{
+	vector<const Concept*> concepts(2, mpConceptManager->getAtomicConcept(true, entry.name));
+	for (size_t i = 0; i < entry.candidates.size(); ++i)
+	{
+		Entry& candidate = getEntry(entry.candidates[i]);
+		pthread_mutex_lock(&mMutex);
+		bool known = isKnown(entry, candidate.name);
+		if (!known && !candidate.satisfiable)
+		{
+			recordNonSubsumption(entry, candidate.name);
+			known = true;
+		}
+		pthread_mutex_unlock(&mMutex);
+		if (known)
+		{
+			__sync_fetch_and_add(&mStatistics.prunedTestCount, 1);
+			continue;
+		}
+
+		concepts[1] = mpConceptManager->getAtomicConcept(false, candidate.name);
+		Reasoner::Result result = mpReasoner->checkSatisfiability(concepts, limits);
+		__sync_fetch_and_add(&mStatistics.subsumptionTestCount, 1);
+
+		pthread_mutex_lock(&mMutex);
+		if (result == Reasoner::RESULT_UNSATISFIABLE)
+			recordSubsumption(entry, candidate);
+		else if (result == Reasoner::RESULT_SATISFIABLE)
+			recordNonSubsumption(entry, candidate.name);
+		pthread_mutex_unlock(&mMutex);
+		if (result == Reasoner::RESULT_UNKNOWN)
+			__sync_fetch_and_add(&mStatistics.unknownTestCount, 1);
+	}
+	pthread_mutex_lock(&mMutex);
+	entry.done = true;
+	pthread_mutex_unlock(&mMutex);
+}
+
+// Called with the mutex held
+bool Classifier::isKnown(const Entry& entry, Symbol candidate) const
+{
+	if (entry.subsumers.find(candidate) != entry.subsumers.end() || entry.nonSubsumers.find(candidate) != entry.nonSubsumers.end())
+		return true;
+	// A name below this one that the candidate does not subsume
+	for (size_t i = 0; i < entry.subsumees.size(); ++i)
+		if (entry.subsumees[i]->exactCandidates && entry.subsumees[i]->name != candidate &&
+			!binary_search(entry.subsumees[i]->candidates.begin(), entry.subsumees[i]->candidates.end(), candidate))
+			return true;
+	return false;
+}
+
+// Called with the mutex held
+void Classifier::recordSubsumption(Entry& entry, Entry& subsumer)
+{
+	entry.subsumers.insert(subsumer.name);
+	subsumer.subsumees.push_back(&entry);
+	if (subsumer.done)
+	{
+		entry.subsumers.insert(subsumer.subsumers.begin(), subsumer.subsumers.end());
+		entry.subsumers.erase(entry.name);
+	}
+	// What does not subsume this entry does not subsume the subsumer either
+	subsumer.nonSubsumers.insert(entry.nonSubsumers.begin(), entry.nonSubsumers.end());
+}
+
+// Called with the mutex held
+void Classifier::recordNonSubsumption(Entry& entry, Symbol nonSubsumer)
+{
+	entry.nonSubsumers.insert(nonSubsumer);
+	for (set<Symbol>::const_iterator it = entry.subsumers.begin(); it != entry.subsumers.end(); ++it)
+		getEntry(*it).nonSubsumers.insert(nonSubsumer);
+}
+
+void Classifier::dumpToString(const SymbolDictionary& symbolDictionary, std::ostream& outStream) const
+{
+	map<string, Symbol> names;
+	for (size_t i = 0; i < mNames.size(); ++i)
+		names[symbolDictionary.toName(mNames[i])] = mNames[i];
+
+	for (map<string, Symbol>::const_iterator it = names.begin(); it != names.end(); ++it)
+	{
+		const Entry& entry = getEntry(it->second);
+		outStream << it->first;
+		if (!entry.satisfiable)
+		{
+			outStream << " = " << symbolDictionary.toName(Concept::BOTTOM_SYMBOL) << "\n";
+			continue;
+		}
+		set<Symbol> strictSubsumers;
+		for (set<Symbol>::const_iterator sit = entry.subsumers.begin(); sit != entry.subsumers.end(); ++sit)
+			if (getEntry(*sit).subsumers.count(entry.name))
+				outStream << " = " << symbolDictionary.toName(*sit);
+			else
+				strictSubsumers.insert(*sit);
+		outStream << " <";
+		bool top = true;
+		for (set<Symbol>::const_iterator sit = strictSubsumers.begin(); sit != strictSubsumers.end(); ++sit)
+		{
+			// Direct unless strictly below another subsumer
+			bool direct = true;
+			for (set<Symbol>::const_iterator oit = strictSubsumers.begin(); oit != strictSubsumers.end() && direct; ++oit)
+				if (*oit != *sit && getEntry(*oit).subsumers.count(*sit) && !getEntry(*sit).subsumers.count(*oit))
+					direct = false;
+			if (direct)
+			{
+				outStream << " " << symbolDictionary.toName(*sit);
+				top = false;
+			}
+		}
+		if (top)
+			outStream << " " << symbolDictionary.toName(Concept::TOP_SYMBOL);
+		outStream << "\n";
+	}
+}
+
+}
@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include "Reasoner.h"
+#include <pthread.h>
+
+namespace tinyreason
+{
+
+class ThreadPool;
+
+/**
+ * Computes the subsumption hierarchy of the concept names of a Tbox.
+ *
+ * Each name is first checked for satisfiability, in parallel. The model found
+ * for a satisfiable name A has A at its root, so only the names in the root
+ * label can subsume A: they are the candidates. Then the candidates of each
+ * name are tested, also in parallel, with A and not B unsatisfiable meaning
+ * that B subsumes A. The names with the fewest candidates, the most general
+ * ones, are classified first and every result is shared as soon as it is
+ * known: a name subsumed by an already classified one inherits its
+ * subsumers, and a name that is not subsumed by B tells the same about each
+ * of its subsumers. Tests whose answer is already known are skipped.
+ *
+ * Checks that reach the limits count as failed subsumption tests.
+ */
+class Classifier {
+public:
+
+	struct Statistics {
+		size_t nameCount;
+		size_t satisfiabilityTestCount;
+		size_t subsumptionTestCount;
+		size_t prunedTestCount; // candidate subsumers settled without a test
+		size_t unknownTestCount; // tests stopped by a limit
+		unsigned long long time; // microseconds
+
+		Statistics() :
+		nameCount(0), satisfiabilityTestCount(0), subsumptionTestCount(0), prunedTestCount(0), unknownTestCount(0), time(0) { }
+	};
+
+	Classifier(const Reasoner* pReasoner, const ConceptManager* pConceptManager);
+	~Classifier();
+	void classify(ThreadPool& threadPool, const Reasoner::Limits& limits);
+	const std::vector<Symbol>& getNames() const {
+		return mNames;
+	}
+	bool isSatisfiable(Symbol name) const;
+	const std::set<Symbol>& getSubsumers(Symbol name) const;
+	const Statistics& getStatistics() const {
+		return mStatistics;
+	}
+	// One line per name: its equivalent names then its direct subsumers
+	void dumpToString(const SymbolDictionary& symbolDictionary, std::ostream& outStream) const;
+private:
+	class SatisfiabilityJob;
+	class SubsumptionJob;
+
+	struct Entry {
+		Symbol name;
+		bool satisfiable;
+		bool exactCandidates; // no other name can subsume this one
+		bool done;
+		std::vector<Symbol> candidates; // sorted
+		std::set<Symbol> subsumers; // equivalent names included, the name itself excluded
+		std::set<Symbol> nonSubsumers;
+		std::vector<const Entry*> subsumees;
+
+		Entry(Symbol name) :
+		name(name), satisfiable(true), exactCandidates(false), done(false) { }
+	};
+
+	Entry& getEntry(Symbol name);
+	const Entry& getEntry(Symbol name) const;
+	void testCandidates(Entry& entry, const Reasoner::Limits& limits);
+	bool isKnown(const Entry& entry, Symbol candidate) const;
+	void recordSubsumption(Entry& entry, Entry& subsumer);
+	void recordNonSubsumption(Entry& entry, Symbol nonSubsumer);
+
+	const Reasoner* mpReasoner;
+	const ConceptManager* mpConceptManager;
+	std::vector<Symbol> mNames;
+	std::map<Symbol, Entry*> mEntries;
+	pthread_mutex_t mMutex; // guards the entries during classify()
+	Statistics mStatistics;
+};
+
+}
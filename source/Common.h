@@ -40,11 +40,17 @@
 #include <fstream>
 #include <algorithm>
 #include <tr1/memory>
+#ifdef _WIN32
+#include <ctime>
+#else
+#include <sys/time.h>
+#endif
 #define shared_ptr std::tr1::shared_ptr
 
 namespace tinyreason
 {
 typedef unsigned long Symbol;
+typedef unsigned int ConceptID;
 
 // Forward decls
 class Concept;
@@ -53,6 +59,8 @@ class Reasoner;
 class SymbolDictionary;
 class Model;
 class Individual;
+class ConceptWriter;
+class Snapshot;
 
 // Base classes
 
@@ -67,7 +75,8 @@ public:
 	}
 	virtual ~Exception() throw () { }
 	const char* what() const throw () {
-		return mMessageBuffer.str().c_str();
+		mMessage = mMessageBuffer.str();
+		return mMessage.c_str();
 	}
 	Exception & operator=(const Exception& other) throw () {
 		mMessageBuffer.str(other.mMessageBuffer.str());
@@ -75,6 +84,7 @@ public:
 	}
 protected:
 	std::stringstream mMessageBuffer;
+	mutable std::string mMessage;
 };
 /* Some basic algorithms */
 template<class T>
@@ -103,6 +113,45 @@ inline void deleteAll(std::map<T, Q>& someMap) {
 		delete it->second;
 	someMap.clear();
 }
+/* Deletes the object it points to when it goes out of scope, not copyable */
+template<class T>
+class ScopedPointer {
+public:
+	explicit ScopedPointer(T* pObject = 0) :
+	mpObject(pObject) { }
+	~ScopedPointer() {
+		delete mpObject;
+	}
+	void reset(T* pObject = 0) {
+		if (pObject != mpObject)
+			delete mpObject;
+		mpObject = pObject;
+	}
+	T* get() const {
+		return mpObject;
+	}
+	T* operator->() const {
+		return mpObject;
+	}
+	T& operator*() const {
+		return *mpObject;
+	}
+private:
+	ScopedPointer(const ScopedPointer&);
+	ScopedPointer& operator=(const ScopedPointer&);
+
+	T* mpObject;
+};
+/* Wall clock time in microseconds, only meaningful as a difference */
+inline unsigned long long getMicroseconds() {
+#ifdef _WIN32
+	return (unsigned long long) clock() * 1000000 / CLOCKS_PER_SEC;
+#else
+	timeval tv;
+	gettimeofday(&tv, 0);
+	return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
 template <typename T>
 inline std::string toString(const T& t) {
 	std::stringstream ss;
@@ -27,6 +27,7 @@
  ******************************************************************************/
 
 #include "Concept.h"
+#include "ConceptWriter.h"
 
 using namespace std;
 
@@ -35,27 +36,30 @@ namespace tinyreason
 
 const Concept* Concept::getTopConcept()
 {
-	static Concept top(true, (Symbol) 1);
+	static Concept top(TOP_ID, true, (Symbol) TOP_SYMBOL);
 	return &top;
 }
 
 const Concept* Concept::getBottomConcept()
 {
-	static Concept bottom(true, (Symbol) 0);
+	static Concept bottom(BOTTOM_ID, true, (Symbol) BOTTOM_SYMBOL);
 	return &bottom;
 }
 
-Concept::Concept(bool positive, Symbol symbol) :
+Concept::Concept(ConceptID id, bool positive, Symbol symbol) :
 mType(positive ? TYPE_POSITIVE_ATOMIC : TYPE_NEGATIVE_ATOMIC),
+mID(id),
 mSymbol(symbol) { }
 
-Concept::Concept(Type type, const Concept* pConcept1, const Concept* pConcept2) :
+Concept::Concept(ConceptID id, Type type, const Concept* pConcept1, const Concept* pConcept2) :
 mType(type),
+mID(id),
 mpConcept1(pConcept1),
 mpConcept2(pConcept2) { }
 
-Concept::Concept(Type type, Symbol role, const Concept* pQualificationConcept) :
+Concept::Concept(ConceptID id, Type type, Symbol role, const Concept* pQualificationConcept) :
 mType(type),
+mID(id),
 mRole(role),
 mpQualificationConcept(pQualificationConcept) { }
 
@@ -75,25 +79,12 @@ bool Concept::isExpansionDeterministic() const
 	return true;
 }
 
+// Through the writer, which needs no recursion however deep the concept is
 std::string Concept::toString(const SymbolDictionary& sd) const
 {
-	switch (mType)
-	{
-		case TYPE_POSITIVE_ATOMIC:
-			return sd.toName(mSymbol);
-		case TYPE_NEGATIVE_ATOMIC:
-			return "not " + sd.toName(mSymbol);
-		case TYPE_CONJUNCTION:
-			return "(" + mpConcept1->toString(sd) + " and " + mpConcept2->toString(sd) + ")";
-		case TYPE_DISJUNCTION:
-			return "(" + mpConcept1->toString(sd) + " or " + mpConcept2->toString(sd) + ")";
-		case TYPE_EXISTENTIAL_RESTRICTION:
-			return sd.toName(mRole) + " some " +  mpConcept2->toString(sd);
-		case TYPE_UNIVERSAL_RESTRICTION:
-			return sd.toName(mRole) + " only " + mpConcept2->toString(sd);
-		default:
-			return "INVALID CONCEPT";
-	}
+	ostringstream stream;
+	ConceptWriter(sd).write(stream, this);
+	return stream.str();
 }
 
 }
@@ -46,13 +46,28 @@ public:
 		TYPE_UNIVERSAL_RESTRICTION,
 	};
 
+	enum {
+		BOTTOM_SYMBOL = 0,
+		TOP_SYMBOL = 1
+	};
+
+	// IDs are handed out by the ConceptManager, the built-in concepts come first
+	enum {
+		BOTTOM_ID = 0,
+		TOP_ID = 1,
+		FIRST_FREE_ID = 2
+	};
+
 	static const Concept* getTopConcept();
 	static const Concept* getBottomConcept();
 
-	Concept(bool positive, Symbol symbol);
-	Concept(Type type, const Concept* pConcept1, const Concept* pConcept2);
-	Concept(Type type, Symbol role, const Concept* pQualificationConcept);
+	Concept(ConceptID id, bool positive, Symbol symbol);
+	Concept(ConceptID id, Type type, const Concept* pConcept1, const Concept* pConcept2);
+	Concept(ConceptID id, Type type, Symbol role, const Concept* pQualificationConcept);
 	~Concept();
+	ConceptID getID() const {
+		return mID;
+	}
 	Symbol getSymbol() const {
 		return mSymbol;
 	}
@@ -74,11 +89,20 @@ public:
 	bool isAtomic() const {
 		return mType == TYPE_POSITIVE_ATOMIC || mType == TYPE_NEGATIVE_ATOMIC;
 	}
+	// Top and bottom are recognized by value rather than by address so that
+	// copies living in a mapped Snapshot are equivalent to the built-in ones.
+	bool isTop() const {
+		return mType == TYPE_POSITIVE_ATOMIC && mSymbol == TOP_SYMBOL;
+	}
+	bool isBottom() const {
+		return mType == TYPE_POSITIVE_ATOMIC && mSymbol == BOTTOM_SYMBOL;
+	}
 	bool isExpandable() const;
 	bool isExpansionDeterministic() const;
 	std::string toString(const SymbolDictionary& sd) const;
 private:
 	Type mType;
+	ConceptID mID;
 
 	union {
 		// For atomic concepts
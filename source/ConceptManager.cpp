@@ -28,14 +28,18 @@
 
 #include "ConceptManager.h"
 #include "Concept.h"
+#include "Snapshot.h"
+#include "Abox.h"
 
 using namespace std;
 
 namespace tinyreason
 {
 
-ConceptManager::ConceptManager(SymbolDictionary* pSD) :
-mpSymbolDictionary(pSD) { }
+ConceptManager::ConceptManager(SymbolDictionary* pSD, const Snapshot* pSnapshot) :
+mpSymbolDictionary(pSD),
+mpSnapshot(pSnapshot),
+mFirstConceptID(pSnapshot ? pSnapshot->getConceptCount() : (size_t) Concept::FIRST_FREE_ID) { }
 
 ConceptManager::~ConceptManager() { }
 
@@ -59,19 +63,19 @@ const Concept* ConceptManager::parseConcept(std::istream& source) const
 	return pConcept;
 }
 
-void ConceptManager::parseAssertions(const std::string& str, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles) const
+void ConceptManager::parseAssertions(const std::string& str, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles, Abox* pAbox) const
 {
 	istringstream source(str);
-	return parseAssertions(source, concepts, transitiveRoles);
+	return parseAssertions(source, concepts, transitiveRoles, pAbox);
 }
 
-void ConceptManager::parseAssertions(std::istream& source, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles) const
+void ConceptManager::parseAssertions(std::istream& source, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles, Abox* pAbox) const
 {
 	getNextChar(source);
 	mTokenType = T_EOS;
 	nextToken(source);
 
-	parseAssertionList(source, concepts, transitiveRoles);
+	parseAssertionList(source, concepts, transitiveRoles, pAbox);
 
 	if (mTokenType != T_EOS)
 		throwSyntaxException();
@@ -82,106 +86,442 @@ const Concept* ConceptManager::makeNegation(const Concept* pConcept) const
 	if (pConcept == 0)
 		return 0;
 
-	if (pConcept == Concept::getTopConcept())
+	// The negations of the parts are made first, from a stack of their own so
+	// that deep concepts take no stack. Every negation made is recorded, so
+	// the negations of the parts of a recorded one are always recorded too.
+	vector<const Concept*> pending(1, pConcept);
+	while (!pending.empty())
+	{
+		const Concept* pPending = pending.back();
+		if (getKnownNegation(pPending))
+		{
+			pending.pop_back();
+			continue;
+		}
+		const Concept* pNegation = 0;
+		switch (pPending->getType())
+		{
+			case Concept::TYPE_POSITIVE_ATOMIC:
+				pNegation = getAtomicConcept(false, pPending->getSymbol());
+				break;
+			case Concept::TYPE_NEGATIVE_ATOMIC:
+				pNegation = getAtomicConcept(true, pPending->getSymbol());
+				break;
+			case Concept::TYPE_CONJUNCTION:
+			case Concept::TYPE_DISJUNCTION:
+			{
+				const Concept* pNegation1 = getKnownNegation(pPending->getConcept1());
+				const Concept* pNegation2 = getKnownNegation(pPending->getConcept2());
+				if (!pNegation1)
+					pending.push_back(pPending->getConcept1());
+				if (!pNegation2)
+					pending.push_back(pPending->getConcept2());
+				if (pNegation1 && pNegation2)
+					pNegation = pPending->getType() == Concept::TYPE_CONJUNCTION ? makeDisjunction(pNegation1, pNegation2) : makeConjunction(pNegation1, pNegation2);
+				break;
+			}
+			case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+			case Concept::TYPE_UNIVERSAL_RESTRICTION:
+			{
+				const Concept* pQualificationNegation = getKnownNegation(pPending->getQualificationConcept());
+				if (!pQualificationNegation)
+					pending.push_back(pPending->getQualificationConcept());
+				else if (pPending->getType() == Concept::TYPE_EXISTENTIAL_RESTRICTION)
+					pNegation = makeUniversalRestriction(pPending->getRole(), pQualificationNegation);
+				else
+					pNegation = makeExistentialRestriction(pPending->getRole(), pQualificationNegation);
+				break;
+			}
+			default:
+				throw Exception("Invalid concept received while making negation.");
+		}
+		if (!pNegation)
+			continue;
+		mNegations.insert(ConceptToConceptMap::value_type(pPending, pNegation));
+		if (!mEpochs.empty())
+			mEpochNegations.push_back(pPending);
+		pending.pop_back();
+	}
+	return getKnownNegation(pConcept);
+}
+
+// Top and bottom are each other's negation without being recorded
+const Concept* ConceptManager::getKnownNegation(const Concept* pConcept) const
+{
+	if (pConcept->isTop())
 		return Concept::getBottomConcept();
-	else if (pConcept == Concept::getBottomConcept())
+	else if (pConcept->isBottom())
 		return Concept::getTopConcept();
+	ConceptToConceptMap::const_iterator it = mNegations.find(pConcept);
+	return it == mNegations.end() ? 0 : it->second;
+}
 
-	// neither top nor bottom
-
-	switch (pConcept->getType())
+const Concept* ConceptManager::findNegation(const Concept* pConcept) const
+{
+	if (pConcept->isTop())
+		return Concept::getBottomConcept();
+	else if (pConcept->isBottom())
+		return Concept::getTopConcept();
+	if (pConcept->isAtomic())
 	{
-		case Concept::TYPE_POSITIVE_ATOMIC:
-		{
-			SymbolToConceptMap::iterator it = mNegativeAtomicConcepts.find(pConcept->getSymbol());
-			if (it == mNegativeAtomicConcepts.end())
-				it = mNegativeAtomicConcepts.insert(it, SymbolToConceptMap::value_type(pConcept->getSymbol(), new Concept(false, pConcept->getSymbol())));
+		bool isPositive = pConcept->getType() == Concept::TYPE_NEGATIVE_ATOMIC;
+		const SymbolToConceptMap& symbolToConceptMap = isPositive ? mPositiveAtomicConcepts : mNegativeAtomicConcepts;
+		SymbolToConceptMap::const_iterator it = symbolToConceptMap.find(pConcept->getSymbol());
+		if (it != symbolToConceptMap.end())
 			return it->second;
+		return mpSnapshot ? mpSnapshot->findAtomicConcept(isPositive, pConcept->getSymbol()) : 0;
+	}
+	ConceptToConceptMap::const_iterator it = mNegations.find(pConcept);
+	return it == mNegations.end() ? 0 : it->second;
+}
 
-		}
-		case Concept::TYPE_NEGATIVE_ATOMIC:
+const Concept* ConceptManager::getAtomicConcept(bool isPositive, Symbol symbol) const
+{
+	SymbolToConceptMap* pSymbolToConceptMap;
+
+	if (isPositive)
+		pSymbolToConceptMap = &mPositiveAtomicConcepts;
+	else
+		pSymbolToConceptMap = &mNegativeAtomicConcepts;
+
+	SymbolToConceptMap::iterator it = pSymbolToConceptMap->find(symbol);
+	if (it == pSymbolToConceptMap->end())
+	{
+		if (mpSnapshot)
 		{
-			SymbolToConceptMap::iterator it = mPositiveAtomicConcepts.find(pConcept->getSymbol());
-			if (it == mPositiveAtomicConcepts.end())
-				it = mPositiveAtomicConcepts.insert(it, SymbolToConceptMap::value_type(pConcept->getSymbol(), new Concept(true, pConcept->getSymbol())));
-			return it->second;
+			const Concept* pConcept = mpSnapshot->findAtomicConcept(isPositive, symbol);
+			if (pConcept)
+				return pConcept;
 		}
-		case Concept::TYPE_CONJUNCTION:
+		it = pSymbolToConceptMap->insert(it, SymbolToConceptMap::value_type(symbol, registerConcept(new Concept(getNextConceptID(), isPositive, symbol))));
+	}
+	return it->second;
+}
+
+const Concept* ConceptManager::makeConjunction(const Concept* pConcept1, const Concept* pConcept2) const
+{
+	const Concept* pSimplified = simplifyOperation(Concept::TYPE_CONJUNCTION, pConcept1, pConcept2);
+	if (pSimplified)
+		return pSimplified;
+
+	ConceptPair cp(pConcept1, pConcept2);
+	ConceptPairToConceptMap::iterator it = mConjunctionConcepts.find(cp);
+	if (it == mConjunctionConcepts.end())
+	{
+		it = mConjunctionConcepts.find(ConceptPair(cp.second, cp.first));
+		if (it == mConjunctionConcepts.end())
 		{
-			ConceptPair cp(makeNegation(pConcept->getConcept1()), makeNegation(pConcept->getConcept2()));
-			ConceptPairToConceptMap::iterator it = mDisjunctionConcepts.find(cp);
-			if (it == mDisjunctionConcepts.end())
+			if (mpSnapshot)
 			{
-				ConceptPair swappedCP(cp.second, cp.first);
-				it = mDisjunctionConcepts.find(swappedCP);
-				if (it == mDisjunctionConcepts.end())
-					it = mDisjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(cp, new Concept(Concept::TYPE_DISJUNCTION, cp.first, cp.second)));
+				const Concept* pConcept = mpSnapshot->findConjunction(pConcept1, pConcept2);
+				if (pConcept)
+					return pConcept;
 			}
-			return it->second;
+			it = mConjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(cp, registerConcept(new Concept(getNextConceptID(), Concept::TYPE_CONJUNCTION, cp.first, cp.second))));
 		}
-		case Concept::TYPE_DISJUNCTION:
+	}
+	return it->second;
+}
+
+const Concept* ConceptManager::makeDisjunction(const Concept* pConcept1, const Concept* pConcept2) const
+{
+	const Concept* pSimplified = simplifyOperation(Concept::TYPE_DISJUNCTION, pConcept1, pConcept2);
+	if (pSimplified)
+		return pSimplified;
+
+	ConceptPair cp(pConcept1, pConcept2);
+	ConceptPairToConceptMap::iterator it = mDisjunctionConcepts.find(cp);
+	if (it == mDisjunctionConcepts.end())
+	{
+		it = mDisjunctionConcepts.find(ConceptPair(cp.second, cp.first));
+		if (it == mDisjunctionConcepts.end())
 		{
-			ConceptPair cp(makeNegation(pConcept->getConcept1()), makeNegation(pConcept->getConcept2()));
-			ConceptPairToConceptMap::iterator it = mConjunctionConcepts.find(cp);
-			if (it == mConjunctionConcepts.end())
+			if (mpSnapshot)
 			{
-				ConceptPair swappedCP(cp.second, cp.first);
-				it = mConjunctionConcepts.find(swappedCP);
-				if (it == mConjunctionConcepts.end())
-					it = mConjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(cp, new Concept(Concept::TYPE_CONJUNCTION, cp.first, cp.second)));
+				const Concept* pConcept = mpSnapshot->findDisjunction(pConcept1, pConcept2);
+				if (pConcept)
+					return pConcept;
 			}
-			return it->second;
+			it = mDisjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(cp, registerConcept(new Concept(getNextConceptID(), Concept::TYPE_DISJUNCTION, cp.first, cp.second))));
 		}
-		case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+	}
+	return it->second;
+}
+
+const Concept* ConceptManager::makeExistentialRestriction(Symbol role, const Concept* pQualificationConcept) const
+{
+	if (pQualificationConcept->isBottom())
+		return Concept::getBottomConcept();
+
+	SymbolConceptPair scp(role, pQualificationConcept);
+	SymbolConceptPairToConceptMap::iterator it = mExistentialConcepts.find(scp);
+	if (it == mExistentialConcepts.end())
+	{
+		if (mpSnapshot)
 		{
-			SymbolConceptPair scp(pConcept->getRole(), makeNegation(pConcept->getQualificationConcept()));
-			SymbolConceptPairToConceptMap::iterator it = mUniversalConcepts.find(scp);
-			if (it == mUniversalConcepts.end())
-				it = mUniversalConcepts.insert(it, SymbolConceptPairToConceptMap::value_type(scp, new Concept(Concept::TYPE_UNIVERSAL_RESTRICTION, scp.first, scp.second)));
-			return it->second;
+			const Concept* pConcept = mpSnapshot->findExistentialRestriction(role, pQualificationConcept);
+			if (pConcept)
+				return pConcept;
 		}
-		case Concept::TYPE_UNIVERSAL_RESTRICTION:
+		it = mExistentialConcepts.insert(it, SymbolConceptPairToConceptMap::value_type(scp, registerConcept(new Concept(getNextConceptID(), Concept::TYPE_EXISTENTIAL_RESTRICTION, role, pQualificationConcept))));
+	}
+	return it->second;
+}
+
+const Concept* ConceptManager::makeUniversalRestriction(Symbol role, const Concept* pQualificationConcept) const
+{
+	if (pQualificationConcept->isTop())
+		return Concept::getTopConcept();
+
+	SymbolConceptPair scp(role, pQualificationConcept);
+	SymbolConceptPairToConceptMap::iterator it = mUniversalConcepts.find(scp);
+	if (it == mUniversalConcepts.end())
+	{
+		if (mpSnapshot)
 		{
-			SymbolConceptPair scp(pConcept->getRole(), makeNegation(pConcept->getQualificationConcept()));
-			SymbolConceptPairToConceptMap::iterator it = mExistentialConcepts.find(scp);
-			if (it == mExistentialConcepts.end())
-				it = mExistentialConcepts.insert(it, SymbolConceptPairToConceptMap::value_type(scp, new Concept(Concept::TYPE_EXISTENTIAL_RESTRICTION, scp.first, scp.second)));
-			return it->second;
+			const Concept* pConcept = mpSnapshot->findUniversalRestriction(role, pQualificationConcept);
+			if (pConcept)
+				return pConcept;
+		}
+		it = mUniversalConcepts.insert(it, SymbolConceptPairToConceptMap::value_type(scp, registerConcept(new Concept(getNextConceptID(), Concept::TYPE_UNIVERSAL_RESTRICTION, role, pQualificationConcept))));
+	}
+	return it->second;
+}
+
+// The rules come in dual pairs for conjunctions and disjunctions, so the
+// negation of a simplified concept is simplified as well. Returns 0 when no
+// rule applies.
+const Concept* ConceptManager::simplifyOperation(Concept::Type type, const Concept* pConcept1, const Concept* pConcept2) const
+{
+	bool isConjunction = type == Concept::TYPE_CONJUNCTION;
+	Concept::Type dualType = isConjunction ? Concept::TYPE_DISJUNCTION : Concept::TYPE_CONJUNCTION;
+	const Concept* pAbsorbing = isConjunction ? Concept::getBottomConcept() : Concept::getTopConcept();
+	if (isConjunction ? pConcept1->isBottom() || pConcept2->isBottom() : pConcept1->isTop() || pConcept2->isTop())
+		return pAbsorbing;
+	if (isConjunction ? pConcept1->isTop() : pConcept1->isBottom())
+		return pConcept2;
+	if (isConjunction ? pConcept2->isTop() : pConcept2->isBottom())
+		return pConcept1;
+	if (pConcept1 == pConcept2)
+		return pConcept1;
+	if (areComplements(pConcept1, pConcept2))
+		return pAbsorbing;
+
+	// One operand against the operands of the other: A and (A and B) is
+	// A and B, A and (not A and B) is bottom, A and (A or B) is A and
+	// A and (not A or B) is A and B
+	for (int i = 0; i < 2; ++i)
+	{
+		const Concept* pSingle = i ? pConcept2 : pConcept1;
+		const Concept* pPair = i ? pConcept1 : pConcept2;
+		if (pPair->getType() == type)
+		{
+			if (pPair->getConcept1() == pSingle || pPair->getConcept2() == pSingle)
+				return pPair;
+			if (areComplements(pSingle, pPair->getConcept1()) || areComplements(pSingle, pPair->getConcept2()))
+				return pAbsorbing;
+		} else if (pPair->getType() == dualType)
+		{
+			if (pPair->getConcept1() == pSingle || pPair->getConcept2() == pSingle)
+				return pSingle;
+			if (areComplements(pSingle, pPair->getConcept1()))
+				return makeOperation(type, pSingle, pPair->getConcept2());
+			if (areComplements(pSingle, pPair->getConcept2()))
+				return makeOperation(type, pSingle, pPair->getConcept1());
 		}
-		default:
-			throw Exception("Invalid concept received while making negation.");
 	}
 	return 0;
 }
 
-const Concept* ConceptManager::getAtomicConcept(bool isPositive, Symbol symbol) const
+// True when one concept is the one makeNegation() makes from the other, found
+// without interning the negation. The pairs of operands still to compare are
+// kept on a stack of their own as the concepts may be deep.
+bool ConceptManager::areComplements(const Concept* pConcept1, const Concept* pConcept2)
 {
-	SymbolToConceptMap* pSymbolToConceptMap;
+	struct Comparison {
+		const Concept* pConcept1;
+		const Concept* pConcept2;
+		int stage; // how many of the operand comparisons were made
+	};
+	Comparison first = {pConcept1, pConcept2, 0};
+	vector<Comparison> pending(1, first);
+	bool result = false;
+	while (!pending.empty())
+	{
+		Comparison& comparison = pending.back();
+		const Concept* pFirst = comparison.pConcept1;
+		const Concept* pSecond = comparison.pConcept2;
+		const Concept* pNext1 = 0;
+		const Concept* pNext2 = 0;
+		if (comparison.stage == 0)
+		{
+			if (pFirst->isTop() || pFirst->isBottom() || pSecond->isTop() || pSecond->isBottom())
+				result = pFirst->isTop() ? pSecond->isBottom() : pFirst->isBottom() && pSecond->isTop();
+			else
+				switch (pFirst->getType())
+				{
+					case Concept::TYPE_POSITIVE_ATOMIC:
+						result = pSecond->getType() == Concept::TYPE_NEGATIVE_ATOMIC && pFirst->getSymbol() == pSecond->getSymbol();
+						break;
+					case Concept::TYPE_NEGATIVE_ATOMIC:
+						result = pSecond->getType() == Concept::TYPE_POSITIVE_ATOMIC && pFirst->getSymbol() == pSecond->getSymbol();
+						break;
+					case Concept::TYPE_CONJUNCTION:
+					case Concept::TYPE_DISJUNCTION:
+						result = pSecond->getType() == (pFirst->getType() == Concept::TYPE_CONJUNCTION ? Concept::TYPE_DISJUNCTION : Concept::TYPE_CONJUNCTION);
+						pNext1 = pFirst->getConcept1();
+						pNext2 = pSecond->getConcept1();
+						break;
+					case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+					case Concept::TYPE_UNIVERSAL_RESTRICTION:
+						result = pSecond->getType() == (pFirst->getType() == Concept::TYPE_EXISTENTIAL_RESTRICTION ?
+							Concept::TYPE_UNIVERSAL_RESTRICTION : Concept::TYPE_EXISTENTIAL_RESTRICTION) && pFirst->getRole() == pSecond->getRole();
+						pNext1 = pFirst->getQualificationConcept();
+						pNext2 = pSecond->getQualificationConcept();
+						break;
+					default:
+						result = false;
+				}
+		} else if (pFirst->getType() == Concept::TYPE_CONJUNCTION || pFirst->getType() == Concept::TYPE_DISJUNCTION)
+		{
+			// The interned operands may be in either order: first 1-1 and 2-2, then 1-2 and 2-1
+			if (comparison.stage == 1 && result)
+			{
+				pNext1 = pFirst->getConcept2();
+				pNext2 = pSecond->getConcept2();
+			} else if (comparison.stage == 3 && result)
+			{
+				pNext1 = pFirst->getConcept2();
+				pNext2 = pSecond->getConcept1();
+			} else if (comparison.stage <= 2 && !result)
+			{
+				comparison.stage = 2;
+				pNext1 = pFirst->getConcept1();
+				pNext2 = pSecond->getConcept2();
+				result = true;
+			}
+		}
+		if (result && pNext1)
+		{
+			++comparison.stage;
+			Comparison next = {pNext1, pNext2, 0};
+			pending.push_back(next);
+		} else
+			pending.pop_back();
+	}
+	return result;
+}
 
-	if (isPositive)
-		pSymbolToConceptMap = &mPositiveAtomicConcepts;
-	else
-		pSymbolToConceptMap = &mNegativeAtomicConcepts;
+const Concept* ConceptManager::getConcept(ConceptID id) const
+{
+	if (id == Concept::BOTTOM_ID)
+		return Concept::getBottomConcept();
+	else if (id == Concept::TOP_ID)
+		return Concept::getTopConcept();
+	else if (id < mFirstConceptID)
+		return mpSnapshot ? mpSnapshot->getConcept(id) : 0;
+	else if (id - mFirstConceptID < mConceptsByID.size())
+		return mConceptsByID[id - mFirstConceptID];
+	return 0;
+}
 
-	SymbolToConceptMap::iterator it = pSymbolToConceptMap->find(symbol);
-	if (it == pSymbolToConceptMap->end())
-		it = pSymbolToConceptMap->insert(it, SymbolToConceptMap::value_type(symbol, new Concept(isPositive, symbol)));
-	return it->second;
+void ConceptManager::getConceptNames(std::vector<Symbol>& names) const
+{
+	for (Symbol symbol = 0; symbol < mpSymbolDictionary->getSymbolCount(); ++symbol)
+	{
+		if (symbol == Concept::TOP_SYMBOL || symbol == Concept::BOTTOM_SYMBOL)
+			continue;
+		if (mPositiveAtomicConcepts.count(symbol) || mNegativeAtomicConcepts.count(symbol) ||
+			(mpSnapshot && (mpSnapshot->findAtomicConcept(true, symbol) || mpSnapshot->findAtomicConcept(false, symbol))))
+			names.push_back(symbol);
+	}
+}
+
+// Concepts of a snapshot are mapped from its file and not counted
+size_t ConceptManager::getByteCount() const
+{
+	// A concept, its entry in an interning map and its slot by ID
+	return mConceptsByID.size() * (sizeof (Concept) + 4 * sizeof (void*) + sizeof (ConceptPair) + 2 * sizeof (const Concept*)) +
+		mNegations.size() * (4 * sizeof (void*) + sizeof (ConceptToConceptMap::value_type));
 }
 
 void ConceptManager::clearCache() const
 {
+	mConceptsByID.clear();
+	mNegations.clear();
 	deleteAll(mPositiveAtomicConcepts);
 	deleteAll(mNegativeAtomicConcepts);
 	deleteAll(mConjunctionConcepts);
 	deleteAll(mDisjunctionConcepts);
 	deleteAll(mExistentialConcepts);
 	deleteAll(mUniversalConcepts);
+	mEpochNegations.clear();
+	mEpochs.clear();
+}
+
+size_t ConceptManager::beginEpoch() const
+{
+	Epoch epoch;
+	epoch.conceptCount = mConceptsByID.size();
+	epoch.negationCount = mEpochNegations.size();
+	epoch.symbolCount = mpSymbolDictionary->getSymbolCount();
+	mEpochs.push_back(epoch);
+	return mEpochs.size() - 1;
+}
+
+void ConceptManager::endEpoch(size_t epoch) const
+{
+	if (epoch + 1 != mEpochs.size())
+		throw Exception("Epochs must end in the reverse order they began.");
+	size_t conceptCount = mEpochs.back().conceptCount;
+	size_t negationCount = mEpochs.back().negationCount;
+	Symbol symbolCount = mEpochs.back().symbolCount;
+	mEpochs.pop_back();
+
+	// Either side of a negation made during the epoch may be deleted below
+	for (size_t i = negationCount; i < mEpochNegations.size(); ++i)
+		mNegations.erase(mEpochNegations[i]);
+	mEpochNegations.resize(negationCount);
+	// The IDs are handed out again, most recent concepts first so that
+	// nothing refers to a concept deleted already
+	while (mConceptsByID.size() > conceptCount)
+	{
+		forgetConcept(mConceptsByID.back());
+		delete mConceptsByID.back();
+		mConceptsByID.pop_back();
+	}
+	mpSymbolDictionary->truncate(symbolCount);
+}
+
+// Removes the concept from the map it was interned in
+void ConceptManager::forgetConcept(const Concept* pConcept) const
+{
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_POSITIVE_ATOMIC:
+			mPositiveAtomicConcepts.erase(pConcept->getSymbol());
+			break;
+		case Concept::TYPE_NEGATIVE_ATOMIC:
+			mNegativeAtomicConcepts.erase(pConcept->getSymbol());
+			break;
+		case Concept::TYPE_CONJUNCTION:
+			mConjunctionConcepts.erase(ConceptPair(pConcept->getConcept1(), pConcept->getConcept2()));
+			break;
+		case Concept::TYPE_DISJUNCTION:
+			mDisjunctionConcepts.erase(ConceptPair(pConcept->getConcept1(), pConcept->getConcept2()));
+			break;
+		case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+			mExistentialConcepts.erase(SymbolConceptPair(pConcept->getRole(), pConcept->getQualificationConcept()));
+			break;
+		case Concept::TYPE_UNIVERSAL_RESTRICTION:
+			mUniversalConcepts.erase(SymbolConceptPair(pConcept->getRole(), pConcept->getQualificationConcept()));
+			break;
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void ConceptManager::parseAssertionList(std::istream& source, vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles) const
+void ConceptManager::parseAssertionList(std::istream& source, vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles, Abox* pAbox) const
 {
 	do
 	{
@@ -193,7 +533,16 @@ void ConceptManager::parseAssertionList(std::istream& source, vector<const Conce
 
 		if (mTokenType == T_TRANS) // it's a transitive role assertion
 			parseTransitiveRoleAssertion(source, transitiveRoles);
-		else
+		else if (mTokenType == T_ELEMENT)
+		{
+			// "a in C" and "a R b" start like an atomic concept does
+			Symbol symbol = mpSymbolDictionary->get(mTokenString);
+			nextToken(source);
+			if (mTokenType == T_IN || mTokenType == T_ELEMENT)
+				parseIndividualAssertion(source, symbol, pAbox);
+			else
+				concepts.push_back(parseExpression(source, &symbol));
+		} else
 			concepts.push_back(parseSingleComplexConcept(source));
 
 		while (mTokenType != T_SEMICOLON && mTokenType != T_EOS)
@@ -212,220 +561,159 @@ void ConceptManager::parseTransitiveRoleAssertion(std::istream& source, std::vec
 			throwSyntaxException();
 		transitiveRoles.push_back(mpSymbolDictionary->get(mTokenString));
 		nextToken(source);
-		if (mTokenType == T_SEMICOLON)
-		{
-			nextToken(source);
-			break;
-		}
-	} while (true);
-}
-
-const Concept* ConceptManager::parseSingleComplexConcept(std::istream& source) const
-{
-	return parseEquivalence(source);
+	} while (mTokenType != T_SEMICOLON && mTokenType != T_EOS);
 }
 
-const Concept* ConceptManager::parseEquivalence(std::istream& source) const
+void ConceptManager::parseIndividualAssertion(std::istream& source, Symbol individual, Abox* pAbox) const
 {
-	const Concept* pC1 = parseSubsumption(source);
-	if (mTokenType == T_IS)
+	if (!pAbox)
+		throw Exception("Individual assertions are only allowed in the ontology (individual \"" + mpSymbolDictionary->toName(individual) + "\" found)");
+	if (mTokenType == T_IN)
 	{
 		nextToken(source);
-		const Concept* pC2 = parseEquivalence(source);
-		// Simplifications
-		if (pC1 == Concept::getTopConcept())
-			return pC2;
-		if (pC2 == Concept::getTopConcept())
-			return pC1;
-		const Concept* pNegatedC1 = makeNegation(pC1);
-		const Concept* pNegatedC2 = makeNegation(pC2);
-		if (pC1 == Concept::getBottomConcept())
-			return pNegatedC1;
-		if (pC2 == Concept::getBottomConcept())
-			return pNegatedC2;
-
-		// Ok can't simplify. This is a disjunction of conjunctions (both true or both false)
-		const Concept* pBothTrueConcept, *pBothFalseConcept;
-
-		ConceptPair btcp(pC1, pC2);
-		ConceptPairToConceptMap::iterator it = mConjunctionConcepts.find(btcp);
-		if (it == mConjunctionConcepts.end())
-		{
-			it = mConjunctionConcepts.find(ConceptPair(btcp.second, btcp.first));
-			if (it == mConjunctionConcepts.end())
-				it = mConjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(btcp, new Concept(Concept::TYPE_CONJUNCTION, btcp.first, btcp.second)));
-		}
-		pBothTrueConcept = it->second;
-
-		ConceptPair bfcp(pNegatedC1, pNegatedC2);
-		it = mConjunctionConcepts.find(bfcp);
-		if (it == mConjunctionConcepts.end())
-		{
-			it = mConjunctionConcepts.find(ConceptPair(bfcp.second, bfcp.first));
-			if (it == mConjunctionConcepts.end())
-				it = mConjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(bfcp, new Concept(Concept::TYPE_CONJUNCTION, bfcp.first, bfcp.second)));
-		}
-		pBothFalseConcept = it->second;
-
-		// Then make cojunction
-		ConceptPair conjCP(pBothTrueConcept, pBothFalseConcept);
-		it = mDisjunctionConcepts.find(conjCP);
-		if (it == mDisjunctionConcepts.end())
-		{
-			it = mDisjunctionConcepts.find(ConceptPair(conjCP.second, conjCP.first));
-			if (it == mDisjunctionConcepts.end())
-				it = mDisjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(conjCP, new Concept(Concept::TYPE_DISJUNCTION, conjCP.first, conjCP.second)));
-		}
-		return it->second;
-	}
-	return pC1;
-}
-
-const Concept* ConceptManager::parseSubsumption(std::istream& source) const
-{
-	const Concept* pC1 = parseDisjunction(source);
-	if (mTokenType == T_ISA)
+		pAbox->addConceptAssertion(individual, parseSingleComplexConcept(source));
+	} else
 	{
+		Symbol role = mpSymbolDictionary->get(mTokenString);
 		nextToken(source);
-		const Concept* pC2 = parseSubsumption(source);
-		const Concept* pNegatedC1 = makeNegation(pC1);
-		// Simplifications
-		if (pNegatedC1 == Concept::getTopConcept() || pC2 == Concept::getTopConcept())
-			return Concept::getTopConcept();
-		if (pNegatedC1 == Concept::getBottomConcept())
-			return pC2;
-		if (pC2 == Concept::getBottomConcept())
-			return pNegatedC1;
-
-		ConceptPair cp(pNegatedC1, pC2);
-		ConceptPairToConceptMap::iterator it = mDisjunctionConcepts.find(cp);
-		if (it == mDisjunctionConcepts.end())
-		{
-			it = mDisjunctionConcepts.find(ConceptPair(cp.second, cp.first));
-			if (it == mDisjunctionConcepts.end())
-				it = mDisjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(cp, new Concept(Concept::TYPE_DISJUNCTION, cp.first, cp.second)));
-		}
-		return it->second;
-	}
-	return pC1;
-}
-
-const Concept* ConceptManager::parseDisjunction(std::istream& source) const
-{
-	const Concept* pC1 = parseConjunction(source);
-	if (mTokenType == T_OR)
-	{
+		if (mTokenType != T_ELEMENT)
+			throwSyntaxException();
+		pAbox->addRoleAssertion(individual, role, mpSymbolDictionary->get(mTokenString));
 		nextToken(source);
-		const Concept * pC2 = parseDisjunction(source);
-
-		// Simplifications
-		if (pC1 == Concept::getTopConcept() || pC2 == Concept::getTopConcept())
-			return Concept::getTopConcept();
-		if (pC1 == Concept::getBottomConcept())
-			return pC2;
-		if (pC2 == Concept::getBottomConcept())
-			return pC1;
-
-		ConceptPair cp(pC1, pC2);
-		ConceptPairToConceptMap::iterator it = mDisjunctionConcepts.find(cp);
-		if (it == mDisjunctionConcepts.end())
-		{
-			it = mDisjunctionConcepts.find(ConceptPair(cp.second, cp.first));
-			if (it == mDisjunctionConcepts.end())
-				it = mDisjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(cp, new Concept(Concept::TYPE_DISJUNCTION, cp.first, cp.second)));
-		}
-		return it->second;
 	}
-	return pC1;
 }
 
-const Concept* ConceptManager::parseConjunction(std::istream& source) const
+const Concept* ConceptManager::parseSingleComplexConcept(std::istream& source) const
 {
-	const Concept* pC1 = parseSimpleConcept(source);
-	if (mTokenType == T_AND)
-	{
-		nextToken(source);
-		const Concept * pC2 = parseConjunction(source);
-
-		// Simplifications
-		if (pC1 == Concept::getBottomConcept() || pC2 == Concept::getBottomConcept())
-			return Concept::getBottomConcept();
-		if (pC1 == Concept::getTopConcept())
-			return pC2;
-		if (pC2 == Concept::getTopConcept())
-			return pC1;
-
-		ConceptPair cp(pC1, pC2);
-		ConceptPairToConceptMap::iterator it = mConjunctionConcepts.find(cp);
-		if (it == mConjunctionConcepts.end())
-		{
-			it = mConjunctionConcepts.find(ConceptPair(pC2, pC1));
-
-			if (it == mConjunctionConcepts.end())
-				it = mConjunctionConcepts.insert(it, ConceptPairToConceptMap::value_type(cp, new Concept(Concept::TYPE_CONJUNCTION, pC1, pC2)));
-		}
-		return it->second;
-	}
-	return pC1;
+	return parseExpression(source);
 }
 
-const Concept* ConceptManager::parseSimpleConcept(std::istream& source) const
+// Iterative, so that neither long chains of operators nor deep nesting take
+// any stack: the operators wait on a stack of their own for their right
+// operand. The binary ones associate to the right, "A or B or C" being
+// "A or (B or C)", and bind from "and" (tightest) to "or", "isa" and "is";
+// prefixes bind to the simple concept that follows them.
+const Concept* ConceptManager::parseExpression(std::istream& source, const Symbol* pFirstElement) const
 {
-	switch (mTokenType)
+	vector<PendingOperator> operators;
+	vector<const Concept*> operands;
+	size_t openCount = 0;
+	do
 	{
-		case T_THING:
-			nextToken(source);
-			return Concept::getTopConcept();
-
-		case T_NOTHING:
-			nextToken(source);
-			return Concept::getBottomConcept();
-
-		case T_ELEMENT:
+		// A simple concept, after its prefixes and open parentheses
+		const Concept* pConcept = 0;
+		while (!pConcept)
 		{
-			Symbol s = mpSymbolDictionary->get(mTokenString);
-			nextToken(source);
-			if (mTokenType == T_SOME)
+			PendingOperator pendingOperator = {mTokenType, 0};
+			if (pFirstElement || mTokenType == T_ELEMENT)
 			{
-				nextToken(source);
-				const Concept* pConcept = parseSimpleConcept(source);
-				SymbolConceptPairToConceptMap::iterator it = mExistentialConcepts.find(SymbolConceptPair(s, pConcept));
-				if (it == mExistentialConcepts.end())
-					it = mExistentialConcepts.insert(it, SymbolConceptPairToConceptMap::value_type(
-					SymbolConceptPair(s, pConcept), new Concept(Concept::TYPE_EXISTENTIAL_RESTRICTION, s, pConcept)));
-				return it->second;
-
-			} else if (mTokenType == T_ONLY)
+				// The name is a role if a restriction follows
+				Symbol symbol = pFirstElement ? *pFirstElement : mpSymbolDictionary->get(mTokenString);
+				if (!pFirstElement)
+					nextToken(source);
+				pFirstElement = 0;
+				if (mTokenType != T_SOME && mTokenType != T_ONLY)
+				{
+					pConcept = getAtomicConcept(true, symbol);
+					break;
+				}
+				pendingOperator.type = mTokenType;
+				pendingOperator.role = symbol;
+			} else if (mTokenType == T_THING || mTokenType == T_NOTHING)
 			{
+				pConcept = mTokenType == T_THING ? Concept::getTopConcept() : Concept::getBottomConcept();
 				nextToken(source);
-				const Concept* pConcept = parseSimpleConcept(source);
-				SymbolConceptPairToConceptMap::iterator it = mUniversalConcepts.find(SymbolConceptPair(s, pConcept));
-				if (it == mUniversalConcepts.end())
-					it = mUniversalConcepts.insert(it, SymbolConceptPairToConceptMap::value_type(
-					SymbolConceptPair(s, pConcept), new Concept(Concept::TYPE_UNIVERSAL_RESTRICTION, s, pConcept)));
-				return it->second;
-			} else
-				return getAtomicConcept(true, s);
-		}
-		case T_NOT: // Negation
+				break;
+			} else if (mTokenType == T_LPAR)
+				++openCount;
+			else if (mTokenType != T_NOT)
+				throwSyntaxException();
+			operators.push_back(pendingOperator);
 			nextToken(source);
-			return makeNegation(parseSimpleConcept(source));
+		}
 
-		case T_LPAR: // sub concept
+		// Its prefixes apply, and so do those of the parentheses it closes
+		do
 		{
+			while (!operators.empty() && operators.back().type != T_LPAR && getPrecedence(operators.back().type) < 0)
+			{
+				pConcept = applyOperator(operators.back(), pConcept);
+				operators.pop_back();
+			}
+			if (mTokenType != T_RPAR || !openCount)
+				break;
+			while (operators.back().type != T_LPAR)
+			{
+				pConcept = applyOperator(operators.back(), operands.back(), pConcept);
+				operators.pop_back();
+				operands.pop_back();
+			}
+			operators.pop_back();
+			--openCount;
 			nextToken(source);
-			const Concept* pConcept = parseSingleComplexConcept(source);
-			if (mTokenType != T_RPAR)
-				throwSyntaxException();
-			nextToken(source);
+		} while (true);
 
+		// The operators before it that bind tighter than the next one have
+		// both operands now
+		int precedence = getPrecedence(mTokenType);
+		while (!operators.empty() && operators.back().type != T_LPAR && getPrecedence(operators.back().type) > precedence)
+		{
+			pConcept = applyOperator(operators.back(), operands.back(), pConcept);
+			operators.pop_back();
+			operands.pop_back();
+		}
+		if (precedence < 0)
+		{
+			if (openCount)
+				throwSyntaxException();
 			return pConcept;
 		}
+		operands.push_back(pConcept);
+		PendingOperator pendingOperator = {mTokenType, 0};
+		operators.push_back(pendingOperator);
+		nextToken(source);
+	} while (true);
+}
 
+const Concept* ConceptManager::applyOperator(const PendingOperator& pendingOperator, const Concept* pConcept1, const Concept* pConcept2) const
+{
+	switch (pendingOperator.type)
+	{
+		case T_NOT:
+			return makeNegation(pConcept1);
+		case T_SOME:
+			return makeExistentialRestriction(pendingOperator.role, pConcept1);
+		case T_ONLY:
+			return makeUniversalRestriction(pendingOperator.role, pConcept1);
+		case T_AND:
+			return makeConjunction(pConcept1, pConcept2);
+		case T_OR:
+			return makeDisjunction(pConcept1, pConcept2);
+		case T_ISA:
+			return makeDisjunction(makeNegation(pConcept1), pConcept2);
+		case T_IS:
+			// A disjunction of conjunctions (both true or both false)
+			return makeDisjunction(makeConjunction(pConcept1, pConcept2), makeConjunction(makeNegation(pConcept1), makeNegation(pConcept2)));
 		default:
-			throwSyntaxException();
+			throw Exception("Invalid operator received while parsing.");
+	}
+}
+
+int ConceptManager::getPrecedence(TokenType type)
+{
+	switch (type)
+	{
+		case T_IS:
+			return 0;
+		case T_ISA:
+			return 1;
+		case T_OR:
+			return 2;
+		case T_AND:
+			return 3;
+		default:
+			return -1;
 	}
-	return 0;
 }
 
 void ConceptManager::nextToken(std::istream & source) const
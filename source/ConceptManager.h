@@ -30,24 +30,57 @@
 
 #include "Common.h"
 #include "SymbolDictionary.h"
+#include "Concept.h"
 
 namespace tinyreason
 {
-class Concept;
+class Snapshot;
+class Abox;
 
 class ConceptManager {
+	friend class Snapshot;
+
 public:
-	ConceptManager(SymbolDictionary* pSD);
+	ConceptManager(SymbolDictionary* pSD, const Snapshot* pSnapshot = 0);
 	~ConceptManager();
 	const Concept* parseConcept(const std::string& str) const;
 	const Concept* parseConcept(std::istream& source) const;
 
-	void parseAssertions(const std::string& str, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles) const;
-	void parseAssertions(std::istream& source, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles) const;
+	// Individual assertions are only accepted when an Abox is given
+	void parseAssertions(const std::string& str, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles, Abox* pAbox = 0) const;
+	void parseAssertions(std::istream& source, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles, Abox* pAbox = 0) const;
 
+	// The constructors simplify their result: top, bottom, duplicate and
+	// complementary operands, absorption and restrictions on top or bottom
 	const Concept* makeNegation(const Concept* pConcept) const;
+	// The negation if it was made already, 0 otherwise: nothing is interned
+	const Concept* findNegation(const Concept* pConcept) const;
 	const Concept* getAtomicConcept(bool isPositive, Symbol symbol) const;
+	const Concept* makeConjunction(const Concept* pConcept1, const Concept* pConcept2) const;
+	const Concept* makeDisjunction(const Concept* pConcept1, const Concept* pConcept2) const;
+	const Concept* makeExistentialRestriction(Symbol role, const Concept* pQualificationConcept) const;
+	const Concept* makeUniversalRestriction(Symbol role, const Concept* pQualificationConcept) const;
+	const Concept* getConcept(ConceptID id) const;
+	// The names used as concepts so far, in symbol order: simplification may
+	// have left them out of the concepts built, but their atomic concepts stay
+	void getConceptNames(std::vector<Symbol>& names) const;
+	size_t getByteCount() const; // estimated size of the concepts interned by this manager
 	void clearCache() const;
+
+	// The concepts interned from beginEpoch() on are deleted by the matching
+	// endEpoch(), the ones interned before (the Tbox) stay. Epochs nest and
+	// end in reverse order; the negations made during one are forgotten too,
+	// and so are the symbols it defined.
+	size_t beginEpoch() const;
+	void endEpoch(size_t epoch) const;
+	// True when the concept goes away at the end of the outermost epoch
+	bool isReclaimable(const Concept* pConcept) const {
+		return !mEpochs.empty() && pConcept->getID() >= mFirstConceptID + mEpochs.front().conceptCount;
+	}
+	// True when the symbol may name something else after the outermost epoch
+	bool isReclaimable(Symbol symbol) const {
+		return !mEpochs.empty() && symbol >= mEpochs.front().symbolCount;
+	}
 private:
 
 	enum TokenType {
@@ -70,19 +103,42 @@ private:
 		T_TRANS,
 	};
 
-	void parseAssertionList(std::istream& source, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles) const;
+	void parseAssertionList(std::istream& source, std::vector<const Concept*>& concepts, std::vector<Symbol>& transitiveRoles, Abox* pAbox) const;
 	void parseTransitiveRoleAssertion(std::istream& source, std::vector<Symbol>& transitiveRoles) const;
+	void parseIndividualAssertion(std::istream& source, Symbol individual, Abox* pAbox) const;
 	const Concept* parseSingleComplexConcept(std::istream& source) const;
 
-	const Concept* parseEquivalence(std::istream& source) const;
-	const Concept* parseSubsumption(std::istream& source) const;
-	const Concept* parseDisjunction(std::istream& source) const;
-	const Concept* parseConjunction(std::istream& source) const;
-	const Concept* parseSimpleConcept(std::istream& source) const;
+	// An operator whose right operand is being parsed: a binary one (its left
+	// operand waits on the operand stack), a prefix or an open parenthesis
+	struct PendingOperator {
+		TokenType type;
+		Symbol role; // of "some" and "only"
+	};
+
+	// pFirstElement is the leftmost name when it was read already
+	const Concept* parseExpression(std::istream& source, const Symbol* pFirstElement = 0) const;
+	const Concept* applyOperator(const PendingOperator& pendingOperator, const Concept* pConcept1, const Concept* pConcept2 = 0) const;
+	// Of the binary operators, -1 for the other tokens
+	static int getPrecedence(TokenType type);
+
+	const Concept* simplifyOperation(Concept::Type type, const Concept* pConcept1, const Concept* pConcept2) const;
+	const Concept* makeOperation(Concept::Type type, const Concept* pConcept1, const Concept* pConcept2) const {
+		return type == Concept::TYPE_CONJUNCTION ? makeConjunction(pConcept1, pConcept2) : makeDisjunction(pConcept1, pConcept2);
+	}
+	static bool areComplements(const Concept* pConcept1, const Concept* pConcept2);
+	const Concept* getKnownNegation(const Concept* pConcept) const;
+	void forgetConcept(const Concept* pConcept) const;
 
 	void nextToken(std::istream& source) const;
 	void scanElement(std::istream& source) const;
 	void throwSyntaxException() const;
+	ConceptID getNextConceptID() const {
+		return mFirstConceptID + mConceptsByID.size();
+	}
+	const Concept* registerConcept(const Concept* pConcept) const {
+		mConceptsByID.push_back(pConcept);
+		return pConcept;
+	}
 	inline void getNextChar(std::istream& source) const {
 		mCurrChar = source.get();
 	}
@@ -94,11 +150,13 @@ private:
 	typedef std::pair<const Concept*, const Concept*> ConceptPair;
 	typedef std::pair<Symbol, const Concept*> SymbolConceptPair;
 
+	typedef std::map< const Concept*, const Concept*> ConceptToConceptMap;
 	typedef std::map< Symbol, const Concept*> SymbolToConceptMap;
 	typedef std::map< ConceptPair, const Concept*> ConceptPairToConceptMap;
 	typedef std::map< SymbolConceptPair, const Concept*> SymbolConceptPairToConceptMap;
 
 	SymbolDictionary* mpSymbolDictionary;
+	const Snapshot* mpSnapshot;
 
 	mutable SymbolToConceptMap mPositiveAtomicConcepts;
 	mutable SymbolToConceptMap mNegativeAtomicConcepts;
@@ -106,6 +164,21 @@ private:
 	mutable ConceptPairToConceptMap mDisjunctionConcepts;
 	mutable SymbolConceptPairToConceptMap mExistentialConcepts;
 	mutable SymbolConceptPairToConceptMap mUniversalConcepts;
+	// Negations already made, looked up without interning anything
+	mutable ConceptToConceptMap mNegations;
+	// Concepts created by this manager indexed by ID, starting from mFirstConceptID
+	ConceptID mFirstConceptID;
+	mutable std::vector<const Concept*> mConceptsByID;
+	// The concepts whose negation was recorded while an epoch was open
+	mutable std::vector<const Concept*> mEpochNegations;
+	// Of every open epoch, the sizes of mConceptsByID, mEpochNegations and the
+	// symbol dictionary when it began
+	struct Epoch {
+		size_t conceptCount;
+		size_t negationCount;
+		Symbol symbolCount;
+	};
+	mutable std::vector<Epoch> mEpochs;
 
 	mutable TokenType mTokenType;
 	mutable std::string mTokenString;
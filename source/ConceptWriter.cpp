@@ -0,0 +1,189 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "ConceptWriter.h"
+#include "Concept.h"
+#include "SymbolDictionary.h"
+#include <cstring>
+
+using namespace std;
+
+namespace tinyreason
+{
+
+ConceptWriter::ConceptWriter(const SymbolDictionary& symbolDictionary, bool useIDs) : mSymbolDictionary(symbolDictionary), mUseIDs(useIDs) { }
+
+void ConceptWriter::write(std::ostream& outStream, const Concept* pConcept)
+{
+	render(pConcept);
+	if (mUseIDs)
+	{
+		outStream << '#' << pConcept->getID();
+		mUsedIDs.insert(pConcept->getID());
+		return;
+	}
+	writeRendering(outStream, pConcept->getID());
+}
+
+void ConceptWriter::writeLegend(std::ostream& outStream, const char* separator)
+{
+	for (set<ConceptID>::const_iterator it = mUsedIDs.begin(); it != mUsedIDs.end(); ++it)
+	{
+		outStream << '#' << *it << ": ";
+		writeRendering(outStream, *it);
+		outStream << separator;
+	}
+}
+
+// Subconcepts are rendered before the concepts referring to them, with an explicit stack as concepts can be very deep
+void ConceptWriter::render(const Concept* pConcept)
+{
+	vector<const Concept*> stack(1, pConcept);
+	while (!stack.empty())
+	{
+		const Concept* pTop = stack.back();
+		if (isRendered(pTop))
+		{
+			stack.pop_back();
+			continue;
+		}
+		Concept::Type type = pTop->getType();
+		const Concept* pFirst = 0;
+		const Concept* pSecond = 0;
+		if (type == Concept::TYPE_CONJUNCTION || type == Concept::TYPE_DISJUNCTION)
+		{
+			pFirst = pTop->getConcept1();
+			pSecond = pTop->getConcept2();
+		} else if (type == Concept::TYPE_EXISTENTIAL_RESTRICTION || type == Concept::TYPE_UNIVERSAL_RESTRICTION)
+			pFirst = pTop->getQualificationConcept();
+		bool ready = true;
+		if (pSecond && !isRendered(pSecond))
+		{
+			stack.push_back(pSecond);
+			ready = false;
+		}
+		if (pFirst && !isRendered(pFirst))
+		{
+			stack.push_back(pFirst);
+			ready = false;
+		}
+		if (ready)
+		{
+			renderOne(pTop);
+			stack.pop_back();
+		}
+	}
+}
+
+// Expects the subconcepts rendered already
+void ConceptWriter::renderOne(const Concept* pConcept)
+{
+	ConceptID id = pConcept->getID();
+	size_t firstPiece = mPieces.size();
+	Concept::Type type = pConcept->getType();
+	switch (type)
+	{
+		case Concept::TYPE_CONJUNCTION:
+		case Concept::TYPE_DISJUNCTION:
+		{
+			const char* op = type == Concept::TYPE_CONJUNCTION ? " and " : " or ";
+			appendText("(", 1);
+			appendReference(pConcept->getConcept1());
+			appendText(op, strlen(op));
+			appendReference(pConcept->getConcept2());
+			appendText(")", 1);
+			break;
+		}
+		case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+		case Concept::TYPE_UNIVERSAL_RESTRICTION:
+		{
+			string prefix = mSymbolDictionary.toName(pConcept->getRole()) +
+				(type == Concept::TYPE_EXISTENTIAL_RESTRICTION ? " some " : " only ");
+			appendText(prefix.data(), prefix.size());
+			appendReference(pConcept->getQualificationConcept());
+			break;
+		}
+		case Concept::TYPE_POSITIVE_ATOMIC:
+		case Concept::TYPE_NEGATIVE_ATOMIC:
+		{
+			string name = mSymbolDictionary.toName(pConcept->getSymbol());
+			if (type == Concept::TYPE_NEGATIVE_ATOMIC)
+				name = "not " + name;
+			appendText(name.data(), name.size());
+			break;
+		}
+		default:
+			appendText("INVALID CONCEPT", 15);
+	}
+	if (id >= mRenderings.size())
+		mRenderings.resize(id + 1);
+	mRenderings[id].firstPiece = firstPiece;
+	mRenderings[id].pieceCount = mPieces.size() - firstPiece;
+}
+
+bool ConceptWriter::isRendered(const Concept* pConcept) const
+{
+	ConceptID id = pConcept->getID();
+	return id < mRenderings.size() && mRenderings[id].firstPiece != NOT_RENDERED;
+}
+
+void ConceptWriter::appendText(const char* text, size_t length)
+{
+	mPieces.push_back(Piece(mBuffer.size(), length));
+	mBuffer.insert(mBuffer.end(), text, text + length);
+}
+
+void ConceptWriter::appendReference(const Concept* pConcept)
+{
+	mPieces.push_back(Piece(pConcept->getID(), REFERENCE));
+}
+
+// Follows the references with an explicit stack of the pieces left to write
+void ConceptWriter::writeRendering(std::ostream& outStream, ConceptID id) const
+{
+	vector<pair<size_t, size_t> > stack; // next piece, end
+	const Rendering& rendering = mRenderings[id];
+	stack.push_back(make_pair(rendering.firstPiece, rendering.firstPiece + rendering.pieceCount));
+	while (!stack.empty())
+	{
+		if (stack.back().first == stack.back().second)
+		{
+			stack.pop_back();
+			continue;
+		}
+		const Piece& piece = mPieces[stack.back().first++];
+		if (piece.length == REFERENCE)
+		{
+			const Rendering& child = mRenderings[piece.offset];
+			stack.push_back(make_pair(child.firstPiece, child.firstPiece + child.pieceCount));
+		} else
+			outStream.write(&mBuffer[piece.offset], piece.length);
+	}
+}
+
+}
@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+
+namespace tinyreason
+{
+
+/**
+ * Writes concepts to a stream. Concepts are interned, so each one is rendered
+ * once: its rendering holds its own fixed text and references to the
+ * renderings of its subconcepts, and writing follows those references. Dumping
+ * a model repeats the same concepts on many individuals and no string is built
+ * per write, while deep or long concepts take memory linear in their size.
+ *
+ * With useIDs the writer prints "#<id>" instead and remembers the concepts it
+ * printed, writeLegend() then prints each of them once with its text.
+ */
+class ConceptWriter {
+public:
+	ConceptWriter(const SymbolDictionary& symbolDictionary, bool useIDs = false);
+	void write(std::ostream& outStream, const Concept* pConcept);
+	void writeLegend(std::ostream& outStream, const char* separator = "\n");
+	bool isUsingIDs() const {
+		return mUseIDs;
+	}
+	const SymbolDictionary& getSymbolDictionary() const {
+		return mSymbolDictionary;
+	}
+private:
+	// Text in mBuffer, or with length REFERENCE the rendering of the concept with ID offset
+	struct Piece {
+		Piece(size_t offset, size_t length) : offset(offset), length(length) { }
+		size_t offset;
+		size_t length;
+	};
+	struct Rendering {
+		Rendering() : firstPiece(NOT_RENDERED), pieceCount(0) { }
+		size_t firstPiece;
+		size_t pieceCount;
+	};
+	static const size_t NOT_RENDERED = (size_t) -1;
+	static const size_t REFERENCE = (size_t) -1;
+
+	void render(const Concept* pConcept);
+	void renderOne(const Concept* pConcept);
+	bool isRendered(const Concept* pConcept) const;
+	void appendText(const char* text, size_t length);
+	void appendReference(const Concept* pConcept);
+	void writeRendering(std::ostream& outStream, ConceptID id) const;
+
+	const SymbolDictionary& mSymbolDictionary;
+	bool mUseIDs;
+	std::vector<char> mBuffer;
+	std::vector<Piece> mPieces;
+	std::vector<Rendering> mRenderings; // by concept ID
+	std::set<ConceptID> mUsedIDs;
+};
+
+}
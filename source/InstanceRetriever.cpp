@@ -0,0 +1,848 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "InstanceRetriever.h"
+#include "Concept.h"
+#include "ConceptManager.h"
+#include "Abox.h"
+#include "Model.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace tinyreason
+{
+
+/** The deterministic rules applied to the asserted individuals, without any choice or new node */
+class InstanceRetriever::Precompletion {
+public:
+	Precompletion(const Reasoner* pReasoner, const ConceptManager* pConceptManager, const Abox* pAbox);
+	bool run(); // false on a clash
+	void getLabels(std::vector<Label>& labels) const;
+private:
+	bool add(size_t individual, const Concept* pConcept);
+	bool apply(size_t individual, const Concept* pConcept);
+	bool isDecided(size_t individual, const Concept* pDisjunction, const Concept*& pConsequence) const;
+	bool holds(size_t individual, const Concept* pConcept) const;
+	bool clashesWith(size_t individual, const Concept* pConcept) const;
+	void markGrown(size_t individual);
+
+	const Reasoner* mpReasoner;
+	const ConceptManager* mpConceptManager;
+	const Abox* mpAbox;
+	std::vector< std::set<const Concept*> > mLabels;
+	std::vector< std::vector<size_t> > mPredecessors;
+	// Disjunctions that needed a choice, looked at again when their label grows
+	std::vector< std::vector<const Concept*> > mPendingDisjunctions;
+	std::vector<bool> mGrown;
+	std::vector<size_t> mGrownIndividuals;
+	std::vector< std::pair<size_t, const Concept*> > mQueue;
+};
+
+class InstanceRetriever::LocalModelJob : public ThreadPool::Job {
+public:
+	LocalModelJob(InstanceRetriever* pRetriever, const std::vector<size_t>& individuals, const Reasoner::Limits& limits) :
+	mpRetriever(pRetriever), mIndividuals(individuals), mLimits(limits) { }
+	void execute(size_t item) {
+		mpRetriever->checkLocalModel(mIndividuals[item], mLimits);
+	}
+private:
+	InstanceRetriever* mpRetriever;
+	const std::vector<size_t>& mIndividuals;
+	const Reasoner::Limits& mLimits;
+};
+
+class InstanceRetriever::PartJob : public ThreadPool::Job {
+public:
+	PartJob(InstanceRetriever* pRetriever, const std::vector<size_t>& parts, const Reasoner::Limits& limits) :
+	mpRetriever(pRetriever), mParts(parts), mLimits(limits) { }
+	void execute(size_t item) {
+		mpRetriever->checkPart(mParts[item], mLimits);
+	}
+private:
+	InstanceRetriever* mpRetriever;
+	const std::vector<size_t>& mParts;
+	const Reasoner::Limits& mLimits;
+};
+
+class InstanceRetriever::RetrievalJob : public ThreadPool::Job {
+public:
+	RetrievalJob(InstanceRetriever* pRetriever, const std::vector<size_t>& parts, const Concept* pConcept, const Concept* pNegation,
+		const Reasoner::Limits& limits, std::vector<char>& answers) :
+	mpRetriever(pRetriever), mParts(parts), mpConcept(pConcept), mpNegation(pNegation), mLimits(limits), mAnswers(answers) { }
+	void execute(size_t item) {
+		mpRetriever->testCandidates(mParts[item], mpConcept, mpNegation, mLimits, mAnswers);
+	}
+private:
+	InstanceRetriever* mpRetriever;
+	const std::vector<size_t>& mParts;
+	const Concept* mpConcept;
+	const Concept* mpNegation;
+	const Reasoner::Limits& mLimits;
+	std::vector<char>& mAnswers;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+InstanceRetriever::Precompletion::Precompletion(const Reasoner* pReasoner, const ConceptManager* pConceptManager, const Abox* pAbox) :
+mpReasoner(pReasoner), mpConceptManager(pConceptManager), mpAbox(pAbox),
+mLabels(pAbox->getIndividualCount()), mPredecessors(pAbox->getIndividualCount()), mPendingDisjunctions(pAbox->getIndividualCount()),
+mGrown(pAbox->getIndividualCount(), false)
+{
+	for (size_t i = 0; i < pAbox->getIndividualCount(); ++i)
+		for (size_t j = 0; j < pAbox->getSuccessors(i).size(); ++j)
+			mPredecessors[pAbox->getSuccessors(i)[j].second].push_back(i);
+}
+
+bool InstanceRetriever::Precompletion::run()
+{
+	const vector<const Concept*>& tbox = mpReasoner->getTboxConcepts();
+	for (size_t i = 0; i < mpAbox->getIndividualCount(); ++i)
+	{
+		for (size_t j = 0; j < tbox.size(); ++j)
+			if (!add(i, tbox[j]))
+				return false;
+		for (size_t j = 0; j < mpAbox->getConcepts(i).size(); ++j)
+			if (!add(i, mpAbox->getConcepts(i)[j]))
+				return false;
+	}
+
+	while (!mQueue.empty() || !mGrownIndividuals.empty())
+	{
+		while (!mQueue.empty())
+		{
+			pair<size_t, const Concept*> entry = mQueue.back();
+			mQueue.pop_back();
+			if (!apply(entry.first, entry.second))
+				return false;
+		}
+		vector<size_t> grownIndividuals;
+		grownIndividuals.swap(mGrownIndividuals);
+		for (size_t i = 0; i < grownIndividuals.size(); ++i)
+		{
+			size_t individual = grownIndividuals[i];
+			mGrown[individual] = false;
+			vector<const Concept*> disjunctions;
+			disjunctions.swap(mPendingDisjunctions[individual]);
+			for (size_t j = 0; j < disjunctions.size(); ++j)
+			{
+				const Concept* pConsequence;
+				if (!isDecided(individual, disjunctions[j], pConsequence))
+					mPendingDisjunctions[individual].push_back(disjunctions[j]);
+				else if (pConsequence && !add(individual, pConsequence))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+void InstanceRetriever::Precompletion::getLabels(std::vector<Label>& labels) const
+{
+	labels.assign(mLabels.size(), Label());
+	for (size_t i = 0; i < mLabels.size(); ++i)
+		labels[i].assign(mLabels[i].begin(), mLabels[i].end());
+}
+
+bool InstanceRetriever::Precompletion::add(size_t individual, const Concept* pConcept)
+{
+	if (pConcept->isTop())
+		return true;
+	if (clashesWith(individual, pConcept))
+		return false;
+	if (!mLabels[individual].insert(pConcept).second)
+		return true;
+	mQueue.push_back(pair<size_t, const Concept*>(individual, pConcept));
+	// Disjunctions look at the labels of the successors too
+	markGrown(individual);
+	for (size_t i = 0; i < mPredecessors[individual].size(); ++i)
+		markGrown(mPredecessors[individual][i]);
+	return true;
+}
+
+void InstanceRetriever::Precompletion::markGrown(size_t individual)
+{
+	if (!mPendingDisjunctions[individual].empty() && !mGrown[individual])
+	{
+		mGrown[individual] = true;
+		mGrownIndividuals.push_back(individual);
+	}
+}
+
+bool InstanceRetriever::Precompletion::apply(size_t individual, const Concept* pConcept)
+{
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_CONJUNCTION:
+			return add(individual, pConcept->getConcept1()) && add(individual, pConcept->getConcept2());
+
+		case Concept::TYPE_DISJUNCTION:
+		{
+			const Concept* pConsequence;
+			if (!isDecided(individual, pConcept, pConsequence))
+			{
+				mPendingDisjunctions[individual].push_back(pConcept);
+				return true;
+			}
+			return !pConsequence || add(individual, pConsequence);
+		}
+
+		case Concept::TYPE_UNIVERSAL_RESTRICTION:
+		{
+			// Only along the role assertions, existential restrictions are left to the tableau
+			bool transitive = mpReasoner->isTransitive(pConcept->getRole());
+			const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(individual);
+			for (size_t i = 0; i < successors.size(); ++i)
+				if (successors[i].first == pConcept->getRole())
+				{
+					if (!add(successors[i].second, pConcept->getQualificationConcept()))
+						return false;
+					if (transitive && !add(successors[i].second, pConcept))
+						return false;
+				}
+			return true;
+		}
+
+		default:
+			return true;
+	}
+}
+
+// A disjunction is decided when a disjunct holds already or the other clashes
+bool InstanceRetriever::Precompletion::isDecided(size_t individual, const Concept* pDisjunction, const Concept*& pConsequence) const
+{
+	const Concept* pConcept1 = pDisjunction->getConcept1();
+	const Concept* pConcept2 = pDisjunction->getConcept2();
+	if (holds(individual, pConcept1) || clashesWith(individual, pConcept2))
+		pConsequence = pConcept1;
+	else if (holds(individual, pConcept2) || clashesWith(individual, pConcept1))
+		pConsequence = pConcept2;
+	else
+		pConsequence = 0;
+	return pConsequence;
+}
+
+// Whether the label and the role assertions entail the concept
+bool InstanceRetriever::Precompletion::holds(size_t individual, const Concept* pConcept) const
+{
+	if (pConcept->isTop() || mLabels[individual].find(pConcept) != mLabels[individual].end())
+		return true;
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_CONJUNCTION:
+			return holds(individual, pConcept->getConcept1()) && holds(individual, pConcept->getConcept2());
+		case Concept::TYPE_DISJUNCTION:
+			return holds(individual, pConcept->getConcept1()) || holds(individual, pConcept->getConcept2());
+		case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+		{
+			const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(individual);
+			for (size_t i = 0; i < successors.size(); ++i)
+				if (successors[i].first == pConcept->getRole() && holds(successors[i].second, pConcept->getQualificationConcept()))
+					return true;
+			return false;
+		}
+		default:
+			return false;
+	}
+}
+
+// Whether the label and the role assertions contradict the concept
+bool InstanceRetriever::Precompletion::clashesWith(size_t individual, const Concept* pConcept) const
+{
+	if (pConcept->isBottom())
+		return true;
+	if (pConcept->isTop())
+		return false;
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_POSITIVE_ATOMIC:
+		case Concept::TYPE_NEGATIVE_ATOMIC:
+		{
+			const Concept* pComplement = mpConceptManager->getAtomicConcept(pConcept->getType() == Concept::TYPE_NEGATIVE_ATOMIC, pConcept->getSymbol());
+			return mLabels[individual].find(pComplement) != mLabels[individual].end();
+		}
+		case Concept::TYPE_CONJUNCTION:
+			return clashesWith(individual, pConcept->getConcept1()) || clashesWith(individual, pConcept->getConcept2());
+		case Concept::TYPE_DISJUNCTION:
+			return clashesWith(individual, pConcept->getConcept1()) && clashesWith(individual, pConcept->getConcept2());
+		case Concept::TYPE_UNIVERSAL_RESTRICTION:
+		{
+			const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(individual);
+			for (size_t i = 0; i < successors.size(); ++i)
+				if (successors[i].first == pConcept->getRole() && clashesWith(successors[i].second, pConcept->getQualificationConcept()))
+					return true;
+			return false;
+		}
+		default:
+			return false;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+InstanceRetriever::InstanceRetriever(const Reasoner* pReasoner, const ConceptManager* pConceptManager, const Abox* pAbox) :
+mpReasoner(pReasoner), mpConceptManager(pConceptManager), mpAbox(pAbox), mConsistency(Reasoner::RESULT_UNKNOWN)
+{
+	mStatistics.individualCount = pAbox->getIndividualCount();
+}
+
+InstanceRetriever::~InstanceRetriever() { }
+
+Reasoner::Result InstanceRetriever::precomplete(ThreadPool& threadPool, const Reasoner::Limits& limits)
+{
+	unsigned long long startTime = getMicroseconds();
+	size_t individualCount = mpAbox->getIndividualCount();
+	findParts();
+	Precompletion precompletion(mpReasoner, mpConceptManager, mpAbox);
+	if (!precompletion.run())
+	{
+		mConsistency = Reasoner::RESULT_UNSATISFIABLE;
+		mStatistics.precompletionTime = getMicroseconds() - startTime;
+		return mConsistency;
+	}
+	precompletion.getLabels(mLabels);
+
+	// Check every individual alone, then again those that got new concepts
+	// from the models of their predecessors. Each round runs in parallel.
+	mPassedConcepts.assign(individualCount, Label());
+	mModelLabels.assign(individualCount, Label());
+	mLocalResults.assign(individualCount, Reasoner::RESULT_UNKNOWN);
+	vector<size_t> individuals(individualCount);
+	for (size_t i = 0; i < individualCount; ++i)
+		individuals[i] = i;
+	vector<bool> queued(individualCount, false);
+	while (!individuals.empty())
+	{
+		// Individuals with the same concepts share the model found for the first
+		map<Label, size_t> checkedConcepts;
+		vector<size_t> checkedIndividuals, sharedModels(individuals.size());
+		for (size_t i = 0; i < individuals.size(); ++i)
+		{
+			pair<map<Label, size_t>::iterator, bool> entry = checkedConcepts.insert(
+				make_pair(merge(mLabels[individuals[i]], mPassedConcepts[individuals[i]]), individuals[i]));
+			if (entry.second)
+				checkedIndividuals.push_back(individuals[i]);
+			sharedModels[i] = entry.first->second;
+		}
+		LocalModelJob job(this, checkedIndividuals, limits);
+		threadPool.run(job, checkedIndividuals.size());
+		for (size_t i = 0; i < individuals.size(); ++i)
+			if (sharedModels[i] != individuals[i])
+			{
+				mLocalResults[individuals[i]] = mLocalResults[sharedModels[i]];
+				mModelLabels[individuals[i]] = mModelLabels[sharedModels[i]];
+			}
+		vector<size_t> nextIndividuals;
+		for (size_t i = 0; i < individuals.size(); ++i)
+		{
+			if (mLocalResults[individuals[i]] != Reasoner::RESULT_SATISFIABLE)
+				continue;
+			const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(individuals[i]);
+			for (size_t j = 0; j < successors.size(); ++j)
+				if (passOn(mModelLabels[individuals[i]], successors[j], mPassedConcepts[successors[j].second]) && !queued[successors[j].second])
+				{
+					queued[successors[j].second] = true;
+					nextIndividuals.push_back(successors[j].second);
+				}
+		}
+		for (size_t i = 0; i < nextIndividuals.size(); ++i)
+			queued[nextIndividuals[i]] = false;
+		individuals.swap(nextIndividuals);
+	}
+
+	// An individual whose own label is unsatisfiable makes the Abox
+	// inconsistent, the other failures leave it to a check of the whole part
+	mPartResults.assign(mParts.size(), Reasoner::RESULT_SATISFIABLE);
+	mWholePartModels.assign(mParts.size(), false);
+	vector<size_t> failedParts;
+	for (size_t i = 0; i < individualCount; ++i)
+	{
+		size_t part = mPartOfIndividual[i];
+		if (mLocalResults[i] == Reasoner::RESULT_UNSATISFIABLE && mPassedConcepts[i].empty())
+			mPartResults[part] = Reasoner::RESULT_UNSATISFIABLE;
+		else if (mLocalResults[i] != Reasoner::RESULT_SATISFIABLE && !mWholePartModels[part])
+		{
+			mWholePartModels[part] = true;
+			failedParts.push_back(part);
+		}
+	}
+	mStatistics.wholePartCheckCount = failedParts.size();
+	PartJob job(this, failedParts, limits);
+	threadPool.run(job, failedParts.size());
+
+	mConsistency = Reasoner::RESULT_SATISFIABLE;
+	for (size_t i = 0; i < mPartResults.size() && mConsistency != Reasoner::RESULT_UNSATISFIABLE; ++i)
+		if (mPartResults[i] != Reasoner::RESULT_SATISFIABLE)
+			mConsistency = mPartResults[i];
+	mStatistics.precompletionTime = getMicroseconds() - startTime;
+	return mConsistency;
+}
+
+void InstanceRetriever::retrieve(ThreadPool& threadPool, const Concept* pConcept, const Reasoner::Limits& limits, std::vector<size_t>& instances,
+	std::vector<size_t>* pUnknownIndividuals)
+{
+	unsigned long long startTime = getMicroseconds();
+	mStatistics.obviousInstanceCount = mStatistics.obviousNonInstanceCount = 0;
+	mStatistics.testCount = mStatistics.prunedTestCount = mStatistics.unknownTestCount = 0;
+	instances.clear();
+	if (pUnknownIndividuals)
+		pUnknownIndividuals->clear();
+
+	size_t individualCount = mpAbox->getIndividualCount();
+	vector<char> answers(individualCount, ANSWER_CANDIDATE);
+	if (mConsistency == Reasoner::RESULT_UNSATISFIABLE)
+		answers.assign(individualCount, ANSWER_INSTANCE);
+	else
+	{
+		// Interning the negation interns the negations of the parts of the
+		// concept too, the jobs only look them up
+		const Concept* pNegation = mpConceptManager->makeNegation(pConcept);
+		vector<size_t> candidateParts;
+		vector<bool> hasCandidates(mParts.size(), false);
+		for (size_t i = 0; i < individualCount; ++i)
+		{
+			size_t part = mPartOfIndividual[i];
+			if (isTrueIn(i, pConcept))
+				answers[i] = ANSWER_INSTANCE;
+			else if (mPartResults[part] == Reasoner::RESULT_SATISFIABLE && isFalseIn(mModelLabels[i], pConcept))
+				answers[i] = ANSWER_NON_INSTANCE;
+			else if (!hasCandidates[part])
+			{
+				hasCandidates[part] = true;
+				candidateParts.push_back(part);
+			}
+		}
+		for (size_t i = 0; i < individualCount; ++i)
+			if (answers[i] == ANSWER_INSTANCE)
+				++mStatistics.obviousInstanceCount;
+			else if (answers[i] == ANSWER_NON_INSTANCE)
+				++mStatistics.obviousNonInstanceCount;
+
+		RetrievalJob job(this, candidateParts, pConcept, pNegation, limits, answers);
+		threadPool.run(job, candidateParts.size());
+	}
+
+	for (size_t i = 0; i < individualCount; ++i)
+		if (answers[i] == ANSWER_INSTANCE)
+			instances.push_back(i);
+		else if (answers[i] == ANSWER_UNKNOWN && pUnknownIndividuals)
+			pUnknownIndividuals->push_back(i);
+	mStatistics.retrievalTime = getMicroseconds() - startTime;
+}
+
+// Individuals linked by role assertions, either way, end up in the same part
+void InstanceRetriever::findParts()
+{
+	size_t individualCount = mpAbox->getIndividualCount();
+	vector<size_t> roots(individualCount);
+	for (size_t i = 0; i < individualCount; ++i)
+		roots[i] = i;
+	mPredecessors.assign(individualCount, vector<Abox::RoleEdge>());
+	for (size_t i = 0; i < individualCount; ++i)
+	{
+		const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(i);
+		for (size_t j = 0; j < successors.size(); ++j)
+		{
+			mPredecessors[successors[j].second].push_back(Abox::RoleEdge(successors[j].first, i));
+			size_t root1 = i, root2 = successors[j].second;
+			while (roots[root1] != root1)
+				root1 = roots[root1] = roots[roots[root1]];
+			while (roots[root2] != root2)
+				root2 = roots[root2] = roots[roots[root2]];
+			roots[max(root1, root2)] = min(root1, root2);
+		}
+	}
+
+	// Roots are the smallest index of their part, so they come first
+	mPartOfIndividual.assign(individualCount, 0);
+	mParts.clear();
+	for (size_t i = 0; i < individualCount; ++i)
+	{
+		size_t root = i;
+		while (roots[root] != root)
+			root = roots[root];
+		if (root == i)
+		{
+			mPartOfIndividual[i] = mParts.size();
+			mParts.push_back(vector<size_t>());
+		} else
+			mPartOfIndividual[i] = mPartOfIndividual[root];
+		mParts[mPartOfIndividual[i]].push_back(i);
+	}
+	mStatistics.partCount = mParts.size();
+}
+
+// Each item is a different individual, nothing else is written
+void InstanceRetriever::checkLocalModel(size_t individual, const Reasoner::Limits& limits)
+{
+	mLocalResults[individual] = checkIndividual(merge(mLabels[individual], mPassedConcepts[individual]), limits, mModelLabels[individual]);
+}
+
+// Each part is checked by a single thread
+void InstanceRetriever::checkPart(size_t part, const Reasoner::Limits& limits)
+{
+	const vector<size_t>& individuals = mParts[part];
+	vector<Label> concepts;
+	for (size_t i = 0; i < individuals.size(); ++i)
+		concepts.push_back(mLabels[individuals[i]]);
+	vector<Label> labels;
+	mPartResults[part] = mpReasoner->checkConsistency(*mpAbox, individuals, concepts, limits, &labels);
+	if (mPartResults[part] == Reasoner::RESULT_SATISFIABLE)
+		for (size_t i = 0; i < individuals.size(); ++i)
+		{
+			sort(labels[i].begin(), labels[i].end());
+			mModelLabels[individuals[i]].swap(labels[i]);
+		}
+}
+
+// Each part is tested by a single thread, with the local models of its own
+void InstanceRetriever::testCandidates(size_t part, const Concept* pConcept, const Concept* pNegation, const Reasoner::Limits& limits, std::vector<char>& answers)
+{
+	const vector<size_t>& individuals = mParts[part];
+	LocalModels localModels;
+	AboxResults aboxResults;
+	for (size_t i = 0; i < individuals.size(); ++i)
+	{
+		size_t individual = individuals[i];
+		if (answers[individual] != ANSWER_CANDIDATE)
+			continue;
+		__sync_fetch_and_add(&mStatistics.testCount, 1);
+
+		// The label of the individual alone holds in every model, a clash
+		// with it is a clash with the whole Abox
+		Label modelLabel;
+		if (checkIndividual(merge(mLabels[individual], Label(1, pNegation)), limits, localModels, modelLabel) == Reasoner::RESULT_UNSATISFIABLE)
+		{
+			answers[individual] = ANSWER_INSTANCE;
+			continue;
+		}
+
+		// Then a model changing the local models downstream only, if they make
+		// up the model of the part
+		map<size_t, Label> modelLabels;
+		Reasoner::Result result = Reasoner::RESULT_UNKNOWN;
+		if (mPartResults[part] == Reasoner::RESULT_SATISFIABLE && !mWholePartModels[part])
+			result = findLocalModel(individual, pNegation, limits, localModels, modelLabels);
+		if (result != Reasoner::RESULT_SATISFIABLE)
+		{
+			modelLabels.clear();
+			result = checkDownstream(part, individual, pNegation, limits, aboxResults, modelLabels);
+		}
+
+		if (result == Reasoner::RESULT_UNSATISFIABLE)
+			answers[individual] = ANSWER_INSTANCE;
+		else if (result == Reasoner::RESULT_UNKNOWN)
+		{
+			answers[individual] = ANSWER_UNKNOWN;
+			__sync_fetch_and_add(&mStatistics.unknownTestCount, 1);
+		} else
+		{
+			answers[individual] = ANSWER_NON_INSTANCE;
+			// The model found may make the concept false on the candidates
+			// left. The others keep the models they were tried with already.
+			for (map<size_t, Label>::const_iterator it = modelLabels.begin(); it != modelLabels.end(); ++it)
+				if (answers[it->first] == ANSWER_CANDIDATE && isFalseIn(it->second, pConcept))
+				{
+					answers[it->first] = ANSWER_NON_INSTANCE;
+					__sync_fetch_and_add(&mStatistics.prunedTestCount, 1);
+				}
+		}
+	}
+}
+
+// Like precomplete() on the individuals downstream of the one given, with the
+// negation on it and the models of the others left as they are. Unknown means
+// that a local model could not be found, not that there is none.
+Reasoner::Result InstanceRetriever::findLocalModel(size_t individual, const Concept* pNegation, const Reasoner::Limits& limits, LocalModels& localModels,
+	std::map<size_t, Label>& modelLabels) const
+{
+	map<size_t, Label> passedConcepts;
+	vector<size_t> individuals(1, individual);
+	set<size_t> queued;
+	while (!individuals.empty())
+	{
+		size_t current = individuals.back();
+		individuals.pop_back();
+		queued.erase(current);
+		map<size_t, Label>::const_iterator it = passedConcepts.find(current);
+		Label concepts = merge(mLabels[current], it == passedConcepts.end() ? mPassedConcepts[current] : it->second);
+		if (current == individual)
+			concepts = merge(concepts, Label(1, pNegation));
+		if (checkIndividual(concepts, limits, localModels, modelLabels[current]) != Reasoner::RESULT_SATISFIABLE)
+			return Reasoner::RESULT_UNKNOWN;
+
+		const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(current);
+		for (size_t i = 0; i < successors.size(); ++i)
+		{
+			size_t successor = successors[i].second;
+			if (passedConcepts.find(successor) == passedConcepts.end())
+				passedConcepts[successor] = mPassedConcepts[successor];
+			if (passOn(modelLabels[current], successors[i], passedConcepts[successor]) && queued.insert(successor).second)
+				individuals.push_back(successor);
+		}
+	}
+	return Reasoner::RESULT_SATISFIABLE;
+}
+
+// Without inverse roles the negation only reaches the individuals downstream
+// of the one given. A clash with some of them, each successor alone and then
+// those up to depth 1, 2, 4..., is a clash with the whole Abox, and the fewer
+// they are the faster it is found. For a model, the others keep theirs, which
+// holds when the part has one, and what these require from the individuals
+// reached is checked with them. A clash is then certain only if it stays
+// without these, and when it does not the part is checked as a whole.
+Reasoner::Result InstanceRetriever::checkDownstream(size_t part, size_t individual, const Concept* pNegation, const Reasoner::Limits& limits,
+	AboxResults& aboxResults, std::map<size_t, Label>& modelLabels) const
+{
+	// By increasing depth, with the number of individuals up to each one
+	vector<size_t> byDepth(1, individual), depthEnds;
+	set<size_t> reached;
+	reached.insert(individual);
+	for (size_t begin = 0; begin < byDepth.size(); )
+	{
+		size_t end = byDepth.size();
+		depthEnds.push_back(end);
+		for (size_t i = begin; i < end; ++i)
+		{
+			const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(byDepth[i]);
+			for (size_t j = 0; j < successors.size(); ++j)
+				if (reached.insert(successors[j].second).second)
+					byDepth.push_back(successors[j].second);
+		}
+		begin = end;
+	}
+	for (size_t i = 1; depthEnds.size() > 1 && i < depthEnds[1]; ++i)
+	{
+		vector<size_t> individuals;
+		individuals.push_back(individual);
+		individuals.push_back(byDepth[i]);
+		vector<Label> concepts;
+		concepts.push_back(merge(mLabels[individual], Label(1, pNegation)));
+		concepts.push_back(mLabels[byDepth[i]]);
+		if (checkIndividuals(individuals, concepts, limits, aboxResults) == Reasoner::RESULT_UNSATISFIABLE)
+			return Reasoner::RESULT_UNSATISFIABLE;
+	}
+	for (size_t depth = 1; depth + 1 < depthEnds.size(); depth *= 2)
+	{
+		vector<size_t> individuals(byDepth.begin(), byDepth.begin() + depthEnds[depth]);
+		vector<Label> concepts;
+		for (size_t i = 0; i < individuals.size(); ++i)
+			concepts.push_back(mLabels[individuals[i]]);
+		concepts.front() = merge(concepts.front(), Label(1, pNegation));
+		if (checkIndividuals(individuals, concepts, limits, aboxResults) == Reasoner::RESULT_UNSATISFIABLE)
+			return Reasoner::RESULT_UNSATISFIABLE;
+	}
+
+	if (mPartResults[part] == Reasoner::RESULT_SATISFIABLE)
+	{
+		vector<size_t> individuals(reached.begin(), reached.end());
+		vector<Label> concepts, constrainedConcepts;
+		bool isConstrained = false;
+		for (size_t i = 0; i < individuals.size(); ++i)
+		{
+			concepts.push_back(mLabels[individuals[i]]);
+			if (individuals[i] == individual)
+				concepts.back().push_back(pNegation);
+			Label required;
+			const vector<Abox::RoleEdge>& predecessors = mPredecessors[individuals[i]];
+			for (size_t j = 0; j < predecessors.size(); ++j)
+				if (!reached.count(predecessors[j].second))
+					passOn(mModelLabels[predecessors[j].second], Abox::RoleEdge(predecessors[j].first, individuals[i]), required);
+			isConstrained = isConstrained || !required.empty();
+			constrainedConcepts.push_back(merge(mLabels[individuals[i]], required));
+			if (individuals[i] == individual)
+				constrainedConcepts.back().push_back(pNegation);
+		}
+
+		vector<Label> labels;
+		Reasoner::Result result = mpReasoner->checkConsistency(*mpAbox, individuals, constrainedConcepts, limits, &labels);
+		if (result == Reasoner::RESULT_SATISFIABLE)
+		{
+			for (size_t i = 0; i < individuals.size(); ++i)
+			{
+				sort(labels[i].begin(), labels[i].end());
+				modelLabels[individuals[i]].swap(labels[i]);
+			}
+			return result;
+		}
+		if (result == Reasoner::RESULT_UNKNOWN || !isConstrained)
+			return result;
+		result = mpReasoner->checkConsistency(*mpAbox, individuals, concepts, limits);
+		if (result != Reasoner::RESULT_SATISFIABLE)
+			return result;
+	}
+
+	const vector<size_t>& individuals = mParts[part];
+	vector<Label> concepts;
+	for (size_t i = 0; i < individuals.size(); ++i)
+	{
+		concepts.push_back(mLabels[individuals[i]]);
+		if (individuals[i] == individual)
+			concepts.back().push_back(pNegation);
+	}
+	vector<Label> labels;
+	Reasoner::Result result = mpReasoner->checkConsistency(*mpAbox, individuals, concepts, limits, &labels);
+	for (size_t i = 0; i < labels.size(); ++i)
+	{
+		sort(labels[i].begin(), labels[i].end());
+		modelLabels[individuals[i]].swap(labels[i]);
+	}
+	return result;
+}
+
+Reasoner::Result InstanceRetriever::checkIndividual(const Label& concepts, const Reasoner::Limits& limits, Label& modelLabel) const
+{
+	Model model;
+	Reasoner::Result result = mpReasoner->checkSatisfiability(concepts, limits, &model);
+	modelLabel.clear();
+	for (size_t i = 0; i < model.getIndividualCount(); ++i)
+		if (model.getIndividual(i)->getNodeID() == 1)
+			modelLabel.assign(model.getIndividual(i)->getConcepts().begin(), model.getIndividual(i)->getConcepts().end());
+	sort(modelLabel.begin(), modelLabel.end());
+	return result;
+}
+
+// A part of the Abox checked without the others, the same shapes come back
+// for many candidates and their definitive results are kept
+Reasoner::Result InstanceRetriever::checkIndividuals(const std::vector<size_t>& individuals, const std::vector<Label>& concepts, const Reasoner::Limits& limits,
+	AboxResults& aboxResults) const
+{
+	map<size_t, size_t> positions;
+	for (size_t i = 0; i < individuals.size(); ++i)
+		positions[individuals[i]] = i;
+	AboxShape shape;
+	shape.first = concepts;
+	for (size_t i = 0; i < individuals.size(); ++i)
+	{
+		const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(individuals[i]);
+		for (size_t j = 0; j < successors.size(); ++j)
+		{
+			map<size_t, size_t>::const_iterator it = positions.find(successors[j].second);
+			if (it != positions.end())
+				shape.second.push_back(make_pair(i, Abox::RoleEdge(successors[j].first, it->second)));
+		}
+	}
+	AboxResults::const_iterator it = aboxResults.find(shape);
+	if (it != aboxResults.end())
+		return it->second;
+	Reasoner::Result result = mpReasoner->checkConsistency(*mpAbox, individuals, concepts, limits);
+	if (result != Reasoner::RESULT_UNKNOWN)
+		aboxResults[shape] = result;
+	return result;
+}
+
+// The same concepts come back for many candidates, the definitive results
+// are kept
+Reasoner::Result InstanceRetriever::checkIndividual(const Label& concepts, const Reasoner::Limits& limits, LocalModels& localModels, Label& modelLabel) const
+{
+	LocalModels::const_iterator it = localModels.find(concepts);
+	if (it != localModels.end())
+	{
+		modelLabel = it->second.second;
+		return it->second.first;
+	}
+	Reasoner::Result result = checkIndividual(concepts, limits, modelLabel);
+	if (result != Reasoner::RESULT_UNKNOWN)
+		localModels[concepts] = make_pair(result, modelLabel);
+	return result;
+}
+
+// Adds to passed what the universal restrictions of a model label require
+// from a successor, true if something was new
+bool InstanceRetriever::passOn(const Label& modelLabel, const Abox::RoleEdge& edge, Label& passed) const
+{
+	Label required;
+	bool transitive = mpReasoner->isTransitive(edge.first);
+	for (size_t i = 0; i < modelLabel.size(); ++i)
+		if (modelLabel[i]->getType() == Concept::TYPE_UNIVERSAL_RESTRICTION && modelLabel[i]->getRole() == edge.first)
+		{
+			if (!contains(mLabels[edge.second], modelLabel[i]->getQualificationConcept()))
+				required.push_back(modelLabel[i]->getQualificationConcept());
+			if (transitive && !contains(mLabels[edge.second], modelLabel[i]))
+				required.push_back(modelLabel[i]);
+		}
+	sort(required.begin(), required.end());
+	Label merged = merge(passed, required);
+	if (merged.size() == passed.size())
+		return false;
+	passed.swap(merged);
+	return true;
+}
+
+InstanceRetriever::Label InstanceRetriever::merge(const Label& label1, const Label& label2)
+{
+	Label result;
+	result.reserve(label1.size() + label2.size());
+	set_union(label1.begin(), label1.end(), label2.begin(), label2.end(), back_inserter(result));
+	return result;
+}
+
+// What the deterministic rules derived holds in every model, and so do the
+// role assertions
+bool InstanceRetriever::isTrueIn(size_t individual, const Concept* pConcept) const
+{
+	if (pConcept->isTop() || contains(mLabels[individual], pConcept))
+		return true;
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_CONJUNCTION:
+			return isTrueIn(individual, pConcept->getConcept1()) && isTrueIn(individual, pConcept->getConcept2());
+		case Concept::TYPE_DISJUNCTION:
+			return isTrueIn(individual, pConcept->getConcept1()) || isTrueIn(individual, pConcept->getConcept2());
+		case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+		{
+			const vector<Abox::RoleEdge>& successors = mpAbox->getSuccessors(individual);
+			for (size_t i = 0; i < successors.size(); ++i)
+				if (successors[i].first == pConcept->getRole() && isTrueIn(successors[i].second, pConcept->getQualificationConcept()))
+					return true;
+			return false;
+		}
+		default:
+			return false;
+	}
+}
+
+// The label of a model tells what is false too: a name missing from it
+bool InstanceRetriever::isFalseIn(const Label& label, const Concept* pConcept) const
+{
+	if (pConcept->isTop())
+		return false;
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_POSITIVE_ATOMIC:
+			return !contains(label, pConcept);
+		case Concept::TYPE_CONJUNCTION:
+			return isFalseIn(label, pConcept->getConcept1()) || isFalseIn(label, pConcept->getConcept2());
+		case Concept::TYPE_DISJUNCTION:
+			return isFalseIn(label, pConcept->getConcept1()) && isFalseIn(label, pConcept->getConcept2());
+		default:
+			return contains(label, mpConceptManager->makeNegation(pConcept));
+	}
+}
+
+}
@@ -0,0 +1,159 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include "Reasoner.h"
+
+namespace tinyreason
+{
+
+class ThreadPool;
+
+/**
+ * Finds the individuals of an Abox that are instances of a concept.
+ *
+ * precomplete() runs once. It applies the deterministic rules to the asserted
+ * individuals alone: the Tbox, conjunctions, disjunctions with a clashing
+ * disjunct and universal restrictions along the role assertions. What it
+ * derives holds in every model, so an individual whose label makes a concept
+ * true is an obvious instance of it. Then each individual is checked alone,
+ * in parallel, and the universal restrictions in the root of its model are
+ * passed on to its successors, which are checked again until nothing new is
+ * passed on. Without inverse roles, the models found then make up a model of
+ * the whole Abox, and an individual whose model label makes a concept false
+ * is an obvious non-instance. The connected parts of the Abox where this
+ * fails are checked with the tableau as a whole.
+ *
+ * retrieve() runs the tableau only for the individuals left, with the
+ * negation of the concept: a clash with the label of the individual alone
+ * means an instance, a new model for it and for the successors it changes
+ * means a non-instance. Otherwise the individuals it reaches are checked
+ * with it, the closest first, then with what the models of the others
+ * require from them, and its part is checked as a whole only when that is
+ * not enough to answer. The checks that come back for many candidates are
+ * made once per part.
+ * Tests that reach the limits leave their individual unknown, and the answers
+ * assume that the parts whose check stopped early are consistent.
+ */
+class InstanceRetriever {
+public:
+
+	struct Statistics {
+		size_t individualCount;
+		size_t partCount; // connected parts of the Abox
+		size_t wholePartCheckCount; // parts checked as a whole while precompleting
+		// These are about the last retrieval
+		size_t obviousInstanceCount;
+		size_t obviousNonInstanceCount;
+		size_t testCount; // candidates tested with the tableau
+		size_t prunedTestCount; // candidates ruled out by the model of another test
+		size_t unknownTestCount; // tests stopped by a limit
+		unsigned long long precompletionTime; // microseconds
+		unsigned long long retrievalTime;
+
+		Statistics() :
+		individualCount(0), partCount(0), wholePartCheckCount(0), obviousInstanceCount(0), obviousNonInstanceCount(0), testCount(0), prunedTestCount(0),
+		unknownTestCount(0), precompletionTime(0), retrievalTime(0) { }
+	};
+
+	InstanceRetriever(const Reasoner* pReasoner, const ConceptManager* pConceptManager, const Abox* pAbox);
+	~InstanceRetriever();
+	// Unsatisfiable means that the Abox is inconsistent: every individual is
+	// then an instance of every concept
+	Reasoner::Result precomplete(ThreadPool& threadPool, const Reasoner::Limits& limits);
+	Reasoner::Result getConsistency() const {
+		return mConsistency;
+	}
+	// Indexes of the instances, ascending
+	void retrieve(ThreadPool& threadPool, const Concept* pConcept, const Reasoner::Limits& limits, std::vector<size_t>& instances,
+		std::vector<size_t>* pUnknownIndividuals = 0);
+	const Statistics& getStatistics() const {
+		return mStatistics;
+	}
+private:
+	class Precompletion;
+	class LocalModelJob;
+	class PartJob;
+	class RetrievalJob;
+
+	enum Answer {
+		ANSWER_CANDIDATE,
+		ANSWER_INSTANCE,
+		ANSWER_NON_INSTANCE,
+		ANSWER_UNKNOWN
+	};
+
+	typedef std::vector<const Concept*> Label; // sorted
+	// The definitive results of checkIndividual() and the model labels found, by concepts checked
+	typedef std::map< Label, std::pair<Reasoner::Result, Label> > LocalModels;
+	// The concepts of some individuals and the role assertions between them, by position
+	typedef std::pair< std::vector<Label>, std::vector< std::pair<size_t, Abox::RoleEdge> > > AboxShape;
+	// The definitive results of checkIndividuals()
+	typedef std::map<AboxShape, Reasoner::Result> AboxResults;
+
+	void findParts();
+	void checkLocalModel(size_t individual, const Reasoner::Limits& limits);
+	void checkPart(size_t part, const Reasoner::Limits& limits);
+	void testCandidates(size_t part, const Concept* pConcept, const Concept* pNegation, const Reasoner::Limits& limits, std::vector<char>& answers);
+	Reasoner::Result findLocalModel(size_t individual, const Concept* pNegation, const Reasoner::Limits& limits, LocalModels& localModels,
+		std::map<size_t, Label>& modelLabels) const;
+	Reasoner::Result checkDownstream(size_t part, size_t individual, const Concept* pNegation, const Reasoner::Limits& limits,
+		AboxResults& aboxResults, std::map<size_t, Label>& modelLabels) const;
+	Reasoner::Result checkIndividuals(const std::vector<size_t>& individuals, const std::vector<Label>& concepts, const Reasoner::Limits& limits,
+		AboxResults& aboxResults) const;
+	Reasoner::Result checkIndividual(const Label& concepts, const Reasoner::Limits& limits, Label& modelLabel) const;
+	Reasoner::Result checkIndividual(const Label& concepts, const Reasoner::Limits& limits, LocalModels& localModels, Label& modelLabel) const;
+	bool passOn(const Label& modelLabel, const Abox::RoleEdge& edge, Label& passed) const;
+	bool isTrueIn(size_t individual, const Concept* pConcept) const;
+	bool isFalseIn(const Label& label, const Concept* pConcept) const;
+	static bool contains(const Label& label, const Concept* pConcept) {
+		return std::binary_search(label.begin(), label.end(), pConcept);
+	}
+	static Label merge(const Label& label1, const Label& label2);
+
+	const Reasoner* mpReasoner;
+	const ConceptManager* mpConceptManager;
+	const Abox* mpAbox;
+	Reasoner::Result mConsistency;
+	// By individual
+	std::vector<Label> mLabels; // what the deterministic rules derive
+	std::vector<Label> mPassedConcepts; // passed on by the models of the predecessors
+	std::vector<Label> mModelLabels; // the root of the model of the individual
+	std::vector<Reasoner::Result> mLocalResults;
+	std::vector<size_t> mPartOfIndividual;
+	std::vector< std::vector<Abox::RoleEdge> > mPredecessors; // role and predecessor individual
+	// By part
+	std::vector< std::vector<size_t> > mParts; // individuals, ascending
+	std::vector<Reasoner::Result> mPartResults;
+	std::vector<bool> mWholePartModels; // the model labels come from a check of the whole part
+	Statistics mStatistics;
+};
+
+}
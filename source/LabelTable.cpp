@@ -0,0 +1,197 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "LabelTable.h"
+
+using namespace std;
+
+namespace tinyreason
+{
+
+LabelTable::LabelTable() :
+mNextSerial(0)
+{
+	mpEmpty = internLabel(create());
+	mpEmpty->mUseCount = 1;
+}
+
+LabelTable::~LabelTable()
+{
+	for (map<size_t, Label*>::iterator it = mSerials.begin(); it != mSerials.end(); ++it)
+		delete it->second;
+}
+
+const LabelTable::Label* LabelTable::getEmpty()
+{
+	++mpEmpty->mUseCount;
+	return mpEmpty;
+}
+
+const LabelTable::Label* LabelTable::intern(const std::vector<Key>& keys)
+{
+	Label* pLabel = create();
+	pLabel->mKeys.insert(keys.begin(), keys.end());
+	for (size_t i = 0; i < keys.size(); ++i)
+		pLabel->mHash += hashKey(keys[i]);
+	pLabel = internLabel(pLabel);
+	++pLabel->mUseCount;
+	return pLabel;
+}
+
+bool LabelTable::add(const Label*& pLabel, const Key& key)
+{
+	if (pLabel->contains(key))
+		return false;
+	Label* pOld = const_cast<Label*> (pLabel);
+	if (pOld->mUseCount == 1)
+	{
+		// Nobody else has it, so it changes in place unless it becomes a
+		// label that exists already
+		unregister(pOld);
+		pOld->mSerial = mNextSerial++;
+		pOld->mKeys.insert(key);
+		pOld->mHash += hashKey(key);
+		Label* pNew = internLabel(pOld);
+		if (pNew != pOld)
+			++pNew->mUseCount;
+		pLabel = pNew;
+		return true;
+	}
+
+	Label* pNew = 0;
+	Addition addition(pOld->mSerial, key);
+	map<Addition, size_t>::const_iterator it = mAdditions.find(addition);
+	if (it != mAdditions.end())
+	{
+		map<size_t, Label*>::const_iterator it2 = mSerials.find(it->second);
+		if (it2 != mSerials.end())
+			pNew = it2->second;
+	}
+	if (!pNew)
+	{
+		pNew = create();
+		pNew->mKeys = pOld->mKeys;
+		pNew->mKeys.insert(key);
+		pNew->mHash = pOld->mHash + hashKey(key);
+		pNew = internLabel(pNew);
+		trimMemos();
+		mAdditions[addition] = pNew->mSerial;
+	}
+	++pNew->mUseCount;
+	release(pOld);
+	pLabel = pNew;
+	return true;
+}
+
+void LabelTable::acquire(const Label* pLabel)
+{
+	++const_cast<Label*> (pLabel)->mUseCount;
+}
+
+void LabelTable::release(const Label* pLabel)
+{
+	Label* pOld = const_cast<Label*> (pLabel);
+	if (--pOld->mUseCount)
+		return;
+	unregister(pOld);
+	delete pOld;
+}
+
+bool LabelTable::isSubset(const Label* pLabel1, const Label* pLabel2)
+{
+	if (pLabel1 == pLabel2 || pLabel1->mKeys.empty())
+		return true;
+	if (pLabel1->mpTable != this || pLabel2->mpTable != this)
+		return pLabel1->mKeys.size() <= pLabel2->mKeys.size() &&
+			includes(pLabel2->mKeys.begin(), pLabel2->mKeys.end(), pLabel1->mKeys.begin(), pLabel1->mKeys.end());
+	// Equal sets would be the same label
+	if (pLabel1->mKeys.size() >= pLabel2->mKeys.size())
+		return false;
+	Inclusion inclusion(pLabel1->mSerial, pLabel2->mSerial);
+	map<Inclusion, bool>::const_iterator it = mInclusions.find(inclusion);
+	if (it != mInclusions.end())
+		return it->second;
+	bool result = includes(pLabel2->mKeys.begin(), pLabel2->mKeys.end(), pLabel1->mKeys.begin(), pLabel1->mKeys.end());
+	trimMemos();
+	mInclusions[inclusion] = result;
+	return result;
+}
+
+LabelTable::Label* LabelTable::create()
+{
+	return new Label(this, mNextSerial++);
+}
+
+LabelTable::Label* LabelTable::internLabel(Label* pLabel)
+{
+	typedef multimap<size_t, Label*>::iterator Iterator;
+	pair<Iterator, Iterator> range = mLabels.equal_range(pLabel->mHash);
+	for (Iterator it = range.first; it != range.second; ++it)
+		if (it->second->mKeys == pLabel->mKeys)
+		{
+			delete pLabel;
+			return it->second;
+		}
+	mLabels.insert(range.second, multimap<size_t, Label*>::value_type(pLabel->mHash, pLabel));
+	mSerials[pLabel->mSerial] = pLabel;
+	return pLabel;
+}
+
+void LabelTable::unregister(Label* pLabel)
+{
+	typedef multimap<size_t, Label*>::iterator Iterator;
+	pair<Iterator, Iterator> range = mLabels.equal_range(pLabel->mHash);
+	for (Iterator it = range.first; it != range.second; ++it)
+		if (it->second == pLabel)
+		{
+			mLabels.erase(it);
+			break;
+		}
+	mSerials.erase(pLabel->mSerial);
+}
+
+// The memos of labels that are gone are never found again, they are dropped
+// all at once when they outnumber the live labels
+void LabelTable::trimMemos()
+{
+	if (mAdditions.size() + mInclusions.size() > 4 * mSerials.size() + 4096)
+	{
+		mAdditions.clear();
+		mInclusions.clear();
+	}
+}
+
+// Summed over the keys of a label, so it is mixed to spread
+size_t LabelTable::hashKey(const Key& key)
+{
+	size_t hash = key.second * 2654435761u + key.first;
+	hash ^= hash >> 15;
+	return hash * 2246822519u;
+}
+
+}
@@ -0,0 +1,111 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+
+namespace tinyreason
+{
+
+/**
+ * Node labels, hash-consed: a label is an immutable set of concept keys
+ * shared by every node that has the same concepts, so that equal labels are
+ * the same object. Adding a concept to a label shared with other nodes gives
+ * another label, and the table remembers both that addition and the subset
+ * tests made between labels; a label used by one node only grows in place, in
+ * logarithmic time. One table serves a single check, so it needs no locking.
+ */
+class LabelTable {
+public:
+	typedef std::pair<int, size_t> Key; // as Reasoner::Node::DependencyKey
+	typedef std::set<Key> Keys;
+
+	class Label {
+	public:
+		const Keys& getKeys() const {
+			return mKeys;
+		}
+		size_t getSize() const {
+			return mKeys.size();
+		}
+		bool contains(const Key& key) const {
+			return mKeys.find(key) != mKeys.end();
+		}
+	private:
+		friend class LabelTable;
+		Label(const LabelTable* pTable, size_t serial) :
+		mpTable(pTable), mHash(0), mSerial(serial), mUseCount(0) { }
+
+		const LabelTable* mpTable;
+		Keys mKeys;
+		size_t mHash; // of the keys, in any order
+		size_t mSerial; // never handed out again by the table
+		size_t mUseCount;
+	};
+
+	LabelTable();
+	~LabelTable();
+	// The labels returned are in use once more, until released
+	const Label* getEmpty();
+	const Label* intern(const std::vector<Key>& keys); // sorted
+	// Replaces pLabel, for its user, with the label that has key too; false
+	// if pLabel had it already
+	bool add(const Label*& pLabel, const Key& key);
+	void acquire(const Label* pLabel);
+	void release(const Label* pLabel);
+	// Remembered for the labels of this table, worked out for the others
+	bool isSubset(const Label* pLabel1, const Label* pLabel2);
+	size_t getSize() const {
+		return mSerials.size();
+	}
+private:
+	LabelTable(const LabelTable&);
+	LabelTable& operator=(const LabelTable&);
+
+	Label* create();
+	// The label with the keys and hash of pLabel if there is one already,
+	// else pLabel which is registered
+	Label* internLabel(Label* pLabel);
+	void unregister(Label* pLabel);
+	void trimMemos();
+	static size_t hashKey(const Key& key);
+
+	typedef std::pair<size_t, Key> Addition;
+	typedef std::pair<size_t, size_t> Inclusion;
+
+	size_t mNextSerial;
+	Label* mpEmpty; // held by the table itself
+	std::multimap<size_t, Label*> mLabels; // by hash
+	std::map<size_t, Label*> mSerials;
+	// Memos by serial, a label that is gone is simply not found
+	std::map<Addition, size_t> mAdditions;
+	std::map<Inclusion, bool> mInclusions;
+};
+
+}
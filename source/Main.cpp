@@ -29,10 +29,29 @@
 #include "Common.h"
 #include "Reasoner.h"
 #include "Model.h"
+#include "Snapshot.h"
+#include "Server.h"
+#include "Trace.h"
+#include "Classifier.h"
+#include "InstanceRetriever.h"
+#include "Portfolio.h"
+#include "ThreadPool.h"
+#include "ResultCache.h"
 
 using namespace std;
 using namespace tinyreason;
 
+namespace
+{
+// Ctrl+C stops the search, which then reports what it found so far
+CancellationToken sInterruptToken;
+
+void onInterrupt(int)
+{
+	sInterruptToken.cancel();
+}
+}
+
 /*
  * 
  */
@@ -42,7 +61,7 @@ int main(int argc, char** argv)
 	{
 		if (argc < 4)
 		{
-			cout << "Usage: saltr <options|-> (<Tbox-file-name|-) <concepts-to-test-satisfiability>\n\noptions:\n\te: prints the structure of the example model (if found) that satisfies the concept;\n\tv: verbose, shows a log of the precedure of decision;\n\tp: shows parsed concepts (both from tbox and user concept);\n\tc: prints complex concepts in the output model too;\n\tD: dumps the example model (if found) into a GraphViz DOT file \'example.dot\';" << endl;
+			cout << "Usage: saltr <options|->[,<limit>=<value>...] (<Tbox-file-name|-) <concepts-to-test-satisfiability>\n\noptions:\n\te: prints the structure of the example model (if found) that satisfies the concept;\n\tv: verbose, shows a log of the precedure of decision;\n\tp: shows parsed concepts (both from tbox and user concept);\n\tc: prints complex concepts in the output model too;\n\tD: dumps the example model (if found) into a GraphViz DOT file \'example.dot\';\n\ti: writes concept IDs in the example model, followed by a legend;\n\tj: prints the example model (if found) as a columnar JSON object;\n\tM: writes the example model (if found) into the binary file \'example.model\';\n\tx: explains an unsatisfiable answer with a minimal set of Tbox axioms and concepts that are unsatisfiable together;\n\ts: prints the statistics of the search as a JSON object;\n\tT: writes the trace of the search into the file \'trace.bin\' (needs a build made with TRACE=1);\n\tX: decodes the trace file given in place of the Tbox file, as text or as Chrome trace JSON when the concepts argument is \'text\' or \'chrome\';\n\tS: compiles the Tbox into the snapshot file \'<Tbox-file-name>.snapshot\', which can be given in place of the Tbox file afterwards;\n\tl: loads the Tbox once then serves queries, one per line, from stdin (concepts argument \'-\') or from the Unix socket whose path is given in place of the concepts;\n\tC: classifies the concept names of the Tbox on every core and prints their hierarchy (concepts argument \'-\');\n\tR: retrieves the individuals of the Abox, asserted in the Tbox file, that are instances of the concepts;\n\tP: runs the check under a different configuration on every core and keeps the first answer;\n\nlimits (the answer is unknown when one is reached):\n\ttime: milliseconds of wall time;\n\texpansions: expansion steps;\n\ttrees: completion trees created;\n\tbytes: estimated size of the open completion trees;\n\toverflow: \'fail\' (default) stops at the bytes limit, \'evict\' drops the least promising trees to stay within it;\n\theuristic: order of the disjunctions, \'types\' (default), \'moms\' (literals occurring in many short disjunctions first) or \'vsids\' (literals taking part in recent clashes first);\n\tactivities: \'keep\' starts \'vsids\' from the activities left by the previous check against the same Tbox, \'reset\' (default) from scratch;\n\tsearch: which open tree is expanded next, \'best\' (default) the one with the fewest concepts to expand or \'depth\' the one with the most choices made;\n\tseed: a number breaking the ties of the heuristics, 0 (default) leaves them as they fall;\n\tnogoods: how many sets of concepts found to clash together are kept to close the trees holding them early, in this check and the next ones against the same Tbox, 0 (default) learns none;\n\tsuccessors: \'tree\' (default) expands the successors of a node in the same completion tree, \'separate\' checks each one on its own, in parallel and once for every distinct label, the example model then holds the first individual only;\n\tcache: a file keeping the answers across runs and processes, looked up before a check and updated after it;" << endl;
 			return -1;
 		}
 
@@ -50,8 +69,25 @@ int main(int argc, char** argv)
 			verbose = false,
 			showParsedResult = false,
 			showComplexConcepts = false,
-			dumpToDOT = false;
+			dumpToDOT = false,
+			useConceptIDs = false,
+			printJSONModel = false,
+			writeBinaryModel = false,
+			explainUnsatisfiability = false,
+			printStatistics = false,
+			writeTrace = false,
+			writeSnapshot = false,
+			serve = false,
+			classify = false,
+			retrieveInstances = false,
+			portfolio = false;
 		string stroptions(argv[1]);
+		Reasoner::Limits limits;
+		if (stroptions.find(',') != string::npos)
+		{
+			limits.parse(stroptions.substr(stroptions.find(',') + 1));
+			stroptions.erase(stroptions.find(','));
+		}
 		for (size_t i = 0; i < stroptions.size(); ++i)
 		{
 			switch (stroptions[i])
@@ -73,29 +109,130 @@ int main(int argc, char** argv)
 				case 'D':
 					dumpToDOT = true;
 					break;
+				case 'i': // Concept IDs and legend in the example model
+					useConceptIDs = true;
+					break;
+				case 'j': // Columnar JSON model
+					printJSONModel = true;
+					break;
+				case 'M': // Binary model
+					writeBinaryModel = true;
+					break;
+				case 'x': // Explains unsatisfiability
+					explainUnsatisfiability = true;
+					break;
+				case 's': // Statistics as JSON
+					printStatistics = true;
+					break;
+				case 'T': // Binary trace
+					writeTrace = true;
+					break;
+				case 'X': // Decodes a trace file
+					Trace::decode(argv[2], cout, string(argv[3]) == "chrome" ? Trace::FORMAT_CHROME : Trace::FORMAT_TEXT);
+					return 0;
+				case 'S': // Compiles the Tbox into a snapshot
+					writeSnapshot = true;
+					break;
+				case 'l': // Serves queries
+					serve = true;
+					break;
+				case 'C': // Classifies the Tbox
+					classify = true;
+					break;
+				case 'R': // Instance retrieval
+					retrieveInstances = true;
+					break;
+				case 'P': // Portfolio of configurations
+					portfolio = true;
+					break;
 			}
 		}
 
-		SymbolDictionary sd;
-		ConceptManager cp(&sd);
+		// A snapshot replaces the Tbox file, it must outlive everything built on it
+		shared_ptr<Snapshot> spSnapshot;
+		if (argv[2][0] != '-' && Snapshot::isSnapshotFile(argv[2]))
+			spSnapshot = shared_ptr<Snapshot>(new Snapshot(argv[2]));
+
+		SymbolDictionary sd(spSnapshot.get());
+		ConceptManager cp(&sd, spSnapshot.get());
 		Reasoner r(&sd, &cp);
+		ConceptWriter parsedWriter(sd);
 
 		vector<Symbol> transitiveRoles;
+		Abox abox;
 
-		if (argv[2][0] != '-')
+		if (spSnapshot)
+		{
+			r.loadSnapshot(*spSnapshot);
+			if (showParsedResult)
+			{
+				cout << "Tbox concepts (from snapshot):" << endl;
+				for (size_t i = 0; i < r.getTboxConcepts().size(); ++i)
+				{
+					cout << "\t* ";
+					parsedWriter.write(cout, r.getTboxConcepts()[i]);
+					cout << endl;
+				}
+			}
+		} else if (argv[2][0] != '-')
 		{
 			vector<const Concept*> tboxConcepts;
 			ifstream f(argv[2]);
-			cp.parseAssertions(f, tboxConcepts, transitiveRoles);
+			cp.parseAssertions(f, tboxConcepts, transitiveRoles, &abox);
 			r.setTboxConcepts(tboxConcepts);
 			if (showParsedResult)
 			{
 				cout << "Tbox concepts (optimized and normalized):" << endl;
 				for (size_t i = 0; i < tboxConcepts.size(); ++i)
-					cout << "\t* " << tboxConcepts[i]->toString(sd) << endl;
+				{
+					cout << "\t* ";
+					parsedWriter.write(cout, tboxConcepts[i]);
+					cout << endl;
+				}
+			}
+			if (writeSnapshot)
+			{
+				string snapshotFileName = string(argv[2]) + ".snapshot";
+				Snapshot::write(snapshotFileName, sd, cp, tboxConcepts, transitiveRoles);
+				cout << "Tbox compiled into snapshot file " << snapshotFileName << "." << endl;
 			}
 		}
 
+		// Answers are only looked up and stored by the satisfiability checks
+		ScopedPointer<ResultCache> apResultCache;
+		if (!limits.cacheFileName.empty())
+			apResultCache.reset(new ResultCache(limits.cacheFileName));
+
+		if (serve)
+		{
+			r.setTransitiveRoles(transitiveRoles);
+			Server server(&sd, &cp, &r);
+			server.setDefaultLimits(limits);
+			server.setResultCache(apResultCache.get());
+			if (string(argv[3]) == "-")
+				server.serve(cin, cout);
+			else
+				server.serveUnixSocket(argv[3]);
+			return 0;
+		}
+
+		if (classify)
+		{
+			r.setTransitiveRoles(transitiveRoles);
+			limits.pCancellationToken = &sInterruptToken;
+			signal(SIGINT, onInterrupt);
+			ThreadPool threadPool(ThreadPool::getHardwareThreadCount());
+			Classifier classifier(&r, &cp);
+			classifier.classify(threadPool, limits);
+			signal(SIGINT, SIG_DFL);
+			const Classifier::Statistics& statistics = classifier.getStatistics();
+			cout << "Classified " << statistics.nameCount << " names in " << statistics.time / 1000 << " ms on " << threadPool.getThreadCount() <<
+			   " threads: " << statistics.satisfiabilityTestCount << " satisfiability tests, " << statistics.subsumptionTestCount <<
+			   " subsumption tests, " << statistics.prunedTestCount << " pruned, " << statistics.unknownTestCount << " stopped by a limit." << endl;
+			classifier.dumpToString(sd, cout);
+			return 0;
+		}
+
 		string conceptString = "";
 		for (int i = 3; i < argc; ++i)
 			conceptString += string(argv[i]) + " ";
@@ -108,7 +245,11 @@ int main(int argc, char** argv)
 			{
 				cout << "Parsed concepts: " << endl;
 				for (size_t i = 0; i < concepts.size(); ++i)
-					cout << "\t* " << concepts[i]->toString(sd) << endl;
+				{
+					cout << "\t* ";
+					parsedWriter.write(cout, concepts[i]);
+					cout << endl;
+				}
 			}
 		}
 
@@ -124,24 +265,154 @@ int main(int argc, char** argv)
 				cout << "NO transitive roles." << endl;
 		}
 
+		if (retrieveInstances)
+		{
+			const Concept* pConcept = Concept::getTopConcept();
+			for (size_t i = 0; i < concepts.size(); ++i)
+				pConcept = i ? cp.makeConjunction(pConcept, concepts[i]) : concepts[i];
+			limits.pCancellationToken = &sInterruptToken;
+			signal(SIGINT, onInterrupt);
+			ThreadPool threadPool(ThreadPool::getHardwareThreadCount());
+			InstanceRetriever retriever(&r, &cp, &abox);
+			Reasoner::Result consistency = retriever.precomplete(threadPool, limits);
+			vector<size_t> instances, unknownIndividuals;
+			retriever.retrieve(threadPool, pConcept, limits, instances, &unknownIndividuals);
+			signal(SIGINT, SIG_DFL);
+			const InstanceRetriever::Statistics& statistics = retriever.getStatistics();
+			cout << "Precompleted " << statistics.individualCount << " individuals in " << statistics.partCount << " parts (" << statistics.wholePartCheckCount <<
+			   " checked as a whole) in " << statistics.precompletionTime / 1000 << " ms on " << threadPool.getThreadCount() << " threads: the Abox is " <<
+			   (consistency == Reasoner::RESULT_SATISFIABLE ? "consistent" : consistency == Reasoner::RESULT_UNSATISFIABLE ? "NOT consistent" : "of unknown consistency") << ".\n";
+			cout << "Retrieved " << instances.size() << " instances in " << statistics.retrievalTime / 1000 << " ms: " << statistics.obviousInstanceCount <<
+			   " obvious instances, " << statistics.obviousNonInstanceCount << " obvious non instances, " << statistics.testCount << " tests, " <<
+			   statistics.prunedTestCount << " pruned, " << statistics.unknownTestCount << " stopped by a limit." << endl;
+			for (size_t i = 0; i < instances.size(); ++i)
+				cout << sd.toName(abox.getName(instances[i])) << endl;
+			for (size_t i = 0; i < unknownIndividuals.size(); ++i)
+				cout << sd.toName(abox.getName(unknownIndividuals[i])) << " ?" << endl;
+			return 0;
+		}
+
+		if (writeTrace && !Trace::isEnabled())
+			throw Exception("Tracing is not compiled in, build with \"make TRACE=1\".");
+
+		limits.pCancellationToken = &sInterruptToken;
+		signal(SIGINT, onInterrupt);
+
 		Model example;
-		if (r.isSatisfiable(concepts, &example, verbose))
+		Reasoner::Statistics statistics;
+		Reasoner::Result result;
+		// A cached answer will do unless the check must show how it got there
+		ResultCache::Fingerprint tboxFingerprint, queryFingerprint;
+		bool cached = false;
+		if (apResultCache.get())
+		{
+			tboxFingerprint = ResultCache::getFingerprint(sd, r.getTboxConcepts());
+			queryFingerprint = ResultCache::getFingerprint(sd, concepts, r.getTransitiveRoles());
+			cached = !verbose && !writeTrace && apResultCache->find(tboxFingerprint, queryFingerprint, result) && (result == Reasoner::RESULT_SATISFIABLE ?
+				!printExampleModelStructure && !dumpToDOT && !printJSONModel && !writeBinaryModel : !explainUnsatisfiability);
+		}
+		if (!cached)
+		{
+			if (portfolio)
+			{
+				ThreadPool threadPool(ThreadPool::getHardwareThreadCount());
+				Portfolio portfolio(&r);
+				result = portfolio.checkSatisfiability(threadPool, concepts, limits, &example, &statistics);
+				if (portfolio.getWinner() == Portfolio::NO_WINNER)
+					cout << "No configuration of " << portfolio.getConfigurations().size() << " answered.\n";
+				else
+					cout << "Configuration " << portfolio.getWinner() + 1 << " of " << portfolio.getConfigurations().size() << " answered first: " <<
+					   Portfolio::describe(portfolio.getConfigurations()[portfolio.getWinner()]) << ".\n";
+			} else if (limits.separateSuccessors)
+			{
+				// The successors of the first node are checked on every core
+				ThreadPool threadPool(ThreadPool::getHardwareThreadCount());
+				limits.pThreadPool = &threadPool;
+				result = r.checkSatisfiability(concepts, limits, &example, verbose, &statistics);
+				limits.pThreadPool = 0;
+			} else
+				result = r.checkSatisfiability(concepts, limits, &example, verbose, &statistics);
+		}
+		signal(SIGINT, SIG_DFL);
+		if (cached)
+			cout << "Answer found in the result cache " << apResultCache->getFileName() << ".\n";
+		else
+		{
+			if (apResultCache.get())
+				apResultCache->store(tboxFingerprint, queryFingerprint, result);
+			cout << "Number of complete trees: " << statistics.completeTreeCount << ". Number of incomplete trees: " << statistics.incompleteTreeCount <<
+			   ". (total " << statistics.completeTreeCount + statistics.incompleteTreeCount << ").\n";
+			cout << "Peak estimated memory: " << statistics.peakByteCount << " bytes of completion trees";
+			if (statistics.evictedTreeCount)
+				cout << ", " << statistics.evictedTreeCount << " trees evicted";
+			cout << ".\n";
+		}
+		if (printStatistics)
+		{
+			statistics.dumpToJSON(cout);
+			cout << endl;
+		}
+		if (writeTrace)
+		{
+			Trace::write("trace.bin", cp, sd);
+			cout << "Trace of the search written to trace.bin." << endl;
+		}
+		if (result == Reasoner::RESULT_SATISFIABLE)
 		{
 			cout << "RESULT: Conjunction of concepts is satisfiable!" << endl;
+			ConceptWriter writer(sd, useConceptIDs);
 			if (printExampleModelStructure)
 			{
 				cout << "Example model: " << endl;
-				example.dumpToString(sd, std::cout, showComplexConcepts);
+				example.dumpToString(writer, std::cout, showComplexConcepts);
 			}
 			if (dumpToDOT)
 			{
 				ofstream outFile("example.dot");
-				example.dumpToDOT(sd, outFile, showComplexConcepts);
+				example.dumpToDOT(writer, outFile, showComplexConcepts);
 				cout << "Example model dumped DOT file dumped to example.dot." << endl;
 			}
+			if (printJSONModel || writeBinaryModel)
+			{
+				CompactModel compact(example, writer);
+				if (printJSONModel)
+				{
+					compact.writeJSON(cout);
+					cout << endl;
+				}
+				if (writeBinaryModel)
+				{
+					ofstream outFile("example.model", ios::binary);
+					compact.writeBinary(outFile);
+					cout << "Example model written to example.model." << endl;
+				}
+			}
 
-		} else
+		} else if (result == Reasoner::RESULT_UNSATISFIABLE)
+		{
 			cout << "RESULT: Conjunction of concepts is NOT satisfiable!" << endl;
+			if (explainUnsatisfiability)
+			{
+				Reasoner::Explanation explanation;
+				r.explain(concepts, limits, explanation);
+				ConceptWriter writer(sd);
+				cout << "Explanation, unsatisfiable together:" << endl;
+				for (size_t i = 0; i < explanation.tboxAxioms.size(); ++i)
+				{
+					cout << "\tTbox axiom " << explanation.tboxAxioms[i] + 1 << ": ";
+					writer.write(cout, r.getTboxConcepts()[explanation.tboxAxioms[i]]);
+					cout << endl;
+				}
+				for (size_t i = 0; i < explanation.concepts.size(); ++i)
+				{
+					cout << "\tConcept " << explanation.concepts[i] + 1 << ": ";
+					writer.write(cout, concepts[explanation.concepts[i]]);
+					cout << endl;
+				}
+			}
+		}
+		else
+			cout << "RESULT: UNKNOWN, the search stopped (" << Reasoner::getLimitName(statistics.limitReached) << " limit reached)." << endl;
 
 		return 0;
 
@@ -28,60 +28,162 @@
 
 #include "Model.h"
 #include "Concept.h"
+#include "SymbolDictionary.h"
+#include <cstring>
 
 using namespace std;
 
 namespace tinyreason
 {
 
+namespace
+{
+
+const char MODEL_MAGIC[8] = {'T', 'R', 'M', 'O', 'D', 'E', 'L', 0};
+const uint32_t MODEL_VERSION = 1;
+const uint32_t MODEL_BYTE_ORDER = 0x01020304;
+
+struct ModelHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t individualCount;
+	uint32_t conceptCount;
+	uint32_t roleCount;
+	uint32_t reserved;
+};
+
+template<class T>
+void writeRaw(ostream& outStream, const T& value)
+{
+	outStream.write((const char*) &value, sizeof (T));
+}
+
+template<class T>
+void writeArray(ostream& outStream, const vector<T>& values)
+{
+	if (!values.empty())
+		outStream.write((const char*) &values[0], values.size() * sizeof (T));
+}
+
+void writeString(ostream& outStream, const string& text)
+{
+	writeRaw(outStream, (uint32_t) text.size());
+	outStream.write(text.data(), text.size());
+}
+
+template<class T>
+void readRaw(istream& inStream, T& value)
+{
+	if (!inStream.read((char*) &value, sizeof (T)))
+		throw Exception("Truncated model file.");
+}
+
+// Counts come from the file, so arrays grow as their data arrives rather than
+// all at once: a damaged count runs out of data before it runs out of memory
+const size_t READ_CHUNK_BYTES = 1 << 20;
+
+template<class T>
+void readArray(istream& inStream, vector<T>& values, size_t count)
+{
+	values.clear();
+	while (values.size() < count)
+	{
+		size_t begin = values.size();
+		values.resize(begin + min(count - begin, READ_CHUNK_BYTES / sizeof (T)));
+		if (!inStream.read((char*) &values[begin], (values.size() - begin) * sizeof (T)))
+			throw Exception("Truncated model file.");
+	}
+}
+
+void readString(istream& inStream, string& text)
+{
+	uint32_t length;
+	readRaw(inStream, length);
+	text.clear();
+	while (text.size() < length)
+	{
+		size_t begin = text.size();
+		text.resize(begin + min((size_t) length - begin, READ_CHUNK_BYTES));
+		if (!inStream.read(&text[begin], text.size() - begin))
+			throw Exception("Truncated model file.");
+	}
+}
+
+void writeJSONString(ostream& outStream, const string& text)
+{
+	outStream << '"';
+	for (size_t i = 0; i < text.size(); ++i)
+	{
+		if (text[i] == '"' || text[i] == '\\')
+			outStream << '\\';
+		outStream << text[i];
+	}
+	outStream << '"';
+}
+
+template<class T>
+void writeJSONArray(ostream& outStream, const vector<T>& values)
+{
+	outStream << '[';
+	for (size_t i = 0; i < values.size(); ++i)
+		outStream << (i ? "," : "") << values[i];
+	outStream << ']';
+}
+
+}
+
+
 void Individual::addRoleAccessibility(Symbol role, const Individual* pIndividual)
 {
-	typedef std::pair<RoleAccessibilityMap::iterator, RoleAccessibilityMap::iterator> Range;
-	const Range& range = mRoleAccessibilities.equal_range(role);
-	for (Range::first_type it = range.first; it != range.second; ++it)
-		if (it->second == pIndividual)
-			return;
-	mRoleAccessibilities.insert(range.first, RoleAccessibilityMap::value_type(role, pIndividual));
+	mRoleAccessibilities.insert(RoleAccessibility(role, pIndividual));
 }
 
-void Individual::dumpToString(const SymbolDictionary& symbolDictionary, std::ostream& outStream, bool showComplexConcepts) const
+void Individual::dumpToString(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts) const
 {
-	outStream << "Individual (node " << mNodeID << ") :" << endl;
+	outStream << "Individual (node " << mNodeID << ") :\n";
 	outStream << "\tTrue concepts:\n";
 
 	bool empty = true;
 	for (std::set<const Concept*>::const_iterator it = mConcepts.begin(); it != mConcepts.end(); ++it)
 		if (showComplexConcepts or (*it)->isAtomic())
 		{
-			outStream << "\t\t" << (*it)->toString(symbolDictionary) << "\n";
+			outStream << "\t\t";
+			writer.write(outStream, *it);
+			outStream << '\n';
 			empty = false;
 		}
 	if (empty)
-		outStream << "\t\t" << Concept::getTopConcept()->toString(symbolDictionary) << "\n"; // Top concept
+	{
+		outStream << "\t\t";
+		writer.write(outStream, Concept::getTopConcept());
+		outStream << '\n';
+	}
 
 	outStream << "\tRole accessibilties:\n";
 
-	for (std::multimap<Symbol, const Individual*>::const_iterator it = mRoleAccessibilities.begin(); it != mRoleAccessibilities.end(); ++it)
-		outStream << "\t\tIndividual " << it->second->mNodeID << " through " << symbolDictionary.toName(it->first) << ";\n";
+	for (RoleAccessibilitySet::const_iterator it = mRoleAccessibilities.begin(); it != mRoleAccessibilities.end(); ++it)
+		outStream << "\t\tIndividual " << it->second->mNodeID << " through " << writer.getSymbolDictionary().toName(it->first) << ";\n";
 }
 
-void Individual::dumpToDOT(const SymbolDictionary & symbolDictionary, std::ostream & outStream, bool showComplexConcepts) const
+void Individual::dumpToDOT(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts) const
 {
 	outStream << (size_t)this << "[label=\"(node " << mNodeID << ")|";
 	bool empty = true;
 	for (std::set<const Concept*>::const_iterator it = mConcepts.begin(); it != mConcepts.end(); ++it)
 		if (showComplexConcepts or (*it)->isAtomic())
 		{
-			outStream << (*it)->toString(symbolDictionary) << "\\n";
+			writer.write(outStream, *it);
+			outStream << "\\n";
 			empty = false;
 		}
 
 	if (empty)
-		outStream << Concept::getTopConcept()->toString(symbolDictionary); // Top concept
+		writer.write(outStream, Concept::getTopConcept());
 	outStream << "\"];";
 
-	for (std::multimap<Symbol, const Individual*>::const_iterator it = mRoleAccessibilities.begin(); it != mRoleAccessibilities.end(); ++it)
-		outStream << (size_t)this << " -> " << (size_t) it->second << "[label=\"" << symbolDictionary.toName(it->first) << "\"];";
+	for (RoleAccessibilitySet::const_iterator it = mRoleAccessibilities.begin(); it != mRoleAccessibilities.end(); ++it)
+		outStream << (size_t)this << " -> " << (size_t) it->second << "[label=\"" << writer.getSymbolDictionary().toName(it->first) << "\"];";
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -95,7 +197,7 @@ Model::~Model()
 
 Individual * Model::createIndividual(size_t nodeID)
 {
-	Individual* pIndividual = new Individual(nodeID);
+	Individual* pIndividual = new Individual(nodeID, mIndividuals.size());
 	mIndividuals.push_back(pIndividual);
 	return pIndividual;
 }
@@ -105,19 +207,203 @@ void Model::clear()
 	deleteAll(mIndividuals);
 }
 
+void Model::swap(Model& model)
+{
+	std::swap(mFreeIndividualID, model.mFreeIndividualID);
+	mIndividuals.swap(model.mIndividuals);
+}
+
 void Model::dumpToString(const SymbolDictionary& symbolDictionary, std::ostream& outStream, bool showComplexConcepts) const
 {
-	for (size_t i = 0; i < mIndividuals.size(); ++i)
-		mIndividuals[i]->dumpToString(symbolDictionary, outStream, showComplexConcepts);
+	ConceptWriter writer(symbolDictionary);
+	dumpToString(writer, outStream, showComplexConcepts);
 }
 
 void Model::dumpToDOT(const SymbolDictionary& symbolDictionary, std::ostream& outStream, bool showComplexConcepts) const
+{
+	ConceptWriter writer(symbolDictionary);
+	dumpToDOT(writer, outStream, showComplexConcepts);
+}
+
+void Model::dumpToString(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts) const
+{
+	for (size_t i = 0; i < mIndividuals.size(); ++i)
+		mIndividuals[i]->dumpToString(writer, outStream, showComplexConcepts);
+	if (writer.isUsingIDs())
+	{
+		outStream << "Concepts:\n";
+		writer.writeLegend(outStream, "\n");
+	}
+}
+
+void Model::dumpToDOT(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts) const
 {
 	outStream << "digraph {rankdir=TB;node[shape=record];";
 	for (size_t i = 0; i < mIndividuals.size(); ++i)
-		mIndividuals[i]->dumpToDOT(symbolDictionary, outStream, showComplexConcepts);
+		mIndividuals[i]->dumpToDOT(writer, outStream, showComplexConcepts);
+	if (writer.isUsingIDs())
+	{
+		outStream << "legend[shape=note,label=\"";
+		writer.writeLegend(outStream, "\\l");
+		outStream << "\"];";
+	}
 	outStream << "}";
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+CompactModel::CompactModel(const Model& model, ConceptWriter& writer) : mWordsPerIndividual(0)
+{
+	const vector<Individual*>& individuals = model.mIndividuals;
+
+	// Columns by concept ID
+	map<ConceptID, const Concept*> concepts;
+	for (size_t i = 0; i < individuals.size(); ++i)
+		for (set<const Concept*>::const_iterator it = individuals[i]->mConcepts.begin(); it != individuals[i]->mConcepts.end(); ++it)
+			concepts[(*it)->getID()] = *it;
+	map<ConceptID, size_t> columns;
+	for (map<ConceptID, const Concept*>::const_iterator it = concepts.begin(); it != concepts.end(); ++it)
+	{
+		columns[it->first] = mConceptIDs.size();
+		mConceptIDs.push_back(it->first);
+		ostringstream text;
+		writer.write(text, it->second);
+		mConceptTexts.push_back(text.str());
+	}
+
+	mWordsPerIndividual = (mConceptIDs.size() + 63) / 64;
+	mConceptBits.assign(individuals.size() * mWordsPerIndividual, 0);
+	map<Symbol, size_t> roles;
+	for (size_t i = 0; i < individuals.size(); ++i)
+	{
+		mNodeIDs.push_back(individuals[i]->mNodeID);
+		for (set<const Concept*>::const_iterator it = individuals[i]->mConcepts.begin(); it != individuals[i]->mConcepts.end(); ++it)
+		{
+			size_t column = columns[(*it)->getID()];
+			mConceptBits[i * mWordsPerIndividual + column / 64] |= (uint64_t) 1 << (column % 64);
+		}
+		for (Individual::RoleAccessibilitySet::const_iterator it = individuals[i]->mRoleAccessibilities.begin(); it != individuals[i]->mRoleAccessibilities.end(); ++it)
+			roles.insert(make_pair(it->first, 0));
+	}
+
+	for (map<Symbol, size_t>::iterator it = roles.begin(); it != roles.end(); ++it)
+	{
+		it->second = mRoles.size();
+		mRoles.push_back(RoleAdjacency());
+		mRoles.back().name = writer.getSymbolDictionary().toName(it->first);
+		mRoles.back().offsets.push_back(0);
+	}
+	// The accessibilities of an individual are sorted by role then by target
+	for (size_t i = 0; i < individuals.size(); ++i)
+	{
+		for (Individual::RoleAccessibilitySet::const_iterator it = individuals[i]->mRoleAccessibilities.begin(); it != individuals[i]->mRoleAccessibilities.end(); ++it)
+			mRoles[roles[it->first]].targets.push_back(it->second->mIndex);
+		for (size_t r = 0; r < mRoles.size(); ++r)
+			mRoles[r].offsets.push_back(mRoles[r].targets.size());
+	}
+}
+
+void CompactModel::writeBinary(std::ostream& outStream) const
+{
+	ModelHeader header;
+	memcpy(header.magic, MODEL_MAGIC, sizeof (MODEL_MAGIC));
+	header.version = MODEL_VERSION;
+	header.byteOrder = MODEL_BYTE_ORDER;
+	header.individualCount = mNodeIDs.size();
+	header.conceptCount = mConceptIDs.size();
+	header.roleCount = mRoles.size();
+	header.reserved = 0;
+	writeRaw(outStream, header);
+
+	writeArray(outStream, mNodeIDs);
+	writeArray(outStream, mConceptIDs);
+	for (size_t i = 0; i < mConceptTexts.size(); ++i)
+		writeString(outStream, mConceptTexts[i]);
+	writeArray(outStream, mConceptBits);
+	for (size_t r = 0; r < mRoles.size(); ++r)
+	{
+		writeString(outStream, mRoles[r].name);
+		writeArray(outStream, mRoles[r].offsets);
+		writeArray(outStream, mRoles[r].targets);
+	}
+}
+
+CompactModel CompactModel::read(std::istream& inStream)
+{
+	ModelHeader header;
+	readRaw(inStream, header);
+	if (memcmp(header.magic, MODEL_MAGIC, sizeof (MODEL_MAGIC)) != 0)
+		throw Exception("Not a model file.");
+	if (header.version != MODEL_VERSION || header.byteOrder != MODEL_BYTE_ORDER)
+		throw Exception("Model file written by an incompatible build.");
+
+	CompactModel model;
+	readArray(inStream, model.mNodeIDs, header.individualCount);
+	readArray(inStream, model.mConceptIDs, header.conceptCount);
+	for (size_t i = 0; i < header.conceptCount; ++i)
+	{
+		model.mConceptTexts.push_back(string());
+		readString(inStream, model.mConceptTexts.back());
+	}
+	model.mWordsPerIndividual = ((size_t) header.conceptCount + 63) / 64;
+	if (model.mWordsPerIndividual && header.individualCount > (size_t) -1 / sizeof (uint64_t) / model.mWordsPerIndividual)
+		throw Exception("Damaged model file.");
+	readArray(inStream, model.mConceptBits, header.individualCount * model.mWordsPerIndividual);
+	for (size_t r = 0; r < header.roleCount; ++r)
+	{
+		model.mRoles.push_back(RoleAdjacency());
+		RoleAdjacency& role = model.mRoles.back();
+		readString(inStream, role.name);
+		readArray(inStream, role.offsets, (size_t) header.individualCount + 1);
+		// Each individual's edges follow the previous one's and lead to an individual
+		if (role.offsets.size() != (size_t) header.individualCount + 1 || role.offsets[0] != 0)
+			throw Exception("Damaged model file.");
+		for (size_t i = 1; i < role.offsets.size(); ++i)
+			if (role.offsets[i] < role.offsets[i - 1])
+				throw Exception("Damaged model file.");
+		readArray(inStream, role.targets, role.offsets.back());
+		for (size_t i = 0; i < role.targets.size(); ++i)
+			if (role.targets[i] >= header.individualCount)
+				throw Exception("Damaged model file.");
+	}
+	return model;
+}
+
+void CompactModel::writeJSON(std::ostream& outStream) const
+{
+	outStream << "{\"concepts\":[";
+	for (size_t i = 0; i < mConceptIDs.size(); ++i)
+	{
+		outStream << (i ? "," : "") << "{\"id\":" << mConceptIDs[i] << ",\"text\":";
+		writeJSONString(outStream, mConceptTexts[i]);
+		outStream << '}';
+	}
+	outStream << "],\"individuals\":[";
+	for (size_t i = 0; i < mNodeIDs.size(); ++i)
+	{
+		outStream << (i ? "," : "") << "{\"node\":" << mNodeIDs[i] << ",\"concepts\":[";
+		bool first = true;
+		for (size_t column = 0; column < mConceptIDs.size(); ++column)
+			if (hasConcept(i, column))
+			{
+				outStream << (first ? "" : ",") << column;
+				first = false;
+			}
+		outStream << "]}";
+	}
+	outStream << "],\"roles\":[";
+	for (size_t r = 0; r < mRoles.size(); ++r)
+	{
+		outStream << (r ? "," : "") << "{\"name\":";
+		writeJSONString(outStream, mRoles[r].name);
+		outStream << ",\"offsets\":";
+		writeJSONArray(outStream, mRoles[r].offsets);
+		outStream << ",\"targets\":";
+		writeJSONArray(outStream, mRoles[r].targets);
+		outStream << '}';
+	}
+	outStream << "]}";
+}
+
 }
 
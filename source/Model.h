@@ -29,27 +29,43 @@
 #pragma once
 
 #include "Common.h"
+#include "ConceptWriter.h"
+#include <stdint.h>
 
 namespace tinyreason
 {
 
 class Individual {
 public:
-	Individual(size_t nodeID) : mNodeID(nodeID) { }
-	const std::set<const Concept*>& getConcepts() {
+	Individual(size_t nodeID, size_t index) : mNodeID(nodeID), mIndex(index) { }
+	size_t getNodeID() const {
+		return mNodeID;
+	}
+	const std::set<const Concept*>& getConcepts() const {
 		return mConcepts;
 	}
 	void addConcept(const Concept* pConcept) {
 		mConcepts.insert(pConcept);
 	}
 	void addRoleAccessibility(Symbol role, const Individual* pIndividual);
-	void dumpToString(const SymbolDictionary& symbolDictionary, std::ostream& outStream, bool showComplexConcepts = false) const;
-	void dumpToDOT(const SymbolDictionary& symbolDictionary, std::ostream& outStream, bool showComplexConcepts = false) const;
+	void dumpToString(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts = false) const;
+	void dumpToDOT(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts = false) const;
 private:
-	typedef std::multimap<Symbol, const Individual*> RoleAccessibilityMap;
+	friend class CompactModel;
+	typedef std::pair<Symbol, const Individual*> RoleAccessibility;
+
+	// By role then by creation order of the accessible individual
+	struct CompareRoleAccessibilities {
+		bool operator()(const RoleAccessibility& a1, const RoleAccessibility& a2) const {
+			return a1.first < a2.first || (a1.first == a2.first && a1.second->mIndex < a2.second->mIndex);
+		}
+	};
+	typedef std::set<RoleAccessibility, CompareRoleAccessibilities> RoleAccessibilitySet;
+
 	size_t mNodeID;
+	size_t mIndex; // in the model
 	std::set<const Concept*> mConcepts;
-	RoleAccessibilityMap mRoleAccessibilities;
+	RoleAccessibilitySet mRoleAccessibilities;
 };
 
 class Model {
@@ -57,14 +73,80 @@ public:
 	Model();
 	~Model();
 	Individual* createIndividual(size_t nodeID);
+	size_t getIndividualCount() const {
+		return mIndividuals.size();
+	}
+	const Individual* getIndividual(size_t index) const {
+		return mIndividuals[index];
+	}
 	void clear();
+	void swap(Model& model);
 	void dumpToString(const SymbolDictionary& symbolDictionary, std::ostream& outStream, bool showComplexConcepts = false) const;
 	void dumpToDOT(const SymbolDictionary& symbolDictionary, std::ostream& outStream, bool showComplexConcepts = false) const;
+	// The writer can be shared by several dumps, with concept IDs a legend follows the model
+	void dumpToString(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts = false) const;
+	void dumpToDOT(ConceptWriter& writer, std::ostream& outStream, bool showComplexConcepts = false) const;
 private:
+	friend class CompactModel;
 	size_t mFreeIndividualID;
 	std::vector<Individual*> mIndividuals;
 };
 
+/**
+ * Flat layout of a model for consumers outside the reasoner. Individuals are
+ * numbered by creation order. The concepts that occur in the model are the
+ * columns of a bitset per individual, each column remembers the concept ID and
+ * text. The edges of each role are in compressed sparse rows: the successors of
+ * individual i are targets[offsets[i]] up to targets[offsets[i + 1]].
+ *
+ * writeBinary() and read() use a versioned layout of fixed size fields in the
+ * byte order of the writer, which the header records. read() throws on a file
+ * whose offsets decrease or whose edges lead past the last individual.
+ * writeJSON() streams the same content as a JSON object.
+ */
+class CompactModel {
+public:
+	struct RoleAdjacency {
+		std::string name;
+		std::vector<uint32_t> offsets; // individual count + 1
+		std::vector<uint32_t> targets;
+	};
+
+	CompactModel() : mWordsPerIndividual(0) { }
+	CompactModel(const Model& model, ConceptWriter& writer);
+	size_t getIndividualCount() const {
+		return mNodeIDs.size();
+	}
+	uint32_t getNodeID(size_t individual) const {
+		return mNodeIDs[individual];
+	}
+	size_t getConceptCount() const {
+		return mConceptIDs.size();
+	}
+	ConceptID getConceptID(size_t column) const {
+		return mConceptIDs[column];
+	}
+	const std::string& getConceptText(size_t column) const {
+		return mConceptTexts[column];
+	}
+	bool hasConcept(size_t individual, size_t column) const {
+		return (mConceptBits[individual * mWordsPerIndividual + column / 64] >> (column % 64)) & 1;
+	}
+	const std::vector<RoleAdjacency>& getRoles() const {
+		return mRoles;
+	}
+	void writeBinary(std::ostream& outStream) const;
+	void writeJSON(std::ostream& outStream) const;
+	static CompactModel read(std::istream& inStream);
+private:
+	std::vector<uint32_t> mNodeIDs;
+	std::vector<ConceptID> mConceptIDs;
+	std::vector<std::string> mConceptTexts;
+	size_t mWordsPerIndividual;
+	std::vector<uint64_t> mConceptBits;
+	std::vector<RoleAdjacency> mRoles;
+};
+
 
 }
 
@@ -0,0 +1,191 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "NogoodSet.h"
+
+using namespace std;
+
+namespace tinyreason
+{
+
+NogoodSet::NogoodSet(size_t capacity) :
+mCapacity(capacity), mTick(0), mLoadTick(0) { }
+
+void NogoodSet::setCapacity(size_t capacity)
+{
+	mCapacity = capacity;
+	while (mIndexes.size() > mCapacity)
+		evict();
+}
+
+bool NogoodSet::add(const Nogood& nogood)
+{
+	map<Nogood, size_t>::const_iterator it = mIndexes.find(nogood);
+	if (it != mIndexes.end())
+	{
+		touch(it->second);
+		return false;
+	}
+	if (!mCapacity || nogood.empty())
+		return false;
+	if (mIndexes.size() >= mCapacity)
+		evict();
+
+	size_t index;
+	if (mFreeEntries.empty())
+	{
+		index = mEntries.size();
+		mEntries.push_back(Entry());
+	} else
+	{
+		index = mFreeEntries.back();
+		mFreeEntries.pop_back();
+	}
+	Entry& entry = mEntries[index];
+	entry.nogood = nogood;
+	entry.lastUse = ++mTick;
+	mIndexes[nogood] = index;
+	mUses.insert(UseSet::value_type(entry.lastUse, index));
+	for (size_t i = 0; i < nogood.size(); ++i)
+		mWatchers[nogood[i]].push_back(index);
+	return true;
+}
+
+const std::vector<size_t>& NogoodSet::getWatchers(const Key& key) const
+{
+	static const vector<size_t> none;
+	map< Key, vector<size_t> >::const_iterator it = mWatchers.find(key);
+	return it == mWatchers.end() ? none : it->second;
+}
+
+void NogoodSet::touch(size_t index)
+{
+	Entry& entry = mEntries[index];
+	mUses.erase(UseSet::value_type(entry.lastUse, index));
+	entry.lastUse = ++mTick;
+	mUses.insert(UseSet::value_type(entry.lastUse, index));
+}
+
+void NogoodSet::remove(const Key& key)
+{
+	map< Key, vector<size_t> >::const_iterator it;
+	while ((it = mWatchers.find(key)) != mWatchers.end())
+		removeEntry(it->second.back());
+}
+
+void NogoodSet::getKeys(std::vector<Key>& keys) const
+{
+	keys.clear();
+	for (map< Key, vector<size_t> >::const_iterator it = mWatchers.begin(); it != mWatchers.end(); ++it)
+		keys.push_back(it->first);
+}
+
+void NogoodSet::evict()
+{
+	removeEntry(mUses.begin()->second);
+}
+
+void NogoodSet::removeEntry(size_t index)
+{
+	Entry& entry = mEntries[index];
+	mUses.erase(UseSet::value_type(entry.lastUse, index));
+	for (size_t i = 0; i < entry.nogood.size(); ++i)
+	{
+		vector<size_t>& watchers = mWatchers[entry.nogood[i]];
+		watchers.erase(find(watchers.begin(), watchers.end(), index));
+		if (watchers.empty())
+			mWatchers.erase(entry.nogood[i]);
+	}
+	mIndexes.erase(entry.nogood);
+	entry.nogood.clear();
+	mFreeEntries.push_back(index);
+}
+
+NogoodSet::Store::Store() :
+mpNogoods(new NogoodSet())
+{
+	pthread_mutex_init(&mMutex, 0);
+}
+
+NogoodSet::Store::Store(const Store& store) :
+mpNogoods(new NogoodSet())
+{
+	pthread_mutex_init(&mMutex, 0);
+	pthread_mutex_lock(&store.mMutex);
+	*mpNogoods = *store.mpNogoods;
+	pthread_mutex_unlock(&store.mMutex);
+}
+
+NogoodSet::Store& NogoodSet::Store::operator=(const Store& store)
+{
+	if (this != &store)
+	{
+		pthread_mutex_lock(&store.mMutex);
+		NogoodSet nogoods(*store.mpNogoods);
+		pthread_mutex_unlock(&store.mMutex);
+		pthread_mutex_lock(&mMutex);
+		*mpNogoods = nogoods;
+		pthread_mutex_unlock(&mMutex);
+	}
+	return *this;
+}
+
+NogoodSet::Store::~Store()
+{
+	pthread_mutex_destroy(&mMutex);
+	delete mpNogoods;
+}
+
+void NogoodSet::Store::load(NogoodSet& nogoods, size_t capacity) const
+{
+	pthread_mutex_lock(&mMutex);
+	nogoods = *mpNogoods;
+	pthread_mutex_unlock(&mMutex);
+	nogoods.mLoadTick = nogoods.mTick;
+	nogoods.setCapacity(capacity);
+}
+
+void NogoodSet::Store::save(const NogoodSet& nogoods)
+{
+	pthread_mutex_lock(&mMutex);
+	// The store grows to the largest capacity a check asked for
+	if (nogoods.mCapacity > mpNogoods->mCapacity)
+		mpNogoods->mCapacity = nogoods.mCapacity;
+	for (UseSet::const_iterator it = nogoods.mUses.upper_bound(UseSet::value_type(nogoods.mLoadTick, (size_t) -1)); it != nogoods.mUses.end(); ++it)
+		mpNogoods->add(nogoods.mEntries[it->second].nogood);
+	pthread_mutex_unlock(&mMutex);
+}
+
+void NogoodSet::Store::clear()
+{
+	pthread_mutex_lock(&mMutex);
+	*mpNogoods = NogoodSet(mpNogoods->mCapacity);
+	pthread_mutex_unlock(&mMutex);
+}
+
+}
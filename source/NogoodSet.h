@@ -0,0 +1,105 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include <pthread.h>
+
+namespace tinyreason
+{
+
+/**
+ * Sets of label concepts that clashed together, each of them unsatisfiable
+ * in any node that has the Tbox it was learned with. Bounded: once full,
+ * the nogood used least recently makes room for the new one. One set serves
+ * a single check, so it needs no locking.
+ */
+class NogoodSet {
+public:
+	typedef std::pair<int, size_t> Key; // as Reasoner::Node::DependencyKey
+	typedef std::vector<Key> Nogood; // sorted
+
+	/** Keeps the nogoods between the checks made with the same Tbox, which may run in parallel */
+	class Store {
+	public:
+		Store();
+		Store(const Store& store);
+		~Store();
+		Store& operator=(const Store& store);
+		void load(NogoodSet& nogoods, size_t capacity) const;
+		// Adds the nogoods learned or used by the check, most recent last
+		void save(const NogoodSet& nogoods);
+		void clear();
+	private:
+		mutable pthread_mutex_t mMutex;
+		NogoodSet* mpNogoods;
+	};
+
+	NogoodSet(size_t capacity = 0);
+	size_t getCapacity() const {
+		return mCapacity;
+	}
+	size_t getSize() const {
+		return mIndexes.size();
+	}
+	// Evicts the least recently used nogoods that no longer fit
+	void setCapacity(size_t capacity);
+	// False if it was known already, which only marks it as used
+	bool add(const Nogood& nogood);
+	// The indexes of the nogoods that contain key
+	const std::vector<size_t>& getWatchers(const Key& key) const;
+	const Nogood& get(size_t index) const {
+		return mEntries[index].nogood;
+	}
+	void touch(size_t index);
+	// Removes the nogoods that contain key
+	void remove(const Key& key);
+	// The keys found in the nogoods, sorted
+	void getKeys(std::vector<Key>& keys) const;
+private:
+	struct Entry {
+		Nogood nogood;
+		unsigned long long lastUse;
+	};
+	typedef std::set< std::pair<unsigned long long, size_t> > UseSet;
+
+	void evict();
+	void removeEntry(size_t index);
+
+	size_t mCapacity;
+	unsigned long long mTick;
+	unsigned long long mLoadTick; // nothing was used after it when loaded
+	std::vector<Entry> mEntries;
+	std::vector<size_t> mFreeEntries;
+	std::map<Nogood, size_t> mIndexes;
+	std::map< Key, std::vector<size_t> > mWatchers;
+	UseSet mUses; // of the entries in use, by last use
+};
+
+}
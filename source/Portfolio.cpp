@@ -0,0 +1,118 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "Portfolio.h"
+#include "Model.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace tinyreason
+{
+
+class Portfolio::CheckJob : public ThreadPool::Job {
+public:
+	CheckJob(Portfolio* pPortfolio, const std::vector<const Concept*>& concepts, CancellationToken& cancellationToken) :
+	mpPortfolio(pPortfolio), mConcepts(concepts), mCancellationToken(cancellationToken),
+	mResults(pPortfolio->mConfigurations.size(), Reasoner::RESULT_UNKNOWN), mModels(pPortfolio->mConfigurations.size()),
+	mStatistics(pPortfolio->mConfigurations.size()) { }
+	void execute(size_t item) {
+		// Checks starting after the winner are cancelled right away
+		mResults[item] = mpPortfolio->mpReasoner->checkSatisfiability(mConcepts, mpPortfolio->mConfigurations[item], &mModels[item], false, &mStatistics[item]);
+		if (mResults[item] != Reasoner::RESULT_UNKNOWN && __sync_bool_compare_and_swap(&mpPortfolio->mWinner, (size_t) NO_WINNER, item))
+			mCancellationToken.cancel();
+	}
+	Reasoner::Result getResult(size_t item) const {
+		return mResults[item];
+	}
+	Model& getModel(size_t item) {
+		return mModels[item];
+	}
+	const Reasoner::Statistics& getStatistics(size_t item) const {
+		return mStatistics[item];
+	}
+private:
+	Portfolio* mpPortfolio;
+	const std::vector<const Concept*>& mConcepts;
+	CancellationToken& mCancellationToken;
+	std::vector<Reasoner::Result> mResults;
+	std::vector<Model> mModels;
+	std::vector<Reasoner::Statistics> mStatistics;
+};
+
+Portfolio::Portfolio(const Reasoner* pReasoner) :
+mpReasoner(pReasoner), mWinner(NO_WINNER) { }
+
+Reasoner::Result Portfolio::checkSatisfiability(ThreadPool& threadPool, const std::vector<const Concept*>& concepts, const Reasoner::Limits& limits,
+	Model* pModel, Reasoner::Statistics* pStatistics)
+{
+	CancellationToken cancellationToken(limits.pCancellationToken);
+	makeConfigurations(limits, threadPool.getThreadCount(), mConfigurations);
+	for (size_t i = 0; i < mConfigurations.size(); ++i)
+		mConfigurations[i].pCancellationToken = &cancellationToken;
+	mWinner = NO_WINNER;
+	CheckJob job(this, concepts, cancellationToken);
+	threadPool.run(job, mConfigurations.size());
+
+	size_t answer = mWinner == NO_WINNER ? 0 : mWinner;
+	if (pModel)
+		pModel->swap(job.getModel(answer));
+	if (pStatistics)
+		*pStatistics = job.getStatistics(answer);
+	return job.getResult(answer);
+}
+
+void Portfolio::makeConfigurations(const Reasoner::Limits& limits, size_t count, std::vector<Reasoner::Limits>& configurations)
+{
+	// Every heuristic with either strategy first, then seeded variations
+	static const size_t HEURISTIC_COUNT = BranchingHeuristic::KIND_ACTIVITIES + 1;
+
+	configurations.assign(max(count, (size_t) 1), limits);
+	for (size_t i = 1; i < configurations.size(); ++i)
+	{
+		Reasoner::Limits& configuration = configurations[i];
+		configuration.heuristic = (BranchingHeuristic::Kind) ((limits.heuristic + i) % HEURISTIC_COUNT);
+		configuration.searchStrategy = (i / HEURISTIC_COUNT) % 2 ? Reasoner::SEARCH_DEPTH_FIRST : Reasoner::SEARCH_BEST_FIRST;
+		if (limits.searchStrategy == Reasoner::SEARCH_DEPTH_FIRST)
+			configuration.searchStrategy = configuration.searchStrategy == Reasoner::SEARCH_DEPTH_FIRST ? Reasoner::SEARCH_BEST_FIRST : Reasoner::SEARCH_DEPTH_FIRST;
+		if (i >= 2 * HEURISTIC_COUNT)
+			configuration.randomSeed = limits.randomSeed + i;
+	}
+}
+
+std::string Portfolio::describe(const Reasoner::Limits& limits)
+{
+	static const char* heuristicNames[] = {"types", "moms", "vsids"};
+	string description = string("heuristic=") + heuristicNames[limits.heuristic] + ",search=" +
+		(limits.searchStrategy == Reasoner::SEARCH_DEPTH_FIRST ? "depth" : "best");
+	if (limits.randomSeed)
+		description += ",seed=" + toString(limits.randomSeed);
+	return description;
+}
+
+}
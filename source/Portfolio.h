@@ -0,0 +1,75 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include "Reasoner.h"
+
+namespace tinyreason
+{
+
+class ThreadPool;
+
+/**
+ * Runs the same satisfiability check under several configurations at once,
+ * one per thread of a pool: the heuristics ordering the disjunctions, the
+ * order in which the open trees are expanded and the seed breaking the ties
+ * of the heuristics. The first definitive answer wins and cancels the other
+ * checks; the answer is unknown only when every check stopped at a limit.
+ */
+class Portfolio {
+public:
+	enum {
+		NO_WINNER = (size_t) -1
+	};
+
+	Portfolio(const Reasoner* pReasoner);
+	// The limits given apply to each configuration, cancelling them cancels all
+	Reasoner::Result checkSatisfiability(ThreadPool& threadPool, const std::vector<const Concept*>& concepts, const Reasoner::Limits& limits,
+		Model* pModel = 0, Reasoner::Statistics* pStatistics = 0);
+	// Of the last check, the winner is NO_WINNER when none answered
+	size_t getWinner() const {
+		return mWinner;
+	}
+	const std::vector<Reasoner::Limits>& getConfigurations() const {
+		return mConfigurations;
+	}
+	// The first one is the configuration given, the others vary it
+	static void makeConfigurations(const Reasoner::Limits& limits, size_t count, std::vector<Reasoner::Limits>& configurations);
+	// As accepted by Reasoner::Limits::parse()
+	static std::string describe(const Reasoner::Limits& limits);
+private:
+	class CheckJob;
+
+	const Reasoner* mpReasoner;
+	std::vector<Reasoner::Limits> mConfigurations;
+	volatile size_t mWinner;
+};
+
+}
@@ -28,21 +28,211 @@
 
 #include "Reasoner.h"
 #include "Model.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 
 using namespace std;
 
 namespace tinyreason
 {
 
+// Rough size of an entry of a tree based standard container, beside its value
+static const size_t TREE_ENTRY_OVERHEAD = 4 * sizeof (void*);
+
+// These are estimates: the allocator's own bookkeeping is ignored
+const size_t Reasoner::CompletionTree::NODE_BYTES = sizeof (Node) + 2 * TREE_ENTRY_OVERHEAD;
+const size_t Reasoner::CompletionTree::LABEL_ENTRY_BYTES = TREE_ENTRY_OVERHEAD + sizeof (void*);
+const size_t Reasoner::CompletionTree::EDGE_BYTES = TREE_ENTRY_OVERHEAD + sizeof (SymbolNodePair);
+const size_t Reasoner::CompletionTree::EXPANDABLE_CONCEPT_BYTES = sizeof (ExpandableConcept) + sizeof (const ExpandableConcept*);
+
+// Checks the successors of the first node in parallel, each with a search
+// of its own. The first unsatisfiable one cancels the others.
+class Reasoner::SuccessorJob : public ThreadPool::Job {
+public:
+	SuccessorJob(const Reasoner* pReasoner, const Search& search, const SuccessorPath& path, const std::vector< std::vector<const Concept*> >& successors) :
+	mpReasoner(pReasoner), mSearch(search), mPath(path), mSuccessors(successors), mCancellationToken(search.pLimits->pCancellationToken),
+	mLimits(*search.pLimits), mResults(successors.size(), RESULT_UNKNOWN), mStatistics(successors.size()),
+	mBlockingDepths(successors.size(), (size_t) -1)
+	{
+		mLimits.pCancellationToken = &mCancellationToken;
+		mLimits.pThreadPool = 0;
+	}
+	void execute(size_t item) {
+		ScopedPointer<BranchingHeuristic> apHeuristic(mpReasoner->createHeuristic(mLimits, mSuccessors[item]));
+		apHeuristic->setSeed(mLimits.randomSeed);
+		Search search(&mLimits, mSearch.pTbox, false, apHeuristic.get());
+		search.startTime = mSearch.startTime;
+		NogoodSet nogoods;
+		mpReasoner->loadNogoods(search, nogoods);
+		search.separateSuccessors = true;
+		search.pSuccessorCache = mSearch.pSuccessorCache;
+		mResults[item] = mpReasoner->checkSuccessor(search, mPath, mSuccessors[item], 0);
+		if (mResults[item] == RESULT_UNSATISFIABLE)
+			mCancellationToken.cancel();
+		mpReasoner->keepHeuristic(mLimits, apHeuristic.get());
+		mpReasoner->saveNogoods(search, nogoods);
+		mStatistics[item] = search.statistics;
+		mBlockingDepths[item] = search.blockingDepth;
+	}
+	// Adds the figures of the checks to search
+	Result getResult(Search& search) const {
+		Result result = RESULT_SATISFIABLE;
+		for (size_t i = 0; i < mResults.size(); ++i)
+		{
+			search.statistics.add(mStatistics[i]);
+			search.blockingDepth = min(search.blockingDepth, mBlockingDepths[i]);
+			if (mResults[i] == RESULT_UNSATISFIABLE)
+				result = RESULT_UNSATISFIABLE;
+			else if (mResults[i] == RESULT_UNKNOWN && result == RESULT_SATISFIABLE)
+			{
+				result = RESULT_UNKNOWN;
+				search.statistics.limitReached = mStatistics[i].limitReached;
+			}
+		}
+		return result;
+	}
+private:
+	const Reasoner* mpReasoner;
+	const Search& mSearch;
+	const SuccessorPath& mPath;
+	const std::vector< std::vector<const Concept*> >& mSuccessors;
+	CancellationToken mCancellationToken;
+	Limits mLimits;
+	std::vector<Result> mResults;
+	std::vector<Statistics> mStatistics;
+	std::vector<size_t> mBlockingDepths;
+};
+
+Reasoner::Statistics::Statistics() :
+completeTreeCount(0), incompleteTreeCount(0), createdTreeCount(0), expansionCount(0),
+clashCount(0), duplicationCount(0), createdNodeCount(0), blockedSkipCount(0), blockedNodeCount(0),
+peakOpenTreeCount(0), peakByteCount(0), evictedTreeCount(0), conceptByteCount(0), learnedNogoodCount(0), nogoodClashCount(0),
+successorCheckCount(0), successorCacheHitCount(0), preprocessingTime(0), expansionTime(0), modelExtractionTime(0), limitReached(LIMIT_NONE)
+{
+	for (size_t i = 0; i < CONCEPT_TYPE_COUNT; ++i)
+		ruleApplicationCounts[i] = 0;
+}
+
+// The times and the limit reached stay those of this check
+void Reasoner::Statistics::add(const Statistics& statistics)
+{
+	completeTreeCount += statistics.completeTreeCount;
+	createdTreeCount += statistics.createdTreeCount;
+	expansionCount += statistics.expansionCount;
+	for (size_t i = 0; i < CONCEPT_TYPE_COUNT; ++i)
+		ruleApplicationCounts[i] += statistics.ruleApplicationCounts[i];
+	clashCount += statistics.clashCount;
+	duplicationCount += statistics.duplicationCount;
+	createdNodeCount += statistics.createdNodeCount;
+	blockedSkipCount += statistics.blockedSkipCount;
+	peakOpenTreeCount = max(peakOpenTreeCount, statistics.peakOpenTreeCount);
+	peakByteCount = max(peakByteCount, statistics.peakByteCount);
+	evictedTreeCount += statistics.evictedTreeCount;
+	learnedNogoodCount += statistics.learnedNogoodCount;
+	nogoodClashCount += statistics.nogoodClashCount;
+	successorCheckCount += statistics.successorCheckCount;
+	successorCacheHitCount += statistics.successorCacheHitCount;
+}
+
+void Reasoner::Statistics::dumpToJSON(std::ostream& outStream) const
+{
+	static const char* typeNames[CONCEPT_TYPE_COUNT] = {
+		"positiveAtomic", "negativeAtomic", "conjunction", "disjunction", "existentialRestriction", "universalRestriction"
+	};
+
+	outStream << "{\"completeTrees\":" << completeTreeCount << ",\"incompleteTrees\":" << incompleteTreeCount <<
+	   ",\"createdTrees\":" << createdTreeCount << ",\"expansions\":" << expansionCount << ",\"ruleApplications\":{";
+	for (size_t i = 0; i < CONCEPT_TYPE_COUNT; ++i)
+		outStream << (i ? "," : "") << "\"" << typeNames[i] << "\":" << ruleApplicationCounts[i];
+	outStream << "},\"clashes\":" << clashCount << ",\"duplications\":" << duplicationCount <<
+	   ",\"createdNodes\":" << createdNodeCount << ",\"blockedSkips\":" << blockedSkipCount <<
+	   ",\"blockedNodes\":" << blockedNodeCount << ",\"peakOpenTrees\":" << peakOpenTreeCount <<
+	   ",\"peakBytes\":" << peakByteCount << ",\"evictedTrees\":" << evictedTreeCount <<
+	   ",\"conceptBytes\":" << conceptByteCount << ",\"learnedNogoods\":" << learnedNogoodCount <<
+	   ",\"nogoodClashes\":" << nogoodClashCount << ",\"successorChecks\":" << successorCheckCount <<
+	   ",\"successorCacheHits\":" << successorCacheHitCount << ",\"time\":{\"preprocessing\":" << preprocessingTime <<
+	   ",\"expansion\":" << expansionTime << ",\"modelExtraction\":" << modelExtractionTime << "},\"limitReached\":\"" <<
+	   getLimitName(limitReached) << "\"}";
+}
+
 Reasoner::Reasoner(const SymbolDictionary* pSymbolDictionary, const ConceptManager* pConceptManager) :
 mpSymbolDictionary(pSymbolDictionary),
-mpConceptManager(pConceptManager) { }
+mpConceptManager(pConceptManager),
+mpLogStream(&std::cout),
+mHasTboxLabel(false),
+mpActivityStore(&mActivityStore),
+mpClashCounter(&mClashCounter),
+mpNogoodStore(&mNogoodStore) { }
 
 Reasoner::~Reasoner() { }
 
 void Reasoner::setTboxConcepts(const std::vector<const Concept*>& tbox)
 {
 	mTbox = tbox;
+	mTboxOccurrences.clear();
+	OccurrenceHeuristic::countOccurrences(mTbox, mTboxOccurrences);
+	mpActivityStore->clear();
+	mpNogoodStore->clear();
+	compileTboxLabel();
+	if (!mHasTboxLabel)
+	{
+		for (size_t i = 0; i < mTbox.size(); ++i)
+			mTboxKeys.push_back(Node::getDependencyKey(mTbox[i]));
+		sort(mTboxKeys.begin(), mTboxKeys.end());
+	}
+	mpClashCounter->reset(mpSymbolDictionary->getSymbolCount());
+}
+
+// The deterministic part of filling a node with the Tbox is the same for
+// every node, so it is done once here
+void Reasoner::compileTboxLabel()
+{
+	Limits limits;
+	BranchingHeuristic heuristic;
+	Search search(&limits, &mTbox, false, &heuristic);
+	CompletionTree completionTree(this, 0, &search);
+	Node* pNode = completionTree.createNode(0);
+	list<const ExpandableConcept*> expandables;
+	for (size_t i = 0; i < mTbox.size(); ++i)
+		completionTree.addConcept(pNode, mTbox[i], &expandables, DependencySet());
+	mHasTboxLabel = completionTree.closeLabel(pNode, expandables);
+	mTboxKeys.clear();
+	mTboxExpandables.clear();
+	if (mHasTboxLabel)
+	{
+		mTboxKeys.assign(pNode->pLabel->getKeys().begin(), pNode->pLabel->getKeys().end());
+		for (list<const ExpandableConcept*>::const_iterator it = expandables.begin(); it != expandables.end(); ++it)
+			mTboxExpandables.push_back((*it)->pConcept);
+	}
+	deleteAll(expandables);
+}
+
+Reasoner::SuccessorCache::SuccessorCache()
+{
+	pthread_mutex_init(&mMutex, 0);
+}
+
+Reasoner::SuccessorCache::~SuccessorCache()
+{
+	pthread_mutex_destroy(&mMutex);
+}
+
+bool Reasoner::SuccessorCache::find(const std::vector<const Concept*>& concepts, Result& result) const
+{
+	pthread_mutex_lock(&mMutex);
+	map<vector<const Concept*>, Result>::const_iterator it = mResults.find(concepts);
+	bool found = it != mResults.end();
+	if (found)
+		result = it->second;
+	pthread_mutex_unlock(&mMutex);
+	return found;
+}
+
+void Reasoner::SuccessorCache::insert(const std::vector<const Concept*>& concepts, Result result)
+{
+	pthread_mutex_lock(&mMutex);
+	mResults[concepts] = result;
+	pthread_mutex_unlock(&mMutex);
 }
 
 void Reasoner::setTransitiveRole(Symbol role)
@@ -56,60 +246,243 @@ void Reasoner::setTransitiveRoles(const std::vector<Symbol>& transitiveRoles)
 		mTransitiveRolesSet.insert(transitiveRoles[i]);
 }
 
-bool Reasoner::isSatisfiable(const Concept* pConcept, Model* pModel, bool verbose) const
+void Reasoner::loadSnapshot(const Snapshot& snapshot)
+{
+	setTboxConcepts(snapshot.getTboxConcepts());
+	setTransitiveRoles(snapshot.getTransitiveRoles());
+}
+
+bool Reasoner::isSatisfiable(const Concept* pConcept, Model* pModel, bool verbose, Statistics* pStatistics) const
 {
 	vector<const Concept*> singleton;
 	singleton.push_back(pConcept);
-	return isSatisfiable(singleton, pModel);
+	return isSatisfiable(singleton, pModel, verbose, pStatistics);
+}
+
+bool Reasoner::isSatisfiable(const std::vector<const Concept*>& concepts, Model* pModel, bool verbose, Statistics* pStatistics) const
+{
+	return checkSatisfiability(concepts, Limits(), pModel, verbose, pStatistics) == RESULT_SATISFIABLE;
+}
+
+Reasoner::Result Reasoner::checkSatisfiability(const std::vector<const Concept*>& concepts, const Limits& limits, Model* pModel, bool verbose, Statistics* pStatistics) const
+{
+	return checkSatisfiability(mTbox, concepts, limits, pModel, verbose, pStatistics, 0);
+}
+
+Reasoner::Result Reasoner::explain(const std::vector<const Concept*>& concepts, const Limits& limits, Explanation& explanation, Statistics* pStatistics) const
+{
+	DependencySet sources;
+	Result result = checkSatisfiability(mTbox, concepts, limits, 0, false, pStatistics, &sources);
+	explanation.tboxAxioms.clear();
+	explanation.concepts.clear();
+	if (result != RESULT_UNSATISFIABLE)
+		return result;
+
+	// Drop each source in turn. Sources found necessary come first, and as
+	// every unsatisfiable subset contains them, narrowing the candidates to
+	// the sources of a check's clashes keeps them in place.
+	size_t i = 0;
+	while (i < sources.size())
+	{
+		DependencySet trial(sources);
+		trial.erase(trial.begin() + i);
+		vector<const Concept*> tbox, query;
+		for (size_t j = 0; j < trial.size(); ++j)
+			if (trial[j] < mTbox.size())
+				tbox.push_back(mTbox[trial[j]]);
+			else
+				query.push_back(concepts[trial[j] - mTbox.size()]);
+		// The sources of the trial are numbered by position in it
+		DependencySet used;
+		if (checkSatisfiability(tbox, query, limits, 0, false, 0, &used) == RESULT_UNSATISFIABLE)
+		{
+			sources.clear();
+			for (size_t j = 0; j < used.size(); ++j)
+				sources.push_back(trial[used[j]]);
+		} else
+			++i;
+	}
+
+	for (size_t i = 0; i < sources.size(); ++i)
+		if (sources[i] < mTbox.size())
+			explanation.tboxAxioms.push_back(sources[i]);
+		else
+			explanation.concepts.push_back(sources[i] - mTbox.size());
+	return result;
 }
 
-bool Reasoner::isSatisfiable(const std::vector<const Concept*>& concepts, Model* pModel, bool verbose) const
+Reasoner::Result Reasoner::checkSatisfiability(const std::vector<const Concept*>& tbox, const std::vector<const Concept*>& concepts, const Limits& limits, Model* pModel,
+	bool verbose, Statistics* pStatistics, DependencySet* pClashDependencies) const
 {
-	auto_ptr< Logger> apLogger(new Logger(std::cout, mpSymbolDictionary));
+	ScopedPointer<Logger> apLogger(new Logger(*mpLogStream, mpSymbolDictionary));
 	const Logger * pLogger = 0;
 	if (verbose)
 		pLogger = apLogger.get();
 
-	mCompletionTreeIDCounter = 1;
-	CompletionTree* pCompletionTree = new CompletionTree(this, pLogger);
+	ScopedPointer<BranchingHeuristic> apHeuristic(createHeuristic(limits, concepts));
+	apHeuristic->setSeed(limits.randomSeed);
+	Search search(&limits, &tbox, pClashDependencies, apHeuristic.get());
+	NogoodSet nogoods;
+	loadNogoods(search, nogoods);
+	// Where each concept comes from is not followed into the successor checks
+	SuccessorCache successorCache;
+	search.separateSuccessors = limits.separateSuccessors && !search.trackDependencies;
+	search.pSuccessorCache = &successorCache;
+	Statistics& statistics = search.statistics;
+	statistics.conceptByteCount = mpConceptManager->getByteCount();
+	unsigned long long phaseStartTime = search.startTime;
+	CompletionTree* pCompletionTree = new CompletionTree(this, pLogger, &search);
 	Node* pNode = pCompletionTree->createNode(0);
 
 	// Make a queue containing expandable concepts
-	if (!mTbox.empty() && pLogger)
+	if (!tbox.empty() && pLogger)
 		pLogger->log("Adding Tbox concepts into first node label.");
-	for (size_t i = 0; i < mTbox.size(); ++i)
-		if (pNode->addConcept(mTbox[i], pLogger, pCompletionTree))
-			pCompletionTree->addExpandableConcept(new ExpandableConcept(pNode, mTbox[i]));
+	pCompletionTree->addTboxConcepts(pNode, 0);
 	if (pLogger)
 		pLogger->log("Adding testing user concept into the first node label.");
 	for (size_t i = 0; i < concepts.size(); ++i)
-		if (pNode->addConcept(concepts[i], pLogger, pCompletionTree))
-			pCompletionTree->addExpandableConcept(new ExpandableConcept(pNode, concepts[i]));
+		pCompletionTree->addConcept(pNode, concepts[i], 0, search.trackDependencies ? DependencySet(1, tbox.size() + i) : DependencySet());
+
+	statistics.preprocessingTime = getMicroseconds() - phaseStartTime;
 
 	std::vector<CompletionTree*> completionTrees;
+	Result result = expandCompletionTrees(search, pCompletionTree, pLogger, completionTrees);
+	if (result == RESULT_SATISFIABLE)
+	{
+		// The concept is satisfiable as there is one complete completion tree alive.
+		phaseStartTime = getMicroseconds();
+		CompletionTree* pExampleCompletionTree = completionTrees.front();
+		statistics.blockedNodeCount = pExampleCompletionTree->getBlockedNodeCount();
+		if (pModel)
+		{
+			// Convert a completion tree into a model
+			pExampleCompletionTree->toModel(mpConceptManager, pModel);
+		}
+		pExampleCompletionTree = 0;
+		statistics.modelExtractionTime = getMicroseconds() - phaseStartTime;
+	}
+	keepHeuristic(limits, apHeuristic.get());
+	saveNogoods(search, nogoods);
+	if (pStatistics)
+		*pStatistics = statistics;
+	if (pClashDependencies)
+		*pClashDependencies = search.clashDependencies;
+	// Cleanup memory
+	for (vector<CompletionTree*>::iterator it = completionTrees.begin(); it != completionTrees.end(); ++it)
+		delete *it;
+
+	return result;
+}
+
+Reasoner::Result Reasoner::checkConsistency(const Abox& abox, const std::vector<size_t>& individuals, const std::vector< std::vector<const Concept*> >& concepts,
+	const Limits& limits, std::vector< std::vector<const Concept*> >* pLabels, Statistics* pStatistics) const
+{
+	vector<const Concept*> allConcepts;
+	for (size_t i = 0; i < concepts.size(); ++i)
+		allConcepts.insert(allConcepts.end(), concepts[i].begin(), concepts[i].end());
+	ScopedPointer<BranchingHeuristic> apHeuristic(createHeuristic(limits, allConcepts));
+	apHeuristic->setSeed(limits.randomSeed);
+	Search search(&limits, &mTbox, false, apHeuristic.get());
+	NogoodSet nogoods;
+	loadNogoods(search, nogoods);
+	Statistics& statistics = search.statistics;
+	statistics.conceptByteCount = mpConceptManager->getByteCount();
+	CompletionTree* pCompletionTree = new CompletionTree(this, 0, &search);
+
+	// One root node per individual, they get IDs 1 to individuals.size()
+	map<size_t, Node*> nodes;
+	for (size_t i = 0; i < individuals.size(); ++i)
+		nodes[individuals[i]] = pCompletionTree->createNode(0);
+	for (size_t i = 0; i < individuals.size(); ++i)
+	{
+		Node* pNode = nodes[individuals[i]];
+		pCompletionTree->addTboxConcepts(pNode, 0);
+		for (size_t j = 0; j < concepts[i].size(); ++j)
+			pCompletionTree->addConcept(pNode, concepts[i][j], 0, DependencySet());
+		const vector<Abox::RoleEdge>& successors = abox.getSuccessors(individuals[i]);
+		for (size_t j = 0; j < successors.size(); ++j)
+		{
+			map<size_t, Node*>::const_iterator it = nodes.find(successors[j].second);
+			if (it != nodes.end())
+				pCompletionTree->addEdge(pNode, successors[j].first, it->second);
+		}
+	}
+	statistics.preprocessingTime = getMicroseconds() - search.startTime;
+
+	std::vector<CompletionTree*> completionTrees;
+	Result result = expandCompletionTrees(search, pCompletionTree, 0, completionTrees);
+	if (result == RESULT_SATISFIABLE && pLabels)
+	{
+		unsigned long long phaseStartTime = getMicroseconds();
+		pLabels->assign(individuals.size(), vector<const Concept*>());
+		completionTrees.front()->getLabels(mpConceptManager, *pLabels);
+		statistics.modelExtractionTime = getMicroseconds() - phaseStartTime;
+	}
+	keepHeuristic(limits, apHeuristic.get());
+	saveNogoods(search, nogoods);
+	if (pStatistics)
+		*pStatistics = statistics;
+	for (vector<CompletionTree*>::iterator it = completionTrees.begin(); it != completionTrees.end(); ++it)
+		delete *it;
+
+	return result;
+}
+
+Reasoner::Result Reasoner::expandCompletionTrees(Search& search, CompletionTree* pCompletionTree, const Logger* pLogger, std::vector<CompletionTree*>& completionTrees) const
+{
+	const Limits& limits = *search.pLimits;
+	Statistics& statistics = search.statistics;
+	unsigned long long phaseStartTime = getMicroseconds();
 	completionTrees.push_back(pCompletionTree);
+	statistics.peakOpenTreeCount = max(statistics.peakOpenTreeCount, (size_t) 1);
 
 	// Then... go!	
 	bool foundCompleteCompletionTree = false;
+	bool interrupted = false;
 	size_t completeTreeCount = 0;
 	do
 	{
 		// Take the first available Completion Tree in the open list
 		pCompletionTree = completionTrees.front();
+		// Expanding it may duplicate it, make room for that first
+		if (limits.evictOnByteLimit)
+			while (completionTrees.size() > 1 && search.exceedsByteLimit(pCompletionTree->getByteCount()))
+				evictLeastPromisingTree(completionTrees, search);
 		if (pLogger)
 			pLogger->log("Completion Tree " + toString(pCompletionTree->getID()) + " chosen to be expanded.");
+		TRACE_EVENT(Trace::EVENT_TREE_CHOSEN, pCompletionTree->getID(), Trace::NONE, Trace::NONE);
 		// Let the completion tree expand
 		CompletionTree* pNewCompletionTree = 0;
 		ExpansionResult result = pCompletionTree->expand(pNewCompletionTree);
+		TRACE_EVENT(Trace::EVENT_TREE_RESULT, pCompletionTree->getID(), Trace::NONE, Trace::NONE, Trace::NONE, result);
 		// If the expansion algorithm created a new completion tree, add it to our active set
 		if (pNewCompletionTree)
 		{
 			completionTrees.push_back(pNewCompletionTree);
-			push_heap(completionTrees.begin(), completionTrees.end(), CompletionTree::ComparePtrs());
+			push_heap(completionTrees.begin(), completionTrees.end(), CompletionTree::ComparePtrs(limits.searchStrategy));
+			statistics.peakOpenTreeCount = max(statistics.peakOpenTreeCount, completionTrees.size());
 		}
 		switch (result)
 		{
 			case EXPANSION_RESULT_NOT_POSSIBLE:
+				// With separate successors the tree is a model once they all are satisfiable
+				if (search.separateSuccessors)
+				{
+					Result successorResult = checkSuccessors(search, pCompletionTree, pLogger);
+					if (successorResult == RESULT_UNKNOWN)
+					{
+						interrupted = true;
+						break;
+					}
+					if (successorResult == RESULT_UNSATISFIABLE)
+					{
+						if (pLogger)
+							pLogger->log(pCompletionTree, "a successor is unsatisfiable!");
+						removeTree(completionTrees, pCompletionTree, limits.searchStrategy);
+						++completeTreeCount;
+						break;
+					}
+				}
 				// Yes! We found a model as this completion tree cannot be further expanded.
 				if (pLogger)
 					pLogger->log(pCompletionTree, "expansion not be possible, model found!");
@@ -128,67 +501,378 @@ bool Reasoner::isSatisfiable(const std::vector<const Concept*>& concepts, Model*
 				// trees.
 				if (pLogger)
 					pLogger->log(pCompletionTree, "clash found!");
-				delete pCompletionTree;
-				pop_heap(completionTrees.begin(), completionTrees.end(), CompletionTree::ComparePtrs());
-				completionTrees.pop_back();
+				++statistics.clashCount;
+				removeTree(completionTrees, pCompletionTree, limits.searchStrategy);
 				++completeTreeCount;
 				break;
+
+			case EXPANSION_RESULT_INTERRUPTED:
+				if (pLogger)
+					pLogger->log(pCompletionTree, string("search stopped, ") + getLimitName(statistics.limitReached) + " limit reached.");
+				interrupted = true;
+				break;
 		}
-	} while (!completionTrees.empty() && !foundCompleteCompletionTree);
+		// Trees and bytes only grow between expansions
+		if (!interrupted && !foundCompleteCompletionTree && search.isInterrupted())
+			interrupted = true;
+	} while (!completionTrees.empty() && !foundCompleteCompletionTree && !interrupted);
 
-	cout << "Number of complete trees: " + toString(completeTreeCount) + ". Number of incomplete trees: " + toString(completionTrees.size()) +
-	   ". (total " + toString(completeTreeCount + completionTrees.size()) + ").\n";
+	statistics.completeTreeCount += completeTreeCount;
+	statistics.incompleteTreeCount = completionTrees.size();
+	statistics.expansionTime = getMicroseconds() - phaseStartTime;
 
 	// Now check results
-	if (completionTrees.empty())
+	if (interrupted && !completionTrees.empty())
+	{
+		// Neither a model nor a clash in every tree, the answer is unknown.
+		return RESULT_UNKNOWN;
+	} else if (completionTrees.empty() && statistics.evictedTreeCount)
+	{
+		// Every tree left is closed but the evicted ones might have led to a model.
+		statistics.limitReached = LIMIT_BYTES;
+		return RESULT_UNKNOWN;
+	} else if (completionTrees.empty())
 	{
 		// All completion trees are closed, the concept is not satisfiable.
-		return false;
+		statistics.limitReached = LIMIT_NONE;
+		return RESULT_UNSATISFIABLE;
+	}
+	return RESULT_SATISFIABLE;
+}
+
+Reasoner::DependencySet Reasoner::merge(const DependencySet& dependencies1, const DependencySet& dependencies2)
+{
+	DependencySet result;
+	result.reserve(dependencies1.size() + dependencies2.size());
+	set_union(dependencies1.begin(), dependencies1.end(), dependencies2.begin(), dependencies2.end(), back_inserter(result));
+	return result;
+}
+
+// The front tree is the one about to be expanded, it is never evicted
+void Reasoner::evictLeastPromisingTree(std::vector<CompletionTree*>& completionTrees, Search& search)
+{
+	CompletionTree::ComparePtrs compare(search.pLimits->searchStrategy);
+	size_t worst = 1;
+	for (size_t i = 2; i < completionTrees.size(); ++i)
+		if (compare(completionTrees[i], completionTrees[worst]))
+			worst = i;
+	delete completionTrees[worst];
+	completionTrees.erase(completionTrees.begin() + worst);
+	make_heap(completionTrees.begin(), completionTrees.end(), compare);
+	++search.statistics.evictedTreeCount;
+}
+
+void Reasoner::removeTree(std::vector<CompletionTree*>& completionTrees, CompletionTree* pCompletionTree, SearchStrategy searchStrategy)
+{
+	// The duplicate pushed by the same expansion may have taken the front
+	if (completionTrees.front() == pCompletionTree)
+	{
+		pop_heap(completionTrees.begin(), completionTrees.end(), CompletionTree::ComparePtrs(searchStrategy));
+		completionTrees.pop_back();
 	} else
 	{
-		// The concept is satisfiable as there is one complete completion tree alive.
-		if (pModel)
+		completionTrees.erase(find(completionTrees.begin(), completionTrees.end(), pCompletionTree));
+		make_heap(completionTrees.begin(), completionTrees.end(), CompletionTree::ComparePtrs(searchStrategy));
+	}
+	delete pCompletionTree;
+}
+
+// Without inverse roles a successor depends on its node through the
+// restrictions pushed down to it only, so each one is a satisfiability check
+// of its own, nested in the one of the node. Only the path of nodes being
+// checked stays in memory, successors held by a node of the path are blocked.
+Reasoner::Result Reasoner::checkSuccessors(Search& search, const CompletionTree* pCompletionTree, const Logger* pLogger) const
+{
+	vector< vector<const Concept*> > successors;
+	collectSuccessors(pCompletionTree->getFirstNode(), successors);
+	SuccessorPath path(pCompletionTree->getFirstNode(), search.pPath);
+	if (!search.pPath && search.pLimits->pThreadPool && !pLogger && successors.size() > 1)
+	{
+		SuccessorJob job(this, search, path, successors);
+		search.pLimits->pThreadPool->run(job, successors.size());
+		return job.getResult(search);
+	}
+	for (size_t i = 0; i < successors.size(); ++i)
+	{
+		Result result = checkSuccessor(search, path, successors[i], pLogger);
+		if (result != RESULT_SATISFIABLE)
+			return result;
+	}
+	return RESULT_SATISFIABLE;
+}
+
+Reasoner::Result Reasoner::checkSuccessor(Search& search, const SuccessorPath& path, const std::vector<const Concept*>& concepts, const Logger* pLogger) const
+{
+	// A node of the path that has all of the concepts can stand for the successor
+	for (const SuccessorPath* pPath = &path; pPath; pPath = pPath->pParent)
+	{
+		size_t i = 0;
+		while (i < concepts.size() && pPath->pNode->contains(concepts[i]))
+			++i;
+		if (i == concepts.size())
 		{
-			// Convert a completion tree into a model
-			CompletionTree* pExampleCompletionTree = completionTrees.front();
-			pExampleCompletionTree->toModel(mpConceptManager, pModel);
-			pExampleCompletionTree = 0;
+			search.blockingDepth = min(search.blockingDepth, pPath->depth);
+			return RESULT_SATISFIABLE;
 		}
-		// Cleanup memory
-		for (vector<CompletionTree*>::iterator it = completionTrees.begin(); it != completionTrees.end(); ++it)
-			delete *it;
+	}
+	Result result;
+	if (search.pSuccessorCache->find(concepts, result))
+	{
+		++search.statistics.successorCacheHitCount;
+		return result;
+	}
 
-		return true;
+	++search.statistics.successorCheckCount;
+	if (pLogger)
+		pLogger->log("Checking a successor of depth " + toString(path.depth + 1) + " on its own.");
+	const SuccessorPath* pOuterPath = search.pPath;
+	size_t outerBlockingDepth = search.blockingDepth;
+	search.pPath = &path;
+	search.blockingDepth = (size_t) -1;
+	CompletionTree* pCompletionTree = new CompletionTree(this, pLogger, &search);
+	Node* pNode = pCompletionTree->createNode(0);
+	pCompletionTree->addTboxConcepts(pNode, 0);
+	for (size_t i = 0; i < concepts.size(); ++i)
+		pCompletionTree->addConcept(pNode, concepts[i], 0, DependencySet());
+	vector<CompletionTree*> completionTrees;
+	result = expandCompletionTrees(search, pCompletionTree, pLogger, completionTrees);
+	deleteAll(completionTrees);
+	search.pPath = pOuterPath;
+
+	// A satisfiable answer that a node above the successor stood for holds
+	// only as long as that node does
+	if (result == RESULT_UNSATISFIABLE || (result == RESULT_SATISFIABLE && search.blockingDepth > path.depth))
+		search.pSuccessorCache->insert(concepts, result);
+	search.blockingDepth = min(outerBlockingDepth, search.blockingDepth);
+	return result;
+}
+
+// The concepts of each successor the existential restrictions of the node
+// need, without repetitions
+void Reasoner::collectSuccessors(const Node* pNode, std::vector< std::vector<const Concept*> >& successors) const
+{
+	// The keys of the restrictions are their type and address
+	const LabelTable::Keys& keys = pNode->pLabel->getKeys();
+	Node::UniversalRestrictionMap restrictions;
+	for (LabelTable::Keys::const_iterator it = keys.begin(); it != keys.end(); ++it)
+		if (it->first == Concept::TYPE_UNIVERSAL_RESTRICTION)
+			restrictions.insert(Node::UniversalRestrictionMap::value_type(((const Concept*) it->second)->getRole(), (const Concept*) it->second));
+	set< vector<const Concept*> > collected;
+	for (LabelTable::Keys::const_iterator it = keys.begin(); it != keys.end(); ++it)
+	{
+		if (it->first != Concept::TYPE_EXISTENTIAL_RESTRICTION)
+			continue;
+		const Concept* pConcept = (const Concept*) it->second;
+		vector<const Concept*> concepts(1, pConcept->getQualificationConcept());
+		bool transitive = isTransitive(pConcept->getRole());
+		Node::UniversalRestrictionRange range = restrictions.equal_range(pConcept->getRole());
+		for (Node::UniversalRestrictionIterator it2 = range.first; it2 != range.second; ++it2)
+		{
+			concepts.push_back(it2->second->getQualificationConcept());
+			if (transitive)
+				concepts.push_back(it2->second);
+		}
+		sort(concepts.begin(), concepts.end());
+		concepts.erase(unique(concepts.begin(), concepts.end()), concepts.end());
+		if (collected.insert(concepts).second)
+			successors.push_back(concepts);
 	}
+}
 
+const char* Reasoner::getLimitName(Limit limit)
+{
+	switch (limit)
+	{
+		case LIMIT_NONE:
+			return "none";
+		case LIMIT_TIME:
+			return "time";
+		case LIMIT_EXPANSIONS:
+			return "expansions";
+		case LIMIT_TREES:
+			return "trees";
+		case LIMIT_BYTES:
+			return "bytes";
+		case LIMIT_CANCELLED:
+			return "cancellation";
+	}
+	return "unknown";
 }
-////////////////////////////////////////////////////////////////////////////////
 
-bool Reasoner::Node::addConcept(const Concept * pConcept, const Logger* pLogger, const CompletionTree * pLoggingCT)
+void Reasoner::Limits::parse(const std::string& text)
 {
-	// If I'm trying to add TOP, skip it and say "we already have it"
-	if (pConcept == Concept::getTopConcept())
-		return false;
-	bool result;
-	switch (pConcept->getType())
+	// A comma separated list of name=value, times are in milliseconds
+	istringstream source(text);
+	string item;
+	while (getline(source, item, ','))
 	{
-		case Concept::TYPE_POSITIVE_ATOMIC:
-			result = positiveAtomicConcepts.insert(pConcept->getSymbol()).second;
-			break;
-		case Concept::TYPE_NEGATIVE_ATOMIC:
-			result = negativeAtomicConcepts.insert(pConcept->getSymbol()).second;
-			break;
+		if (item.empty())
+			continue;
+		size_t equals = item.find('=');
+		if (item.substr(0, equals) == "heuristic")
+		{
+			heuristic = BranchingHeuristic::parseKind(item.substr(equals + 1));
+			continue;
+		}
+		if (item.substr(0, equals) == "search")
+		{
+			if (item.substr(equals + 1) == "best")
+				searchStrategy = SEARCH_BEST_FIRST;
+			else if (item.substr(equals + 1) == "depth")
+				searchStrategy = SEARCH_DEPTH_FIRST;
+			else
+				throw Exception("Invalid limit \"" + item + "\".");
+			continue;
+		}
+		if (item.substr(0, equals) == "activities")
+		{
+			// Whether the activities of the previous check are a starting point
+			if (item.substr(equals + 1) == "keep")
+				keepActivities = true;
+			else if (item.substr(equals + 1) == "reset")
+				keepActivities = false;
+			else
+				throw Exception("Invalid limit \"" + item + "\".");
+			continue;
+		}
+		if (item.substr(0, equals) == "successors")
+		{
+			// Whether the successors are checked on their own or in the tree
+			if (item.substr(equals + 1) == "separate")
+				separateSuccessors = true;
+			else if (item.substr(equals + 1) == "tree")
+				separateSuccessors = false;
+			else
+				throw Exception("Invalid limit \"" + item + "\".");
+			continue;
+		}
+		if (item.substr(0, equals) == "cache")
+		{
+			if (equals == string::npos || equals + 1 == item.size())
+				throw Exception("Invalid limit \"" + item + "\".");
+			cacheFileName = item.substr(equals + 1);
+			continue;
+		}
+		if (item.substr(0, equals) == "overflow")
+		{
+			// What to do when the bytes limit is reached
+			if (item.substr(equals + 1) == "evict")
+				evictOnByteLimit = true;
+			else if (item.substr(equals + 1) == "fail")
+				evictOnByteLimit = false;
+			else
+				throw Exception("Invalid limit \"" + item + "\".");
+			continue;
+		}
+		istringstream valueStream(equals == string::npos ? "" : item.substr(equals + 1));
+		unsigned long long value;
+		if (!(valueStream >> value) || !valueStream.eof())
+			throw Exception("Invalid limit \"" + item + "\".");
+		string name = item.substr(0, equals);
+		if (name == "time")
+			maxTime = value * 1000;
+		else if (name == "expansions")
+			maxExpansionCount = value;
+		else if (name == "trees")
+			maxTreeCount = value;
+		else if (name == "bytes")
+			maxByteCount = value;
+		else if (name == "nogoods")
+			maxNogoodCount = value;
+		else if (name == "seed")
+			randomSeed = value;
+		else
+			throw Exception("Unknown limit \"" + name + "\".");
+	}
+}
 
+BranchingHeuristic* Reasoner::createHeuristic(const Limits& limits, const std::vector<const Concept*>& concepts) const
+{
+	switch (limits.heuristic)
+	{
+		case BranchingHeuristic::KIND_OCCURRENCES:
+			return new OccurrenceHeuristic(mTboxOccurrences, concepts);
+		case BranchingHeuristic::KIND_ACTIVITIES:
+		{
+			ActivityHeuristic::Activities activities;
+			if (limits.keepActivities)
+				mpActivityStore->load(activities);
+			return new ActivityHeuristic(activities);
+		}
 		default:
-			result = complexConcepts.insert(pConcept).second;
-			break;
+			return new BranchingHeuristic();
+	}
+}
+
+// The symbols a query defined may name something else in the next one, so
+// their activities stay with the check
+void Reasoner::keepHeuristic(const Limits& limits, const BranchingHeuristic* pHeuristic) const
+{
+	if (limits.heuristic != BranchingHeuristic::KIND_ACTIVITIES || !limits.keepActivities)
+		return;
+	ActivityHeuristic::Activities activities = static_cast<const ActivityHeuristic*> (pHeuristic)->getActivities();
+	while (!activities.scores.empty() && mpConceptManager->isReclaimable((Symbol) (activities.scores.size() - 1)))
+		activities.scores.pop_back();
+	mpActivityStore->save(activities);
+}
+
+// Nogoods hold with the Tbox they were learned with only, and a tree they
+// close depends on all of it, which explanations cannot afford
+void Reasoner::loadNogoods(Search& search, NogoodSet& nogoods) const
+{
+	if (!search.pLimits->maxNogoodCount || search.pTbox != &mTbox || search.trackDependencies)
+		return;
+	mpNogoodStore->load(nogoods, search.pLimits->maxNogoodCount);
+	search.pNogoods = &nogoods;
+}
+
+// The concepts and symbols of a query may be deleted once it is answered, and
+// a new one take the same address or symbol, so the nogoods holding them stay
+// with the check
+void Reasoner::saveNogoods(const Search& search, NogoodSet& nogoods) const
+{
+	if (!search.pNogoods)
+		return;
+	vector<NogoodSet::Key> keys;
+	nogoods.getKeys(keys);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		bool isAtomic = keys[i].first == Concept::TYPE_POSITIVE_ATOMIC || keys[i].first == Concept::TYPE_NEGATIVE_ATOMIC;
+		if (isAtomic ? mpConceptManager->isReclaimable((Symbol) keys[i].second) :
+			mpConceptManager->isReclaimable((const Concept*) keys[i].second))
+			nogoods.remove(keys[i]);
 	}
-	if (result)
-		++totalConceptCount;
+	mpNogoodStore->save(nogoods);
+}
+
+bool Reasoner::Search::isInterrupted(size_t reservedByteCount)
+{
+	// The clock is read every few checks only, the rest are plain comparisons
+	if (pLimits->pCancellationToken && pLimits->pCancellationToken->isCancelled())
+		statistics.limitReached = LIMIT_CANCELLED;
+	else if (pLimits->maxExpansionCount && statistics.expansionCount >= pLimits->maxExpansionCount)
+		statistics.limitReached = LIMIT_EXPANSIONS;
+	else if (pLimits->maxTreeCount && statistics.createdTreeCount >= pLimits->maxTreeCount)
+		statistics.limitReached = LIMIT_TREES;
+	else if (exceedsByteLimit(reservedByteCount))
+		statistics.limitReached = LIMIT_BYTES;
+	else if (pLimits->maxTime && (++checkCount & 63) == 0 && getMicroseconds() - startTime >= pLimits->maxTime)
+		statistics.limitReached = LIMIT_TIME;
+	return statistics.limitReached != LIMIT_NONE;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+bool Reasoner::Node::addConcept(LabelTable& labels, const Concept * pConcept, const Logger* pLogger, const CompletionTree * pLoggingCT)
+{
+	// If I'm trying to add TOP, skip it and say "we already have it"
+	if (pConcept->isTop())
+		return false;
+	bool result = labels.add(pLabel, getDependencyKey(pConcept));
 	if (result && pLogger)
 		pLogger->log(pLoggingCT, this, pConcept, "added to this node.");
 	else if (!result && pLogger)
 		pLogger->log(pLoggingCT, this, pConcept, "skipped as already present in this node.");
+	TRACE_EVENT(result ? Trace::EVENT_CONCEPT_ADDED : Trace::EVENT_CONCEPT_SKIPPED, pLoggingCT->getID(), ID, pConcept->getID());
 
 	// If we did add a new concept to this node, we must chack that whether the blocking
 	// node contains it anyway
@@ -198,69 +882,115 @@ bool Reasoner::Node::addConcept(const Concept * pConcept, const Logger* pLogger,
 		{
 			if (pLogger)
 				pLogger->log(pLoggingCT, this, pConcept, " not in present in blocking node (node " + toString(pBlockingNode->ID) + ") label therefore this node can be no more blocked by it.");
-			// Our blocking node does NOT contain the newly added concept thus we
-			// must look for another node whose set of concepts contains this ones'
-			pBlockingNode = pBlockingNode->pParentNode;
-			while (pBlockingNode != 0)
-			{
-				if (pBlockingNode->containsConceptsOf(this))
-					break; // Found!
-				pBlockingNode = pBlockingNode->pParentNode;
-			}
-			// Here if pBlockingNode != 0 we found one and this node is still blocked
-			// else this node will now be free.
-			if (pLogger)
-			{
-				if (pBlockingNode == 0)
-					pLogger->log(pLoggingCT, this, "no ancestor node can block this node. Node is now free.");
-				else
-				{
-					pLogger->log(pLoggingCT, this, "is now blocked by node" + toString(pBlockingNode->ID) + ".");
-				}
-			}
+			findBlockingNode(labels, pLogger, pLoggingCT);
 		}
 	}
 	return result;
 }
 
+void Reasoner::Node::stampLabel(LabelTable& labels, const LabelTable::Label* pTboxLabel, const Logger* pLogger, const CompletionTree* pLoggingCT)
+{
+	labels.acquire(pTboxLabel);
+	labels.release(pLabel);
+	pLabel = pTboxLabel;
+	if (pLogger)
+		pLogger->log(pLoggingCT, this, "label filled with the closure of the Tbox.");
+	if (pBlockingNode && !pBlockingNode->containsConceptsOf(labels, this))
+	{
+		if (pLogger)
+			pLogger->log(pLoggingCT, this, "Tbox closure not present in blocking node (node " + toString(pBlockingNode->ID) + ") label therefore this node can be no more blocked by it.");
+		findBlockingNode(labels, pLogger, pLoggingCT);
+	}
+}
+
+void Reasoner::Node::findBlockingNode(LabelTable& labels, const Logger* pLogger, const CompletionTree* pLoggingCT)
+{
+	// Our blocking node does NOT contain the label of this one thus we must
+	// look for another node whose set of concepts contains this ones'
+	pBlockingNode = pBlockingNode->pParentNode;
+	while (pBlockingNode != 0)
+	{
+		if (pBlockingNode->containsConceptsOf(labels, this))
+			break; // Found!
+		pBlockingNode = pBlockingNode->pParentNode;
+	}
+	// Here if pBlockingNode != 0 we found one and this node is still blocked
+	// else this node will now be free.
+	if (pBlockingNode == 0)
+		TRACE_EVENT(Trace::EVENT_NODE_UNBLOCKED, pLoggingCT->getID(), ID, Trace::NONE);
+	else
+		TRACE_EVENT(Trace::EVENT_NODE_BLOCKED, pLoggingCT->getID(), ID, Trace::NONE, pBlockingNode->ID);
+	if (pLogger)
+	{
+		if (pBlockingNode == 0)
+			pLogger->log(pLoggingCT, this, "no ancestor node can block this node. Node is now free.");
+		else
+		{
+			pLogger->log(pLoggingCT, this, "is now blocked by node" + toString(pBlockingNode->ID) + ".");
+		}
+	}
+}
+
 void Reasoner::Node::addRoleAccessibility(Symbol role, Node* pToOtherNode)
 {
 	// NOTE: This implementation assumes that a role accessibility is made always
-	// to new nodes.
+	// to new nodes, or between the nodes of Abox individuals before expanding.
 	roleAccessibilities.insert(SymbolNodePair(role, pToOtherNode));
 }
 
 bool Reasoner::Node::contains(const Concept * pConcept) const
 {
-	if (pConcept == Concept::getTopConcept())
+	if (pConcept->isTop())
 		return true;
-	else if (pConcept == Concept::getBottomConcept())
+	else if (pConcept->isBottom())
 		return false;
-	switch (pConcept->getType())
+	return pLabel->contains(getDependencyKey(pConcept));
+}
+
+bool Reasoner::Node::clashesWith(const Concept * pConcept) const
+{
+	if (pConcept->isBottom())
+		return true;
+	return pConcept->isAtomic() && pLabel->contains(getDependencyKey(pConcept, true));
+}
+
+// Literals are keyed by symbol, the other concepts by address
+const Concept* Reasoner::CompletionTree::getKeyConcept(const ConceptManager* pConceptManager, const Node::DependencyKey& key)
+{
+	switch (key.first)
 	{
 		case Concept::TYPE_POSITIVE_ATOMIC:
-			return positiveAtomicConcepts.find(pConcept->getSymbol()) != positiveAtomicConcepts.end();
+			return pConceptManager->getAtomicConcept(true, key.second);
 		case Concept::TYPE_NEGATIVE_ATOMIC:
-			return negativeAtomicConcepts.find(pConcept->getSymbol()) != negativeAtomicConcepts.end();
-
+			return pConceptManager->getAtomicConcept(false, key.second);
 		default:
-			return complexConcepts.find(pConcept) != complexConcepts.end();
+			return (const Concept*) key.second;
 	}
 }
 
-bool Reasoner::Node::containsConceptsOf(const Node* pNode) const
+bool Reasoner::Node::containsKey(const DependencyKey& key) const
 {
-	for (std::set<Symbol>::const_iterator it = pNode->positiveAtomicConcepts.begin(); it != pNode->positiveAtomicConcepts.end(); ++it)
-		if (positiveAtomicConcepts.find(*it) == positiveAtomicConcepts.end())
-			return false;
-	for (std::set<Symbol>::const_iterator it = pNode->negativeAtomicConcepts.begin(); it != pNode->negativeAtomicConcepts.end(); ++it)
-		if (negativeAtomicConcepts.find(*it) == negativeAtomicConcepts.end())
-			return false;
-	for (std::set<const Concept*>::const_iterator it = pNode->complexConcepts.begin(); it != pNode->complexConcepts.end(); ++it)
-		if (complexConcepts.find(*it) == complexConcepts.end())
+	return pLabel->contains(key);
+}
 
-			return false;
-	return true;
+// Literals are keyed by symbol so that the complement of one is found too
+Reasoner::Node::DependencyKey Reasoner::Node::getDependencyKey(const Concept* pConcept, bool complement)
+{
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_POSITIVE_ATOMIC:
+			return DependencyKey(complement ? Concept::TYPE_NEGATIVE_ATOMIC : Concept::TYPE_POSITIVE_ATOMIC, pConcept->getSymbol());
+		case Concept::TYPE_NEGATIVE_ATOMIC:
+			return DependencyKey(complement ? Concept::TYPE_POSITIVE_ATOMIC : Concept::TYPE_NEGATIVE_ATOMIC, pConcept->getSymbol());
+		default:
+			return DependencyKey(pConcept->getType(), (size_t) pConcept);
+	}
+}
+
+// Labels are interned, so the test is remembered by the table
+bool Reasoner::Node::containsConceptsOf(LabelTable& labels, const Node* pNode) const
+{
+	return labels.isSubset(pNode->pLabel, pLabel);
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -275,16 +1005,7 @@ bool Reasoner::ExpandableConcept::Compare::operator ()(const ExpandableConcept*
 		return false;
 
 	// Ok pEC2 is not nondeterministic, let's check the concepts
-	// Prefer atomic concepts
-	if (pEC1->pConcept->isAtomic() || pEC2->pConcept->isAtomic())
-	{
-		if (pEC1->pConcept->isAtomic())
-			return false;
-		else
-			return true;
-	}
-
-	// Ok none of them is atomic, we'll prefer conjunctions then
+	// Atomic concepts are never queued, we'll prefer conjunctions first
 	if (pEC1->pConcept->getType() == Concept::TYPE_CONJUNCTION || pEC2->pConcept->getType() == Concept::TYPE_CONJUNCTION)
 	{
 		if (pEC1->pConcept->getType() == Concept::TYPE_CONJUNCTION)
@@ -312,7 +1033,13 @@ bool Reasoner::ExpandableConcept::Compare::operator ()(const ExpandableConcept*
 			return true;
 	}
 
-	// No way, they're both conjunctions... just say anything (for now).	
+	// They're both disjunctions, the heuristic decides if it can
+	double score1 = mpHeuristic->getScore(pEC1->pConcept);
+	double score2 = mpHeuristic->getScore(pEC2->pConcept);
+	if (score1 != score2)
+		return score1 < score2;
+	if (mpHeuristic->getSeed() && pEC1->pConcept != pEC2->pConcept)
+		return mpHeuristic->getTieBreaker(pEC1->pConcept) < mpHeuristic->getTieBreaker(pEC2->pConcept);
 	return true;
 }
 
@@ -321,10 +1048,14 @@ bool Reasoner::ExpandableConcept::Compare::operator ()(const ExpandableConcept*
 bool Reasoner::CompletionTree::ComparePtrs::operator ()(const CompletionTree* pCT1, const CompletionTree* pCT2) const
 {
 	//	// True means CT1 is worse than CT2
+	if (mSearchStrategy == SEARCH_DEPTH_FIRST && pCT1->mChoiceCount != pCT2->mChoiceCount)
+		return pCT1->mChoiceCount < pCT2->mChoiceCount;
 	// Compare score, higher is worse
-	if (pCT1->mScore < pCT2->mScore)
+	size_t score1 = pCT1->mScore + pCT1->mBranchPenalty;
+	size_t score2 = pCT2->mScore + pCT2->mBranchPenalty;
+	if (score1 < score2)
 		return false;
-	else if (pCT1->mScore > pCT2->mScore)
+	else if (score1 > score2)
 		return true;
 	else
 	{
@@ -335,43 +1066,300 @@ bool Reasoner::CompletionTree::ComparePtrs::operator ()(const CompletionTree* pC
 	}
 }
 
-Reasoner::CompletionTree::CompletionTree(const Reasoner* pReasoner, const Logger* pLogger) :
-mpReasoner(pReasoner), mID(pReasoner->mCompletionTreeIDCounter++), mpLogger(pLogger)
+Reasoner::CompletionTree::CompletionTree(const Reasoner* pReasoner, const Logger* pLogger, Search* pSearch) :
+mpReasoner(pReasoner), mID(pSearch->completionTreeIDCounter++), mpLogger(pLogger), mpSearch(pSearch), mHeuristicVersion(pSearch->pHeuristic->getVersion()), mScore(0),
+mBranchPenalty(0), mChoiceCount(0), mByteCount(0), mClash(false)
 {
+	++mpSearch->statistics.createdTreeCount;
+	allocate(sizeof (CompletionTree));
 	if (mpLogger)
 		mpLogger->log("Completion Tree " + toString(mID) + " created.");
+	TRACE_EVENT(Trace::EVENT_TREE_CREATED, mID, Trace::NONE, Trace::NONE);
 }
 
 Reasoner::CompletionTree::~CompletionTree()
 {
-
+	for (NodeSet::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it)
+		mpSearch->labels.release((*it)->pLabel);
 	deleteAll(mNodes);
 	deleteAll(mExpandableConceptQueue);
+	release(mByteCount);
 }
 
 size_t Reasoner::CompletionTree::getConceptCount() const
 {
 	size_t c = 0;
 	for (std::set<Node*>::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it)
-		c += (*it)->totalConceptCount;
+		c += (*it)->getConceptCount();
+	return c;
+}
+
+size_t Reasoner::CompletionTree::getBlockedNodeCount() const
+{
+	size_t c = 0;
+	for (std::set<Node*>::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it)
+		if ((*it)->isBlocked())
+			++c;
 	return c;
 }
 
+// mByteCount is kept up to date as things are allocated, this adds it all up
+size_t Reasoner::CompletionTree::measureByteCount() const
+{
+	size_t byteCount = sizeof (CompletionTree) + mExpandableConceptQueue.size() * EXPANDABLE_CONCEPT_BYTES;
+	for (std::set<Node*>::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it)
+		byteCount += NODE_BYTES + (*it)->getConceptCount() * LABEL_ENTRY_BYTES +
+		((*it)->roleAccessibilities.size() + (*it)->universalRestrictions.size()) * EDGE_BYTES;
+	return byteCount;
+}
+
 Reasoner::Node* Reasoner::CompletionTree::createNode(Node* pParent)
 {
-	Node* pNode = new Node(mNodes.size() + 1, pParent);
+	Node* pNode = new Node(mNodes.size() + 1, pParent, mpSearch->labels.getEmpty());
 	mNodes.insert(pNode);
+	allocate(NODE_BYTES);
+	++mpSearch->statistics.createdNodeCount;
 
 	if (mpLogger)
 		mpLogger->log("Node " + toString(mID) + "." + toString(pNode->ID) + " created.");
+	TRACE_EVENT(Trace::EVENT_NODE_CREATED, mID, pNode->ID, Trace::NONE, pParent ? pParent->ID : (size_t) Trace::NONE);
 
 	return pNode;
 }
 
+const Reasoner::Node* Reasoner::CompletionTree::getFirstNode() const
+{
+	for (NodeSet::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it)
+		if ((*it)->ID == 1)
+			return *it;
+	return 0;
+}
+
+void Reasoner::CompletionTree::addEdge(Node* pNode, Symbol role, Node* pSuccessor)
+{
+	pNode->addRoleAccessibility(role, pSuccessor);
+	allocate(EDGE_BYTES);
+}
+
+Reasoner::DependencySet Reasoner::CompletionTree::getDependencies(const Node* pNode, const Concept* pConcept, bool complement) const
+{
+	if (!mpSearch->trackDependencies)
+		return DependencySet();
+	map<Node::DependencyKey, DependencySet>::const_iterator it = pNode->dependencies.find(Node::getDependencyKey(pConcept, complement));
+	return it == pNode->dependencies.end() ? DependencySet() : it->second;
+}
+
+bool Reasoner::CompletionTree::addConcept(Node* pNode, const Concept* pConcept, std::list<const ExpandableConcept*>* pInsertionList, const DependencySet& dependencies,
+	const Node::Premises& premises)
+{
+	// Clashes are found as soon as bottom or the complement of a literal gets
+	// into a label, so the tree is closed before any more work is done on it.
+	if (pNode->clashesWith(pConcept))
+	{
+		if (mpLogger)
+			mpLogger->log(this, pNode, pConcept, "clashes with this node's label.");
+		TRACE_EVENT(Trace::EVENT_CLASH, mID, pNode->ID, pConcept->getID());
+		mClash = true;
+		mpSearch->pHeuristic->notifyClash(pConcept);
+		if (pConcept->isAtomic())
+			mpReasoner->mpClashCounter->count(pConcept->getSymbol());
+		if (mpSearch->trackDependencies)
+			mpSearch->clashDependencies = merge(mpSearch->clashDependencies, merge(dependencies, getDependencies(pNode, pConcept, true)));
+		if (mpSearch->pNogoods)
+		{
+			// Bottom clashes on its own, with whatever it came from
+			Node::Premises reasons(premises);
+			if (!pConcept->isBottom())
+			{
+				if (reasons.empty())
+					reasons.push_back(Node::getDependencyKey(pConcept));
+				reasons.push_back(Node::getDependencyKey(pConcept, true));
+			}
+			learnNogood(pNode, reasons);
+		}
+		return false;
+	}
+	if (!pNode->addConcept(mpSearch->labels, pConcept, mpLogger, this))
+		return false;
+	allocate(LABEL_ENTRY_BYTES);
+	Node::DependencyKey key = Node::getDependencyKey(pConcept);
+	if (mpSearch->trackDependencies)
+		pNode->dependencies[key] = dependencies;
+	if (mpSearch->pNogoods)
+	{
+		if (!premises.empty())
+			pNode->premises[key] = premises;
+		if (completesNogood(pNode, key))
+		{
+			if (mpLogger)
+				mpLogger->log(this, pNode, pConcept, "completes a nogood in this node's label.");
+			TRACE_EVENT(Trace::EVENT_CLASH, mID, pNode->ID, pConcept->getID());
+			mClash = true;
+			++mpSearch->statistics.nogoodClashCount;
+		}
+	}
+	// Literals need no expansion, only complex concepts are queued
+	if (isQueued(pConcept))
+	{
+		allocate(EXPANDABLE_CONCEPT_BYTES);
+		if (pInsertionList)
+			pInsertionList->push_back(new ExpandableConcept(pNode, pConcept));
+		else
+			addExpandableConcept(new ExpandableConcept(pNode, pConcept));
+	}
+	return true;
+}
+
+void Reasoner::CompletionTree::addTboxConcepts(Node* pNode, std::list<const ExpandableConcept*>* pInsertionList)
+{
+	// The closure is only known for the reasoner's Tbox and says nothing of
+	// where each concept comes from
+	const vector<const Concept*>& tbox = *mpSearch->pTbox;
+	if (mpSearch->pTbox != &mpReasoner->mTbox || mpSearch->trackDependencies || !mpReasoner->mHasTboxLabel)
+	{
+		for (size_t i = 0; i < tbox.size(); ++i)
+			addConcept(pNode, tbox[i], pInsertionList, mpSearch->trackDependencies ? merge(DependencySet(1, i), pNode->creationDependencies) : DependencySet());
+		return;
+	}
+	if (!mpSearch->pTboxLabel)
+		mpSearch->pTboxLabel = mpSearch->labels.intern(mpReasoner->mTboxKeys);
+	pNode->stampLabel(mpSearch->labels, mpSearch->pTboxLabel, mpLogger, this);
+	allocate(mpReasoner->mTboxKeys.size() * LABEL_ENTRY_BYTES);
+	const vector<const Concept*>& expandables = mpReasoner->mTboxExpandables;
+	for (size_t i = 0; i < expandables.size(); ++i)
+	{
+		if (!isQueued(expandables[i]))
+			continue;
+		allocate(EXPANDABLE_CONCEPT_BYTES);
+		if (pInsertionList)
+			pInsertionList->push_back(new ExpandableConcept(pNode, expandables[i]));
+		else
+			addExpandableConcept(new ExpandableConcept(pNode, expandables[i]));
+	}
+}
+
+bool Reasoner::CompletionTree::closeLabel(Node* pNode, std::list<const ExpandableConcept*>& expandables)
+{
+	list<const ExpandableConcept*> disjunctions, others;
+	DependencySet dependencies;
+	bool forced = true;
+	while (!mClash && forced)
+	{
+		while (!mClash && !expandables.empty())
+		{
+			const ExpandableConcept* pEC = expandables.front();
+			expandables.pop_front();
+			if (pEC->pConcept->getType() == Concept::TYPE_CONJUNCTION)
+			{
+				addConcept(pNode, pEC->pConcept->getConcept1(), &expandables, DependencySet());
+				addConcept(pNode, pEC->pConcept->getConcept2(), &expandables, DependencySet());
+				delete pEC;
+			} else if (pEC->pConcept->getType() == Concept::TYPE_DISJUNCTION)
+				disjunctions.push_back(pEC);
+			else
+				others.push_back(pEC);
+		}
+		// A disjunct may rule the other one out only now
+		forced = false;
+		list<const ExpandableConcept*> open;
+		while (!mClash && !disjunctions.empty())
+		{
+			const ExpandableConcept* pEC = disjunctions.front();
+			disjunctions.pop_front();
+			const Concept* pConcept1 = pEC->pConcept->getConcept1();
+			const Concept* pConcept2 = pEC->pConcept->getConcept2();
+			if (pNode->contains(pConcept1) || pNode->contains(pConcept2))
+				delete pEC;
+			else if (clashesCertainly(pNode, pConcept2, dependencies, 0))
+			{
+				addConcept(pNode, pConcept1, &expandables, DependencySet());
+				forced = true;
+				delete pEC;
+			} else if (clashesCertainly(pNode, pConcept1, dependencies, 0))
+			{
+				addConcept(pNode, pConcept2, &expandables, DependencySet());
+				forced = true;
+				delete pEC;
+			} else
+				open.push_back(pEC);
+		}
+		disjunctions.splice(disjunctions.end(), open);
+	}
+	expandables.splice(expandables.end(), others);
+	expandables.splice(expandables.end(), disjunctions);
+	return !mClash;
+}
+
+bool Reasoner::CompletionTree::propagateUniversalRestriction(const Node* pNode, const Concept* pConcept, bool transitive, Node* pSuccessor, std::list<const ExpandableConcept*>& insertionList)
+{
+	bool added = false;
+	DependencySet dependencies;
+	if (mpSearch->trackDependencies)
+		dependencies = merge(getDependencies(pNode, pConcept), pSuccessor->creationDependencies);
+	if (addConcept(pSuccessor, pConcept->getQualificationConcept(), &insertionList, dependencies))
+	{
+		added = true;
+		if (mpLogger)
+			mpLogger->log(this, pSuccessor, "adding qualification concept \"" + pConcept->getQualificationConcept()->toString(*mpReasoner->mpSymbolDictionary) + "\" to this node.");
+	}
+	// This applies ONLY if this role is transitive.
+	if (transitive && addConcept(pSuccessor, pConcept, &insertionList, dependencies))
+	{
+		added = true;
+		if (mpLogger)
+			mpLogger->log(this, pSuccessor, pConcept, "copying the whole concept to this node for transitivity.");
+	}
+	return added;
+}
+
+// Keeps the concepts the clash follows from within the node, leaving out
+// the Tbox concepts as every node with the same Tbox has them
+void Reasoner::CompletionTree::learnNogood(const Node* pNode, const Node::Premises& premises)
+{
+	NogoodSet::Nogood nogood;
+	set<Node::DependencyKey> visited;
+	Node::Premises pending(premises);
+	while (!pending.empty())
+	{
+		Node::DependencyKey key = pending.back();
+		pending.pop_back();
+		if (!visited.insert(key).second)
+			continue;
+		map<Node::DependencyKey, Node::Premises>::const_iterator it = pNode->premises.find(key);
+		if (it != pNode->premises.end())
+			pending.insert(pending.end(), it->second.begin(), it->second.end());
+		else if (!binary_search(mpReasoner->mTboxKeys.begin(), mpReasoner->mTboxKeys.end(), key))
+			nogood.push_back(key);
+	}
+	sort(nogood.begin(), nogood.end());
+	if (mpSearch->pNogoods->add(nogood))
+		++mpSearch->statistics.learnedNogoodCount;
+}
+
+// Only the nogoods with the concept just added can have been completed
+bool Reasoner::CompletionTree::completesNogood(const Node* pNode, const Node::DependencyKey& key)
+{
+	NogoodSet* pNogoods = mpSearch->pNogoods;
+	const vector<size_t>& watchers = pNogoods->getWatchers(key);
+	for (size_t i = 0; i < watchers.size(); ++i)
+	{
+		const NogoodSet::Nogood& nogood = pNogoods->get(watchers[i]);
+		size_t j = 0;
+		while (j < nogood.size() && pNode->containsKey(nogood[j]))
+			++j;
+		if (j == nogood.size())
+		{
+			pNogoods->touch(watchers[i]);
+			return true;
+		}
+	}
+	return false;
+}
+
 void Reasoner::CompletionTree::addExpandableConcept(const ExpandableConcept* pExpandableConcept)
 {
 	mExpandableConceptQueue.push_back(pExpandableConcept);
-	push_heap(mExpandableConceptQueue.begin(), mExpandableConceptQueue.end(), ExpandableConcept::Compare());
+	push_heap(mExpandableConceptQueue.begin(), mExpandableConceptQueue.end(), getCompare());
 	// Update score
 	mScore += getConceptScore(pExpandableConcept->pConcept);
 }
@@ -383,13 +1371,28 @@ Reasoner::ExpansionResult Reasoner::CompletionTree::expand(CompletionTree*& pNew
 	bool skipThisExpandableConcept = false;
 	const ExpandableConcept* pEC = 0;
 
+	if (mClash)
+		return EXPANSION_RESULT_CLASH;
 	if (mpLogger && mExpandableConceptQueue.empty())
 		mpLogger->log(this, "no more expandable concepts...");
+	// The scores changed since the queue was ordered
+	if (mHeuristicVersion != mpSearch->pHeuristic->getVersion())
+	{
+		make_heap(mExpandableConceptQueue.begin(), mExpandableConceptQueue.end(), getCompare());
+		mHeuristicVersion = mpSearch->pHeuristic->getVersion();
+	}
 
 	while (result == EXPANSION_RESULT_NOT_POSSIBLE && !mExpandableConceptQueue.empty())
 	{
+		// A disjunction may duplicate this tree, the byte limit must allow for that
+		if (mpSearch->isInterrupted(mByteCount))
+		{
+			result = EXPANSION_RESULT_INTERRUPTED;
+			break;
+		}
+
 		// Pop the most promising expandable concept
-		pop_heap(mExpandableConceptQueue.begin(), mExpandableConceptQueue.end(), ExpandableConcept::Compare());
+		pop_heap(mExpandableConceptQueue.begin(), mExpandableConceptQueue.end(), getCompare());
 		pEC = mExpandableConceptQueue.back();
 		mExpandableConceptQueue.pop_back();
 		mScore -= getConceptScore(pEC->pConcept);
@@ -398,64 +1401,97 @@ Reasoner::ExpansionResult Reasoner::CompletionTree::expand(CompletionTree*& pNew
 
 		if (mpLogger)
 			mpLogger->log(this, pEC->pNode, pEC->pConcept, "chosen to be expanded.");
+		TRACE_EVENT(Trace::EVENT_CONCEPT_CHOSEN, mID, pEC->pNode->ID, pEC->pConcept->getID());
 
-		// If we're expanding a "bottom" concept, that means inconsistency
-		if (pEC->pConcept == Concept::getBottomConcept())
-		{
-			if (mpLogger)
-				mpLogger->log(this, pEC->pNode, pEC->pConcept, "concept is bottom, automatic clash.");
-			result = EXPANSION_RESULT_CLASH;
-		} else if (pEC->pNode->isBlocked())
+		if (pEC->pNode->isBlocked())
 		{
 			// We cannot expand in a blocked node, carry on.
 			if (mpLogger)
 				mpLogger->log(this, pEC->pNode, "node is blocked, thus concept is skipped.");
+			++mpSearch->statistics.blockedSkipCount;
+			TRACE_EVENT(Trace::EVENT_CONCEPT_BLOCKED, mID, pEC->pNode->ID, pEC->pConcept->getID());
 			skipThisExpandableConcept = false;
 		} else
 		{
+			++mpSearch->statistics.expansionCount;
+			++mpSearch->statistics.ruleApplicationCounts[pEC->pConcept->getType()];
+			TRACE_EVENT(Trace::EVENT_RULE_APPLIED, mID, pEC->pNode->ID, pEC->pConcept->getID(), pEC->pConcept->getType());
 			switch (pEC->pConcept->getType())
 			{
-				case Concept::TYPE_POSITIVE_ATOMIC:
-					// If there's a negative atomic argument in node with the same concept, clash!
-					if (pEC->pNode->negativeAtomicConcepts.find(pEC->pConcept->getSymbol()) != pEC->pNode->negativeAtomicConcepts.end())
-						result = EXPANSION_RESULT_CLASH;
-					else
-						result = EXPANSION_RESULT_OK;
-					break;
-
-				case Concept::TYPE_NEGATIVE_ATOMIC:
-					// If there's a positive atomic argument in node with the same concept, clash!
-					if (pEC->pNode->positiveAtomicConcepts.find(pEC->pConcept->getSymbol()) != pEC->pNode->positiveAtomicConcepts.end())
-						result = EXPANSION_RESULT_CLASH;
-					else
-						result = EXPANSION_RESULT_OK;
-					break;
-
 				case Concept::TYPE_CONJUNCTION:
+				{
 					if (mpLogger)
 						mpLogger->log(this, pEC->pNode, pEC->pConcept, "adding subconcepts to the same node.");
 					// Add both subconcepts in node, simple enough! :)
-					if (pEC->pNode->addConcept(pEC->pConcept->getConcept1(), mpLogger, this))
-						insertionList.push_back(new ExpandableConcept(pEC->pNode, pEC->pConcept->getConcept1()));
-					if (pEC->pNode->addConcept(pEC->pConcept->getConcept2(), mpLogger, this))
-						insertionList.push_back(new ExpandableConcept(pEC->pNode, pEC->pConcept->getConcept2()));
+					DependencySet dependencies = getDependencies(pEC->pNode, pEC->pConcept);
+					Node::Premises premises;
+					if (mpSearch->pNogoods)
+						premises.push_back(Node::getDependencyKey(pEC->pConcept));
+					addConcept(pEC->pNode, pEC->pConcept->getConcept1(), &insertionList, dependencies, premises);
+					addConcept(pEC->pNode, pEC->pConcept->getConcept2(), &insertionList, dependencies, premises);
 					result = EXPANSION_RESULT_OK;
 					break;
+				}
 
 				case Concept::TYPE_DISJUNCTION:
 				{
-					if (mpLogger)
-						mpLogger->log(this, pEC->pNode, pEC->pConcept, "adding the first subconcept into this Completion Tree, the second one into its duplication.");
-					// We now need to duplicate the incoming completion tree.
-					// This will clone the completion tree returning the new completion tree and the corresponding node to the one given.
-					std::pair<CompletionTree*, Node*> dupresult = duplicate(pEC->pNode, insertionList);
-					pNewCompletionTree = dupresult.first;
-					// Now add the first concept of the disjunction to the actual completion tree
-					if (pEC->pNode->addConcept(pEC->pConcept->getConcept1(), mpLogger, this))
-						insertionList.push_back(new ExpandableConcept(pEC->pNode, pEC->pConcept->getConcept1()));
-					// then add the second concept of the disjunction to the new completion tree
-					if (dupresult.second->addConcept(pEC->pConcept->getConcept2(), mpLogger, dupresult.first))
-						pNewCompletionTree->addExpandableConcept(new ExpandableConcept(dupresult.second, pEC->pConcept->getConcept2()));
+					const Concept* pConcept1 = pEC->pConcept->getConcept1();
+					const Concept* pConcept2 = pEC->pConcept->getConcept2();
+					DependencySet dependencies = getDependencies(pEC->pNode, pEC->pConcept);
+					DependencySet clashDependencies;
+					// A disjunct added for the other one clashing follows from both
+					Node::Premises premises;
+					Node::Premises* pPremises = 0;
+					if (mpSearch->pNogoods)
+					{
+						premises.push_back(Node::getDependencyKey(pEC->pConcept));
+						pPremises = &premises;
+					}
+					// No choice is needed if a disjunct holds already, and a disjunct
+					// that would clash for sure is not worth a tree of its own.
+					if (pEC->pNode->contains(pConcept1) || pEC->pNode->contains(pConcept2))
+					{
+						if (mpLogger)
+							mpLogger->log(this, pEC->pNode, pEC->pConcept, "a subconcept is already present in this node.");
+					} else if (clashesCertainly(pEC->pNode, pConcept2, clashDependencies, pPremises))
+					{
+						if (mpLogger)
+							mpLogger->log(this, pEC->pNode, pEC->pConcept, "second subconcept would clash, adding the first one only.");
+						// The choice also depends on what rules the other disjunct out
+						addConcept(pEC->pNode, pConcept1, &insertionList, merge(dependencies, clashDependencies), premises);
+					} else if (clashesCertainly(pEC->pNode, pConcept1, clashDependencies, pPremises))
+					{
+						if (mpLogger)
+							mpLogger->log(this, pEC->pNode, pEC->pConcept, "first subconcept would clash, adding the second one only.");
+						addConcept(pEC->pNode, pConcept2, &insertionList, merge(dependencies, clashDependencies), premises);
+					} else
+					{
+						// The disjunct less likely to clash stays in this tree, which
+						// goes on being expanded, the other one is left for later
+						size_t rating1 = rateDisjunct(pConcept1);
+						size_t rating2 = rateDisjunct(pConcept2);
+						const BranchingHeuristic* pHeuristic = mpSearch->pHeuristic;
+						if (rating2 < rating1 || (rating2 == rating1 && pHeuristic->getSeed() &&
+							pHeuristic->getTieBreaker(pConcept2) < pHeuristic->getTieBreaker(pConcept1)))
+						{
+							swap(pConcept1, pConcept2);
+							swap(rating1, rating2);
+						}
+						if (mpLogger)
+							mpLogger->log(this, pEC->pNode, pEC->pConcept, "adding \"" + pConcept1->toString(*mpReasoner->mpSymbolDictionary) +
+							"\" into this Completion Tree, the other subconcept into its duplication.");
+						// We now need to duplicate the incoming completion tree.
+						// This will clone the completion tree returning the new completion tree and the corresponding node to the one given.
+						std::pair<CompletionTree*, Node*> dupresult = duplicate(pEC->pNode, insertionList);
+						pNewCompletionTree = dupresult.first;
+						pNewCompletionTree->mBranchPenalty += rating2 - rating1;
+						++mChoiceCount;
+						++pNewCompletionTree->mChoiceCount;
+						// Now add the first concept of the disjunction to the actual completion tree
+						addConcept(pEC->pNode, pConcept1, &insertionList, dependencies);
+						// then add the second concept of the disjunction to the new completion tree
+						pNewCompletionTree->addConcept(dupresult.second, pConcept2, 0, dependencies);
+					}
 					result = EXPANSION_RESULT_OK;
 					break;
 				}
@@ -477,14 +1513,20 @@ Reasoner::ExpansionResult Reasoner::CompletionTree::expand(CompletionTree*& pNew
 					{
 						// Then create a new world that contains the qualification concept
 						Node* pNode = createNode(pEC->pNode);
+						pNode->creationDependencies = getDependencies(pEC->pNode, pEC->pConcept);
 						// Add all tbox concepts to it
-						for (size_t i = 0; i < mpReasoner->getTboxConcepts().size(); ++i)
-							if (pNode->addConcept(mpReasoner->getTboxConcepts()[i], mpLogger, this))
-								insertionList.push_back(new ExpandableConcept(pNode, mpReasoner->getTboxConcepts()[i]));
+						addTboxConcepts(pNode, &insertionList);
 						// Make other node accessible from this one through this role
-						pEC->pNode->addRoleAccessibility(role, pNode);
-						if (pNode->addConcept(pQualificationConcept, mpLogger, this))
-							insertionList.push_back(new ExpandableConcept(pNode, pQualificationConcept));
+						addEdge(pEC->pNode, role, pNode);
+						addConcept(pNode, pQualificationConcept, &insertionList, pNode->creationDependencies);
+						// and apply the universal restrictions on this role expanded already
+						Node::UniversalRestrictionRange watches = pEC->pNode->universalRestrictions.equal_range(role);
+						if (watches.first != watches.second)
+						{
+							bool transitive = mpReasoner->isTransitive(role);
+							for (Node::UniversalRestrictionIterator it = watches.first; it != watches.second; ++it)
+								propagateUniversalRestriction(pEC->pNode, it->second, transitive, pNode, insertionList);
+						}
 
 						if (mpLogger)
 							mpLogger->log(this, pNode, "adding qualification concept \"" + pQualificationConcept->toString(*mpReasoner->mpSymbolDictionary) + "\" to this new node.");
@@ -495,47 +1537,35 @@ Reasoner::ExpansionResult Reasoner::CompletionTree::expand(CompletionTree*& pNew
 
 				case Concept::TYPE_UNIVERSAL_RESTRICTION:
 				{
+					// Apply the restriction to the successors there are, then leave it
+					// to the node: successors created later get it when they're created.
 					Symbol role = pEC->pConcept->getRole();
-					const Concept* pQualificationConcept = pEC->pConcept->getQualificationConcept();
-					// First get the range of nodes reachable by this one through this concept role
+					bool transitive = mpReasoner->isTransitive(role);
 					Node::RelationMapRange range = pEC->pNode->roleAccessibilities.equal_range(role);
 					for (Node::RelationMapIterator it = range.first; it != range.second; ++it)
-					{
-						if (it->second->addConcept(pQualificationConcept, mpLogger, this))
-						{
-							insertionList.push_back(new ExpandableConcept(it->second, pQualificationConcept));
+						if (propagateUniversalRestriction(pEC->pNode, pEC->pConcept, transitive, it->second, insertionList))
 							result = EXPANSION_RESULT_OK;
-							if (mpLogger)
-								mpLogger->log(this, it->second, "adding qualification concept \"" + pQualificationConcept->toString(*mpReasoner->mpSymbolDictionary) + "\" to this existing node.");
-						}
-						// This applies ONLY if this role is transitive.
-						if (mpReasoner->isTransitive(role))
-						{
-							if (it->second->addConcept(pEC->pConcept, mpLogger, this))
-							{
-								insertionList.push_back(new ExpandableConcept(it->second, pEC->pConcept));
-								result = EXPANSION_RESULT_OK;
-								if (mpLogger)
-									mpLogger->log(this, it->second, pQualificationConcept, "copying the whole concept to this existing node for transitivity.");
-							}
-						}
-					}
+					pEC->pNode->universalRestrictions.insert(Node::UniversalRestrictionMap::value_type(role, pEC->pConcept));
+					allocate(EDGE_BYTES);
 					if (result == EXPANSION_RESULT_NOT_POSSIBLE)
 					{
 						if (mpLogger)
-							mpLogger->log(this, pEC->pNode, pEC->pConcept, "impossible to expand as no reachable node does not contain qualification concept or whole concept already present in all reachable nodes (transitivity).");
+							mpLogger->log(this, pEC->pNode, pEC->pConcept, "nothing to add to the existing successors, watching for new ones.");
 					}
-					skipThisExpandableConcept = false; // never ever totally remove an universal restriction
 					break;
 				}
 				default:
 					throw Exception("Invalid concept found during expansion.");
 			}
 		}
+		if (mClash)
+			result = EXPANSION_RESULT_CLASH;
 
-		if (result != EXPANSION_RESULT_NOT_POSSIBLE && skipThisExpandableConcept)
+		if (skipThisExpandableConcept)
+		{
 			delete pEC;
-		else
+			release(EXPANDABLE_CONCEPT_BYTES);
+		} else
 			insertionList.push_back(pEC); // Reinsert it in the list
 	}
 
@@ -545,23 +1575,26 @@ Reasoner::ExpansionResult Reasoner::CompletionTree::expand(CompletionTree*& pNew
 		mExpandableConceptQueue.push_back(insertionList.back());
 		insertionList.pop_back();
 		// Add back the score
-		mScore += getConceptScore(pEC->pConcept);
+		mScore += getConceptScore(mExpandableConceptQueue.back()->pConcept);
 	}
 	// Restore the heap structure
-	make_heap(mExpandableConceptQueue.begin(), mExpandableConceptQueue.end(), ExpandableConcept::Compare());
+	make_heap(mExpandableConceptQueue.begin(), mExpandableConceptQueue.end(), getCompare());
 
 	return result;
 }
 
 std::pair<Reasoner::CompletionTree*, Reasoner::Node*> Reasoner::CompletionTree::duplicate(const Node* pNode, const std::list<const ExpandableConcept*>& insertionList) const
 {
-	CompletionTree* pCompletionTree = new CompletionTree(mpReasoner, mpLogger);
+	CompletionTree* pCompletionTree = new CompletionTree(mpReasoner, mpLogger, mpSearch);
+	++mpSearch->statistics.duplicationCount;
+	TRACE_EVENT(Trace::EVENT_TREE_DUPLICATED, mID, pNode->ID, Trace::NONE, pCompletionTree->getID());
 	Node* pCorrespondingNode = 0;
 	map<const Node*, Node*> nodeToNodeMap;
 	nodeToNodeMap[0] = 0;
 	for (NodeSet::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it)
 	{
 		Node* pNewNode = new Node(**it);
+		mpSearch->labels.acquire(pNewNode->pLabel);
 		// Map the old one to the new one
 		nodeToNodeMap[*it] = pNewNode;
 		pCompletionTree->mNodes.insert(pNewNode);
@@ -584,14 +1617,21 @@ std::pair<Reasoner::CompletionTree*, Reasoner::Node*> Reasoner::CompletionTree::
 	   nodeToNodeMap[mExpandableConceptQueue[i]->pNode],
 	   mExpandableConceptQueue[i]->pConcept
 	   ));
+	pCompletionTree->mScore = mScore;
+	pCompletionTree->mBranchPenalty = mBranchPenalty;
+	pCompletionTree->mChoiceCount = mChoiceCount;
 	// Add to be inserted ECs
 	for (list<const ExpandableConcept*>::const_iterator it = insertionList.begin(); it != insertionList.end(); ++it)
+	{
 		pCompletionTree->mExpandableConceptQueue.push_back(new ExpandableConcept(
-	   nodeToNodeMap[(*it)->pNode],
-	   (*it)->pConcept
-	   ));
+		   nodeToNodeMap[(*it)->pNode],
+		   (*it)->pConcept
+		   ));
+		pCompletionTree->mScore += getConceptScore((*it)->pConcept);
+	}
 	// Make the heap structure
-	make_heap(pCompletionTree->mExpandableConceptQueue.begin(), pCompletionTree->mExpandableConceptQueue.end(), ExpandableConcept::Compare());
+	make_heap(pCompletionTree->mExpandableConceptQueue.begin(), pCompletionTree->mExpandableConceptQueue.end(), getCompare());
+	pCompletionTree->allocate(pCompletionTree->measureByteCount() - pCompletionTree->mByteCount);
 
 	return pair<Reasoner::CompletionTree*, Reasoner::Node*>(pCompletionTree, pCorrespondingNode);
 }
@@ -608,12 +1648,9 @@ void Reasoner::CompletionTree::toModel(const ConceptManager* pConceptManager, Mo
 		{
 			Individual * pIndividual = pModel->createIndividual(pNode->ID);
 			nodeToIndividual[pNode] = pIndividual;
-			for (set<Symbol>::const_iterator it2 = pNode->positiveAtomicConcepts.begin(); it2 != pNode->positiveAtomicConcepts.end(); ++it2)
-				pIndividual->addConcept(pConceptManager->getAtomicConcept(true, *it2));
-			for (set<Symbol>::const_iterator it2 = pNode->negativeAtomicConcepts.begin(); it2 != pNode->negativeAtomicConcepts.end(); ++it2)
-				pIndividual->addConcept(pConceptManager->getAtomicConcept(false, *it2));
-			for (set<const Concept*>::const_iterator it2 = pNode->complexConcepts.begin(); it2 != pNode->complexConcepts.end(); ++it2)
-				pIndividual->addConcept(*it2);
+			const LabelTable::Keys& keys = pNode->pLabel->getKeys();
+			for (LabelTable::Keys::const_iterator it = keys.begin(); it != keys.end(); ++it)
+				pIndividual->addConcept(getKeyConcept(pConceptManager, *it));
 		}
 	}
 
@@ -636,6 +1673,154 @@ void Reasoner::CompletionTree::toModel(const ConceptManager* pConceptManager, Mo
 	}
 }
 
+void Reasoner::CompletionTree::getLabels(const ConceptManager* pConceptManager, std::vector< std::vector<const Concept*> >& labels) const
+{
+	for (NodeSet::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it)
+	{
+		Node* pNode = *it;
+		if (pNode->ID < 1 || pNode->ID > labels.size())
+			continue;
+		vector<const Concept*>& label = labels[pNode->ID - 1];
+		label.clear();
+		const LabelTable::Keys& keys = pNode->pLabel->getKeys();
+		for (LabelTable::Keys::const_iterator it = keys.begin(); it != keys.end(); ++it)
+			label.push_back(getKeyConcept(pConceptManager, *it));
+	}
+}
+
+// A literal clashing with the label, a concept whose negation is in the label
+// (if it was ever made), a conjunction with such a part or a disjunction
+// whose parts all are. dependencies gets what the clash depends on, and
+// pPremises, if given, the concepts of the label it comes from.
+bool Reasoner::CompletionTree::clashesCertainly(const Node* pNode, const Concept* pConcept, DependencySet& dependencies, Node::Premises* pPremises) const
+{
+	// The parts still to look at are kept on a stack of their own, as the
+	// concept may be deep. A part that does not clash leaves nothing behind,
+	// one that does leaves what it depends on in clashDependencies and
+	// clashPremises for the part above it.
+	struct Part {
+		const Concept* pConcept;
+		int stage; // how many of the operands were looked at
+		DependencySet dependencies1; // of the first operand of a disjunction
+		Node::Premises premises1;
+	};
+	vector<Part> pending(1);
+	pending.back().pConcept = pConcept;
+	pending.back().stage = 0;
+	bool clashes = false;
+	DependencySet clashDependencies;
+	Node::Premises clashPremises;
+	while (!pending.empty())
+	{
+		Part& part = pending.back();
+		const Concept* pPart = part.pConcept;
+		const Concept* pNext = 0;
+		if (part.stage == 0)
+		{
+			clashes = false;
+			if (pNode->clashesWith(pPart))
+			{
+				clashes = true;
+				clashDependencies = getDependencies(pNode, pPart, true);
+				clashPremises.clear();
+				if (pPremises && !pPart->isBottom())
+					clashPremises.push_back(Node::getDependencyKey(pPart, true));
+			} else if (pPart->getType() == Concept::TYPE_CONJUNCTION || pPart->getType() == Concept::TYPE_DISJUNCTION)
+				pNext = pPart->getConcept1();
+			else if (pPart->getType() == Concept::TYPE_EXISTENTIAL_RESTRICTION || pPart->getType() == Concept::TYPE_UNIVERSAL_RESTRICTION)
+			{
+				const Concept* pNegation = mpReasoner->mpConceptManager->findNegation(pPart);
+				if (pNegation && pNode->contains(pNegation))
+				{
+					clashes = true;
+					clashDependencies = getDependencies(pNode, pNegation);
+					clashPremises.clear();
+					if (pPremises)
+						clashPremises.push_back(Node::getDependencyKey(pNegation));
+				}
+			}
+		} else if (part.stage == 1)
+		{
+			// A conjunction clashes with either part, a disjunction with both
+			if (pPart->getType() == Concept::TYPE_CONJUNCTION ? !clashes : clashes)
+				pNext = pPart->getConcept2();
+			if (pNext && clashes)
+			{
+				part.dependencies1.swap(clashDependencies);
+				part.premises1.swap(clashPremises);
+			}
+		} else if (pPart->getType() == Concept::TYPE_DISJUNCTION && clashes)
+		{
+			clashDependencies = merge(part.dependencies1, clashDependencies);
+			part.premises1.insert(part.premises1.end(), clashPremises.begin(), clashPremises.end());
+			clashPremises.swap(part.premises1);
+		}
+		if (pNext)
+		{
+			++part.stage;
+			pending.push_back(Part());
+			pending.back().pConcept = pNext;
+			pending.back().stage = 0;
+		} else
+			pending.pop_back();
+	}
+	if (!clashes)
+		return false;
+	dependencies.swap(clashDependencies);
+	if (pPremises)
+		pPremises->insert(pPremises->end(), clashPremises.begin(), clashPremises.end());
+	return true;
+}
+
+// Lower is more promising: the names that clashed often in the previous
+// checks weigh most, then the size of the concept and the depth of its
+// restrictions, looked at up to a few parts only
+size_t Reasoner::CompletionTree::rateDisjunct(const Concept* pConcept) const
+{
+	static const size_t MAX_PART_COUNT = 16;
+	vector< pair<const Concept*, size_t> > parts(1, make_pair(pConcept, 0));
+	size_t clashCount = 0, partCount = 0, depth = 0;
+	while (!parts.empty() && partCount < MAX_PART_COUNT)
+	{
+		pConcept = parts.back().first;
+		size_t partDepth = parts.back().second;
+		parts.pop_back();
+		++partCount;
+		depth = max(depth, partDepth);
+		switch (pConcept->getType())
+		{
+			case Concept::TYPE_POSITIVE_ATOMIC:
+			case Concept::TYPE_NEGATIVE_ATOMIC:
+				clashCount += mpReasoner->mpClashCounter->getCount(pConcept->getSymbol());
+				break;
+			case Concept::TYPE_CONJUNCTION:
+			case Concept::TYPE_DISJUNCTION:
+				parts.push_back(make_pair(pConcept->getConcept1(), partDepth));
+				parts.push_back(make_pair(pConcept->getConcept2(), partDepth));
+				break;
+			default:
+				parts.push_back(make_pair(pConcept->getQualificationConcept(), partDepth + 1));
+				break;
+		}
+	}
+	size_t clashWeight = 0;
+	while (clashCount)
+	{
+		++clashWeight;
+		clashCount >>= 1;
+	}
+	return 4 * clashWeight + partCount + 2 * depth;
+}
+
+// The restrictions are left to the successor checks when they are separate
+bool Reasoner::CompletionTree::isQueued(const Concept* pConcept) const
+{
+	if (!pConcept->isExpandable())
+		return false;
+	return !mpSearch->separateSuccessors || (pConcept->getType() != Concept::TYPE_EXISTENTIAL_RESTRICTION &&
+		pConcept->getType() != Concept::TYPE_UNIVERSAL_RESTRICTION);
+}
+
 size_t Reasoner::CompletionTree::getConceptScore(const Concept * pConcept)
 {
 	switch (pConcept->getType())
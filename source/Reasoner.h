@@ -32,60 +32,228 @@
 #include "Concept.h"
 #include "SymbolDictionary.h"
 #include "ConceptManager.h"
+#include "Snapshot.h"
+#include "Abox.h"
+#include "BranchingHeuristic.h"
+#include "NogoodSet.h"
+#include "LabelTable.h"
+#include <csignal>
 
 namespace tinyreason
 {
 
+class ThreadPool;
+
+/** Lets another thread, or a signal handler, stop a running search */
+class CancellationToken {
+public:
+	// Cancelling the parent cancels this token too
+	CancellationToken(const CancellationToken* pParent = 0) :
+	mCancelled(0), mpParent(pParent) { }
+	void cancel() {
+		mCancelled = 1;
+	}
+	void reset() {
+		mCancelled = 0;
+	}
+	bool isCancelled() const {
+		return mCancelled || (mpParent && mpParent->isCancelled());
+	}
+private:
+	volatile sig_atomic_t mCancelled;
+	const CancellationToken* mpParent;
+};
+
 class Reasoner {
 	friend class CompletionTree;
 
 public:
+
+	enum Result {
+		RESULT_UNSATISFIABLE,
+		RESULT_SATISFIABLE,
+		RESULT_UNKNOWN // a limit was reached or the search was cancelled
+	};
+
+	/** Which open completion tree is expanded next */
+	enum SearchStrategy {
+		SEARCH_BEST_FIRST, // the one with the fewest concepts to expand
+		SEARCH_DEPTH_FIRST // the one with the most choices made, then the best
+	};
+
+	enum Limit {
+		LIMIT_NONE,
+		LIMIT_TIME,
+		LIMIT_EXPANSIONS,
+		LIMIT_TREES,
+		LIMIT_BYTES,
+		LIMIT_CANCELLED
+	};
+
+	/** Budget of a single satisfiability check, zero means unlimited */
+	struct Limits {
+		unsigned long long maxTime; // microseconds of wall time
+		size_t maxExpansionCount;
+		size_t maxTreeCount; // completion trees created
+		size_t maxByteCount; // estimated size of the open completion trees
+		bool evictOnByteLimit; // drop the least promising trees instead of stopping at maxByteCount
+		BranchingHeuristic::Kind heuristic; // how the disjunctions are ordered
+		bool keepActivities; // start from the activities left by the previous check with the same Tbox
+		SearchStrategy searchStrategy;
+		unsigned randomSeed; // breaks the ties of the heuristics when not zero
+		size_t maxNogoodCount; // kept for the following checks with the same Tbox, none are learned when zero
+		bool separateSuccessors; // each successor's label is checked on its own, see checkSuccessors()
+		std::string cacheFileName; // answers kept on disk by the callers of the check, see ResultCache
+		const CancellationToken* pCancellationToken;
+		ThreadPool* pThreadPool; // checks the successors of the first node in parallel when they are separate
+
+		Limits() :
+		maxTime(0), maxExpansionCount(0), maxTreeCount(0), maxByteCount(0), evictOnByteLimit(false), heuristic(BranchingHeuristic::KIND_TYPES),
+		keepActivities(false), searchStrategy(SEARCH_BEST_FIRST), randomSeed(0), maxNogoodCount(0), separateSuccessors(false),
+		pCancellationToken(0), pThreadPool(0) { }
+		void parse(const std::string& text);
+	};
+
+	/** Figures about a single satisfiability check */
+	struct Statistics {
+		enum {
+			CONCEPT_TYPE_COUNT = Concept::TYPE_UNIVERSAL_RESTRICTION + 1
+		};
+
+		size_t completeTreeCount; // completion trees closed by a clash
+		size_t incompleteTreeCount; // completion trees still open when the search stopped
+		size_t createdTreeCount; // completion trees created, duplicates included
+		size_t expansionCount; // expandable concepts actually expanded
+		size_t ruleApplicationCounts[CONCEPT_TYPE_COUNT]; // expansions per concept type
+		size_t clashCount; // clashes found
+		size_t duplicationCount; // completion trees duplicated on a disjunction
+		size_t createdNodeCount; // nodes created by existential restrictions, first nodes included
+		size_t blockedSkipCount; // expandable concepts skipped because their node was blocked
+		size_t blockedNodeCount; // blocked nodes in the complete completion tree, if any
+		size_t peakOpenTreeCount; // largest number of open completion trees
+		size_t peakByteCount; // largest estimated size of the open completion trees
+		size_t evictedTreeCount; // open completion trees dropped to stay within maxByteCount
+		size_t conceptByteCount; // estimated size of the interned concepts the check could use
+		size_t learnedNogoodCount; // sets of label concepts found to clash together
+		size_t nogoodClashCount; // completion trees closed by a nogood rather than by complementary literals
+		size_t successorCheckCount; // successor labels checked on their own
+		size_t successorCacheHitCount; // successor labels answered by an earlier check of the same label
+		unsigned long long preprocessingTime; // microseconds spent filling the first node
+		unsigned long long expansionTime; // microseconds spent expanding completion trees
+		unsigned long long modelExtractionTime; // microseconds spent converting the complete tree into a model
+		Limit limitReached; // why the search stopped early, if it did
+
+		Statistics();
+		// Adds the figures of a check made on behalf of this one
+		void add(const Statistics& statistics);
+		void dumpToJSON(std::ostream& outStream) const;
+	};
+
+	/** Tbox axioms and query concepts that are unsatisfiable together, by index */
+	struct Explanation {
+		std::vector<size_t> tboxAxioms;
+		std::vector<size_t> concepts;
+	};
 	Reasoner(const SymbolDictionary* pSymbolDictionary, const ConceptManager* pConceptManager);
 	~Reasoner();
 	const std::vector<const Concept*> getTboxConcepts() const {
 		return mTbox;
 	}
+	const std::set<Symbol>& getTransitiveRoles() const {
+		return mTransitiveRolesSet;
+	}
 	bool isTransitive(Symbol role) const {
 		return mTransitiveRolesSet.find(role) != mTransitiveRolesSet.end();
 	}
 	void setTboxConcepts(const std::vector<const Concept*>& tbox);
 	void setTransitiveRole(Symbol role);
 	void setTransitiveRoles(const std::vector<Symbol>& transitiveRoles);
+	void loadSnapshot(const Snapshot& snapshot);
+	void setLogStream(std::ostream& logStream) {
+		mpLogStream = &logStream;
+	}
 
-	bool isSatisfiable(const Concept* pConcept, Model* pModel = 0, bool verbose = false) const;
-	bool isSatisfiable(const std::vector<const Concept*>& concepts, Model* pModel = 0, bool verbose = false) const;
+	bool isSatisfiable(const Concept* pConcept, Model* pModel = 0, bool verbose = false, Statistics* pStatistics = 0) const;
+	bool isSatisfiable(const std::vector<const Concept*>& concepts, Model* pModel = 0, bool verbose = false, Statistics* pStatistics = 0) const;
+	// Checks can run concurrently as long as no concept gets interned meanwhile
+	Result checkSatisfiability(const std::vector<const Concept*>& concepts, const Limits& limits, Model* pModel = 0, bool verbose = false, Statistics* pStatistics = 0) const;
+	/**
+	 * Checks satisfiability tracking which axioms and concepts every label
+	 * entry derives from. When unsatisfiable, the explanation is the union of
+	 * the sources of every clash, minimised by dropping each source in turn.
+	 * The limits apply to each check: a dropped source that makes the check
+	 * stop early is kept, so the explanation may then not be minimal.
+	 */
+	Result explain(const std::vector<const Concept*>& concepts, const Limits& limits, Explanation& explanation, Statistics* pStatistics = 0) const;
+	/**
+	 * Checks that some individuals of an Abox, each one holding the concepts
+	 * given at the same position, have a model together with the Tbox. Their
+	 * role assertions towards the individuals left out are ignored, which makes
+	 * it a check of a part of the Abox. When consistent, pLabels receives the
+	 * concepts of each individual in the model found.
+	 */
+	Result checkConsistency(const Abox& abox, const std::vector<size_t>& individuals, const std::vector< std::vector<const Concept*> >& concepts,
+		const Limits& limits, std::vector< std::vector<const Concept*> >* pLabels = 0, Statistics* pStatistics = 0) const;
+	static const char* getLimitName(Limit limit);
 private:
 
+	// Sorted indexes of the sources of a concept: Tbox axioms first, then the
+	// query concepts numbered after them
+	typedef std::vector<unsigned> DependencySet;
+
 	class Logger;
 	class Node;
 	class CompletionTree;
 	class ExpandableConcept;
+	class SuccessorJob;
 
 	struct Node {
 		typedef std::multimap<Symbol, Node*> RoleAccessibilityMap;
 		typedef RoleAccessibilityMap::iterator RelationMapIterator;
 		typedef std::pair<RelationMapIterator, RelationMapIterator> RelationMapRange;
+		typedef std::multimap<Symbol, const Concept*> UniversalRestrictionMap;
+		typedef UniversalRestrictionMap::const_iterator UniversalRestrictionIterator;
+		typedef std::pair<UniversalRestrictionIterator, UniversalRestrictionIterator> UniversalRestrictionRange;
 
 		size_t ID;
 		const Node* pParentNode;
-		std::set<Symbol> positiveAtomicConcepts;
-		std::set<Symbol> negativeAtomicConcepts;
-		std::set<const Concept*> complexConcepts;
+		const LabelTable::Label* pLabel; // shared with the nodes that have the same concepts
 		std::multimap<Symbol, Node*> roleAccessibilities;
+		// Universal restrictions already expanded in this node, by role, to be
+		// applied to the successors created afterwards
+		UniversalRestrictionMap universalRestrictions;
 		const Node* pBlockingNode;
-		size_t totalConceptCount;
+		// Only filled when explaining: the sources of each label entry and of
+		// the existential restriction that created this node
+		typedef std::pair<int, size_t> DependencyKey;
+		std::map<DependencyKey, DependencySet> dependencies;
+		DependencySet creationDependencies;
+		// Only filled when learning nogoods: the concepts of this label each
+		// entry was derived from, none for those that came from elsewhere
+		typedef std::vector<DependencyKey> Premises;
+		std::map<DependencyKey, Premises> premises;
 
 		// When a new node is created, it automatically is blocked by its parent
 		// because its (empty) label is contained within its parent.
-		Node(size_t id, const Node * pParent) :
-		ID(id), pParentNode(pParent), pBlockingNode(pParent), totalConceptCount(0) { }
+		Node(size_t id, const Node * pParent, const LabelTable::Label* pLabel) :
+		ID(id), pParentNode(pParent), pLabel(pLabel), pBlockingNode(pParent) { }
 		bool isBlocked() const {
 			return pBlockingNode;
 		}
-		bool addConcept(const Concept * pConcept, const Logger* pLogger, const CompletionTree * pLoggingCT);
+		size_t getConceptCount() const {
+			return pLabel->getSize();
+		}
+		bool addConcept(LabelTable& labels, const Concept * pConcept, const Logger* pLogger, const CompletionTree * pLoggingCT);
+		// Gives this node, whose own label is empty, the label of the Tbox closure
+		void stampLabel(LabelTable& labels, const LabelTable::Label* pTboxLabel, const Logger* pLogger, const CompletionTree* pLoggingCT);
+		// The blocking node no longer contains this label, looks further up
+		void findBlockingNode(LabelTable& labels, const Logger* pLogger, const CompletionTree* pLoggingCT);
 		void addRoleAccessibility(Symbol role, Node * pToOtherNode);
 		bool contains(const Concept * pConcept) const;
-		bool containsConceptsOf(const Node * pNode) const;
+		bool clashesWith(const Concept * pConcept) const;
+		bool containsKey(const DependencyKey& key) const;
+		bool containsConceptsOf(LabelTable& labels, const Node * pNode) const;
+		static DependencyKey getDependencyKey(const Concept* pConcept, bool complement = false);
 	};
 
 	typedef std::pair<Symbol, Node*> SymbolNodePair;
@@ -98,44 +266,170 @@ private:
 
 		/** Heuristic for choosing the next complex concept to expand in an individual of a completion tree */
 		struct Compare {
+			Compare(const BranchingHeuristic* pHeuristic) :
+			mpHeuristic(pHeuristic) { }
 			bool operator()(const ExpandableConcept* pEC1, const ExpandableConcept * pEC2) const;
+		private:
+			const BranchingHeuristic* mpHeuristic;
 		};
 	};
 
 	enum ExpansionResult {
 		EXPANSION_RESULT_NOT_POSSIBLE,
 		EXPANSION_RESULT_OK,
-		EXPANSION_RESULT_CLASH
+		EXPANSION_RESULT_CLASH,
+		EXPANSION_RESULT_INTERRUPTED
+	};
+
+	// The complete first nodes of the checks a successor check is nested in,
+	// innermost first
+	struct SuccessorPath {
+		const Node* pNode;
+		const SuccessorPath* pParent;
+		size_t depth;
+
+		SuccessorPath(const Node* pNode, const SuccessorPath* pParent) :
+		pNode(pNode), pParent(pParent), depth(pParent ? pParent->depth + 1 : 0) { }
+	};
+
+	/** Answers of the successor checks of a satisfiability check, shared by the threads making them */
+	class SuccessorCache {
+	public:
+		SuccessorCache();
+		~SuccessorCache();
+		bool find(const std::vector<const Concept*>& concepts, Result& result) const;
+		void insert(const std::vector<const Concept*>& concepts, Result result);
+	private:
+		SuccessorCache(const SuccessorCache&);
+		SuccessorCache& operator=(const SuccessorCache&);
+
+		mutable pthread_mutex_t mMutex;
+		std::map<std::vector<const Concept*>, Result> mResults;
+	};
+
+	/** State of a single satisfiability check shared by its completion trees */
+	struct Search {
+		Statistics statistics;
+		const Limits* pLimits;
+		unsigned long long startTime;
+		size_t byteCount; // estimated size of the open completion trees
+		size_t checkCount;
+		size_t completionTreeIDCounter;
+		const std::vector<const Concept*>* pTbox;
+		bool trackDependencies;
+		DependencySet clashDependencies; // union over the clashes found
+		BranchingHeuristic* pHeuristic;
+		NogoodSet* pNogoods; // null unless learning
+		// When the successors are separate the trees hold the first node only
+		bool separateSuccessors;
+		const SuccessorPath* pPath; // of the check being expanded
+		SuccessorCache* pSuccessorCache;
+		size_t blockingDepth; // of the shallowest node that blocked a successor since it was reset
+		LabelTable labels; // of the nodes of the check
+		const LabelTable::Label* pTboxLabel; // interned when first stamped
+
+		Search(const Limits* pLimits, const std::vector<const Concept*>* pTbox, bool trackDependencies, BranchingHeuristic* pHeuristic) :
+		pLimits(pLimits), startTime(getMicroseconds()), byteCount(0), checkCount(0), completionTreeIDCounter(1), pTbox(pTbox), trackDependencies(trackDependencies),
+		pHeuristic(pHeuristic), pNogoods(0), separateSuccessors(false), pPath(0), pSuccessorCache(0), blockingDepth((size_t) -1), pTboxLabel(0) { }
+		// The byte limit counts reservedByteCount as already allocated
+		bool isInterrupted(size_t reservedByteCount = 0);
+		bool exceedsByteLimit(size_t reservedByteCount) const {
+			return pLimits->maxByteCount && byteCount + reservedByteCount >= pLimits->maxByteCount;
+		}
+		void allocate(size_t bytes) {
+			byteCount += bytes;
+			if (byteCount > statistics.peakByteCount)
+				statistics.peakByteCount = byteCount;
+		}
+		void release(size_t bytes) {
+			byteCount -= bytes;
+		}
 	};
 
 	class CompletionTree {
 	public:
 
 		struct ComparePtrs {
+			ComparePtrs(SearchStrategy searchStrategy) :
+			mSearchStrategy(searchStrategy) { }
 			bool operator()(const CompletionTree* pCT1, const CompletionTree * pCT2) const;
+		private:
+			SearchStrategy mSearchStrategy;
 		};
 
-		CompletionTree(const Reasoner* pReasoner, const Logger* pLogger);
+		CompletionTree(const Reasoner* pReasoner, const Logger* pLogger, Search* pSearch);
 		~CompletionTree();
 		size_t getID() const {
 			return mID;
 		}
 		size_t getConceptCount() const;
+		size_t getBlockedNodeCount() const;
+		size_t getByteCount() const {
+			return mByteCount;
+		}
 		Node* createNode(Node* pParent);
+		const Node* getFirstNode() const;
+		void addEdge(Node* pNode, Symbol role, Node* pSuccessor);
+		// premises are the concepts of the label pConcept is derived from, if any
+		bool addConcept(Node* pNode, const Concept* pConcept, std::list<const ExpandableConcept*>* pInsertionList, const DependencySet& dependencies,
+			const Node::Premises& premises = Node::Premises());
+		// Fills a new node with the Tbox, through pInsertionList if given
+		void addTboxConcepts(Node* pNode, std::list<const ExpandableConcept*>* pInsertionList);
+		// Expands the conjunctions and the disjunctions left with a single
+		// choice in the label of a lone node, until none is, the concepts still
+		// to expand are left in expandables. False on a clash.
+		bool closeLabel(Node* pNode, std::list<const ExpandableConcept*>& expandables);
+		bool propagateUniversalRestriction(const Node* pNode, const Concept* pConcept, bool transitive, Node* pSuccessor, std::list<const ExpandableConcept*>& insertionList);
+		DependencySet getDependencies(const Node* pNode, const Concept* pConcept, bool complement = false) const;
+		bool hasClash() const {
+			return mClash;
+		}
 		void addExpandableConcept(const ExpandableConcept* pExpandableConcept);
 		ExpansionResult expand(CompletionTree*& pNewCompletionTree);
 		std::pair<CompletionTree*, Node*> duplicate(const Node* pNode, const std::list<const ExpandableConcept*>& insertionList) const;
 		void toModel(const ConceptManager* pConceptManager, Model* pModel) const;
+		// The labels of the first nodes created, by ID
+		void getLabels(const ConceptManager* pConceptManager, std::vector< std::vector<const Concept*> >& labels) const;
 	private:
+		// Estimated sizes of what a completion tree allocates
+		static const size_t NODE_BYTES;
+		static const size_t LABEL_ENTRY_BYTES;
+		static const size_t EDGE_BYTES;
+		static const size_t EXPANDABLE_CONCEPT_BYTES;
+
 		static size_t getConceptScore(const Concept * pConcept);
+		static const Concept* getKeyConcept(const ConceptManager* pConceptManager, const Node::DependencyKey& key);
+		bool isQueued(const Concept* pConcept) const;
+		bool clashesCertainly(const Node* pNode, const Concept* pConcept, DependencySet& dependencies, Node::Premises* pPremises) const;
+		void learnNogood(const Node* pNode, const Node::Premises& premises);
+		bool completesNogood(const Node* pNode, const Node::DependencyKey& key);
+		size_t rateDisjunct(const Concept* pConcept) const;
+		size_t measureByteCount() const;
+		ExpandableConcept::Compare getCompare() const {
+			return ExpandableConcept::Compare(mpSearch->pHeuristic);
+		}
+		void allocate(size_t bytes) {
+			mByteCount += bytes;
+			mpSearch->allocate(bytes);
+		}
+		void release(size_t bytes) {
+			mByteCount -= bytes;
+			mpSearch->release(bytes);
+		}
 
 		const Reasoner* mpReasoner;
 		size_t mID;
 		const Logger* mpLogger;
+		Search* mpSearch;
 		typedef std::set<Node*> NodeSet;
 		NodeSet mNodes;
 		std::vector<const ExpandableConcept*> mExpandableConceptQueue;
+		size_t mHeuristicVersion; // of the scores the queue is ordered by
 		size_t mScore;
+		size_t mBranchPenalty; // added to the score for each disjunct less promising than the other one
+		size_t mChoiceCount; // disjunctions that duplicated the tree on the way to it
+		size_t mByteCount;
+		bool mClash; // some node holds bottom or complementary literals
 
 	};
 
@@ -152,11 +446,45 @@ private:
 		const SymbolDictionary* mpSymbolDictionary;
 	};
 
-	mutable size_t mCompletionTreeIDCounter;
+	Result checkSatisfiability(const std::vector<const Concept*>& tbox, const std::vector<const Concept*>& concepts, const Limits& limits, Model* pModel,
+		bool verbose, Statistics* pStatistics, DependencySet* pClashDependencies) const;
+	// Expands until a tree is complete, every tree is closed or a limit is reached,
+	// the open trees are left in completionTrees with the complete one first
+	Result expandCompletionTrees(Search& search, CompletionTree* pCompletionTree, const Logger* pLogger, std::vector<CompletionTree*>& completionTrees) const;
+	BranchingHeuristic* createHeuristic(const Limits& limits, const std::vector<const Concept*>& concepts) const;
+	void keepHeuristic(const Limits& limits, const BranchingHeuristic* pHeuristic) const;
+	void loadNogoods(Search& search, NogoodSet& nogoods) const;
+	void saveNogoods(const Search& search, NogoodSet& nogoods) const;
+	void compileTboxLabel();
+	static DependencySet merge(const DependencySet& dependencies1, const DependencySet& dependencies2);
+	static void evictLeastPromisingTree(std::vector<CompletionTree*>& completionTrees, Search& search);
+	static void removeTree(std::vector<CompletionTree*>& completionTrees, CompletionTree* pCompletionTree, SearchStrategy searchStrategy);
+	Result checkSuccessors(Search& search, const CompletionTree* pCompletionTree, const Logger* pLogger) const;
+	Result checkSuccessor(Search& search, const SuccessorPath& path, const std::vector<const Concept*>& concepts, const Logger* pLogger) const;
+	void collectSuccessors(const Node* pNode, std::vector< std::vector<const Concept*> >& successors) const;
+
 	const SymbolDictionary* mpSymbolDictionary;
 	const ConceptManager* mpConceptManager;
+	std::ostream* mpLogStream;
 	std::vector<const Concept*> mTbox;
 	std::set<Symbol> mTransitiveRolesSet;
+	std::vector<double> mTboxOccurrences; // of the literals in the disjunctions of the Tbox, by symbol
+	// What every node gets from the Tbox before anything else, when the Tbox
+	// alone does not clash: the label it closes to (in mTboxKeys) and the
+	// concepts of it still to expand
+	bool mHasTboxLabel;
+	std::vector<const Concept*> mTboxExpandables;
+	// Sorted, left out of the nogoods as every node has them: the label the
+	// Tbox closes to if there is one, its concepts otherwise
+	std::vector<NogoodSet::Key> mTboxKeys;
+	ActivityHeuristic::Store mActivityStore;
+	ClashCounter mClashCounter;
+	NogoodSet::Store mNogoodStore;
+	// Copies of a reasoner keep learning into the stores and the counter of
+	// the original, which must outlive them
+	ActivityHeuristic::Store* mpActivityStore;
+	ClashCounter* mpClashCounter;
+	NogoodSet::Store* mpNogoodStore;
 };
 
 }
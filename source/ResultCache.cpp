@@ -0,0 +1,547 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "ResultCache.h"
+#include "Concept.h"
+#include "SymbolDictionary.h"
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+namespace tinyreason
+{
+
+namespace
+{
+const char LOG_MAGIC[] = "TinyReason results 1\n";
+const char INDEX_MAGIC[8] = {'T', 'R', 'I', 'N', 'D', 'E', 'X', '1'};
+const uint64_t LOG_HEADER_SIZE = sizeof (LOG_MAGIC) - 1;
+// "<tbox fingerprint> <query fingerprint> <S|U>\n", fingerprints in hex
+const uint64_t RECORD_SIZE = 32 + 1 + 32 + 1 + 1 + 1;
+const uint64_t MIN_SLOT_COUNT = 1024;
+// Records read at once when the log is scanned
+const size_t SCAN_RECORD_COUNT = 1024;
+
+uint64_t mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// The two halves are kept apart by their seeds
+void combine(ResultCache::Fingerprint& fingerprint, const ResultCache::Fingerprint& value)
+{
+	fingerprint.first = mix(fingerprint.first ^ (value.first + 0x9e3779b97f4a7c15ULL));
+	fingerprint.second = mix(fingerprint.second ^ (value.second + 0xc2b2ae3d27d4eb4fULL) ^ 0x165667b19e3779f9ULL);
+}
+
+ResultCache::Fingerprint makeFingerprint(uint64_t value)
+{
+	return ResultCache::Fingerprint(mix(value), mix(value ^ 0xd6e8feb86659fd93ULL));
+}
+
+ResultCache::Fingerprint hashName(const string& name)
+{
+	ResultCache::Fingerprint fingerprint(0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL);
+	for (size_t i = 0; i < name.size(); ++i)
+	{
+		fingerprint.first = (fingerprint.first ^ (unsigned char) name[i]) * 0x100000001b3ULL;
+		fingerprint.second = (fingerprint.second ^ (unsigned char) name[i]) * 0x100000001b3ULL + 1;
+	}
+	return makeFingerprint(fingerprint.first ^ mix(fingerprint.second));
+}
+
+void writeHex(char* pText, uint64_t value)
+{
+	for (int i = 15; i >= 0; --i, value >>= 4)
+		pText[i] = "0123456789abcdef"[value & 15];
+}
+
+bool readHex(const char* pText, uint64_t& value)
+{
+	value = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		char c = pText[i];
+		if (c >= '0' && c <= '9')
+			value = value << 4 | (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			value = value << 4 | (c - 'a' + 10);
+		else
+			return false;
+	}
+	return true;
+}
+
+// A record is only valid if it parses, a torn or garbled one is skipped
+bool parseRecord(const char* pRecord, ResultCache::Fingerprint& tbox, ResultCache::Fingerprint& query, Reasoner::Result& result)
+{
+	if (pRecord[32] != ' ' || pRecord[65] != ' ' || pRecord[RECORD_SIZE - 1] != '\n' ||
+		!readHex(pRecord, tbox.first) || !readHex(pRecord + 16, tbox.second) ||
+		!readHex(pRecord + 33, query.first) || !readHex(pRecord + 49, query.second))
+		return false;
+	if (pRecord[66] == 'S')
+		result = Reasoner::RESULT_SATISFIABLE;
+	else if (pRecord[66] == 'U')
+		result = Reasoner::RESULT_UNSATISFIABLE;
+	else
+		return false;
+	return true;
+}
+
+// Never zero, which marks the free slots of the index
+uint64_t getTag(const ResultCache::Fingerprint& tbox, const ResultCache::Fingerprint& query)
+{
+	uint64_t tag = mix(tbox.first ^ mix(query.first));
+	return tag ? tag : 1;
+}
+
+// The operands of a conjunction, or a disjunction, and of those of the same
+// type nested in it
+void collectOperands(const Concept* pConcept, vector<const Concept*>& operands)
+{
+	vector<const Concept*> pending(1, pConcept);
+	while (!pending.empty())
+	{
+		const Concept* pPart = pending.back();
+		pending.pop_back();
+		if (pPart->getType() == pConcept->getType())
+		{
+			pending.push_back(pPart->getConcept2());
+			pending.push_back(pPart->getConcept1());
+		} else
+			operands.push_back(pPart);
+	}
+}
+
+#ifndef _WIN32
+bool readAt(int file, void* pBuffer, size_t size, uint64_t offset)
+{
+	while (size)
+	{
+		ssize_t count = pread(file, pBuffer, size, offset);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			return false;
+		pBuffer = (char*) pBuffer + count;
+		size -= count;
+		offset += count;
+	}
+	return true;
+}
+
+void writeAt(int file, const void* pBuffer, size_t size, uint64_t offset)
+{
+	while (size)
+	{
+		ssize_t count = pwrite(file, pBuffer, size, offset);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			throw Exception("Cannot write the result cache.");
+		pBuffer = (const char*) pBuffer + count;
+		size -= count;
+		offset += count;
+	}
+}
+
+uint64_t getFileSize(int file)
+{
+	struct stat status;
+	if (fstat(file, &status) < 0)
+		throw Exception("Cannot read the result cache.");
+	return status.st_size;
+}
+#endif
+}
+
+struct ResultCache::IndexHeader {
+	char magic[8];
+	uint64_t slotCount; // a power of two
+	uint64_t recordCount;
+	uint64_t indexedSize; // how much of the log the slots cover
+};
+
+// Slots are pairs of a tag and the offset of the record in the log
+typedef pair<uint64_t, uint64_t> IndexSlot;
+
+/** Holds a flock on a file for its lifetime */
+class ResultCache::Lock {
+public:
+	Lock(int file, int operation) :
+	mFile(file) {
+#ifndef _WIN32
+		while (flock(mFile, operation) < 0)
+			if (errno != EINTR)
+				throw Exception("Cannot lock the result cache.");
+#endif
+	}
+	~Lock() {
+#ifndef _WIN32
+		flock(mFile, LOCK_UN);
+#endif
+	}
+private:
+	int mFile;
+};
+
+ResultCache::Fingerprint ResultCache::getFingerprint(const SymbolDictionary& symbolDictionary, const std::vector<const Concept*>& concepts,
+	const std::set<Symbol>& transitiveRoles)
+{
+	// Concepts are hashed bottom up, from a stack of their own as they may
+	// be deep, and each one once however many concepts share it. Nested
+	// conjunctions, or disjunctions, are hashed as one, from the sorted set
+	// of their operands, so neither their order nor their nesting matters.
+	map<const Concept*, Fingerprint> fingerprints;
+	vector<const Concept*> pending(concepts.rbegin(), concepts.rend());
+	vector<const Concept*> operands;
+	while (!pending.empty())
+	{
+		const Concept* pConcept = pending.back();
+		if (fingerprints.count(pConcept))
+		{
+			pending.pop_back();
+			continue;
+		}
+		Fingerprint fingerprint = makeFingerprint(pConcept->getType());
+		if (pConcept->isTop() || pConcept->isBottom())
+			combine(fingerprint, makeFingerprint(pConcept->getSymbol()));
+		else if (pConcept->isAtomic())
+			combine(fingerprint, hashName(symbolDictionary.toName(pConcept->getSymbol())));
+		else
+		{
+			operands.clear();
+			if (pConcept->getType() == Concept::TYPE_EXISTENTIAL_RESTRICTION || pConcept->getType() == Concept::TYPE_UNIVERSAL_RESTRICTION)
+			{
+				combine(fingerprint, hashName(symbolDictionary.toName(pConcept->getRole())));
+				operands.push_back(pConcept->getQualificationConcept());
+			} else
+				collectOperands(pConcept, operands);
+			// The operands not hashed yet come first, then this one again
+			vector<Fingerprint> parts;
+			for (size_t i = 0; i < operands.size(); ++i)
+			{
+				map<const Concept*, Fingerprint>::const_iterator it = fingerprints.find(operands[i]);
+				if (it == fingerprints.end())
+					pending.push_back(operands[i]);
+				else
+					parts.push_back(it->second);
+			}
+			if (pending.back() != pConcept)
+				continue;
+			sort(parts.begin(), parts.end());
+			parts.erase(unique(parts.begin(), parts.end()), parts.end());
+			for (size_t i = 0; i < parts.size(); ++i)
+				combine(fingerprint, parts[i]);
+		}
+		fingerprints[pConcept] = fingerprint;
+		pending.pop_back();
+	}
+
+	// The concepts are a conjunction too, and the order of the roles does
+	// not matter either
+	operands.clear();
+	for (size_t i = 0; i < concepts.size(); ++i)
+	{
+		if (concepts[i]->getType() == Concept::TYPE_CONJUNCTION)
+			collectOperands(concepts[i], operands);
+		else
+			operands.push_back(concepts[i]);
+	}
+	vector<Fingerprint> parts;
+	for (size_t i = 0; i < operands.size(); ++i)
+		parts.push_back(fingerprints[operands[i]]);
+	sort(parts.begin(), parts.end());
+	parts.erase(unique(parts.begin(), parts.end()), parts.end());
+	vector<Fingerprint> roles;
+	for (set<Symbol>::const_iterator it = transitiveRoles.begin(); it != transitiveRoles.end(); ++it)
+		roles.push_back(hashName(symbolDictionary.toName(*it)));
+	sort(roles.begin(), roles.end());
+	Fingerprint fingerprint = makeFingerprint(parts.size());
+	for (size_t i = 0; i < parts.size(); ++i)
+		combine(fingerprint, parts[i]);
+	combine(fingerprint, makeFingerprint(roles.size()));
+	for (size_t i = 0; i < roles.size(); ++i)
+		combine(fingerprint, roles[i]);
+	return fingerprint;
+}
+
+ResultCache::ResultCache(const std::string& fileName) :
+mFileName(fileName), mLogFile(-1), mIndexFile(-1)
+{
+#ifdef _WIN32
+	throw Exception("The result cache is not supported on this platform.");
+#else
+	mLogFile = open(fileName.c_str(), O_RDWR | O_CREAT, 0666);
+	if (mLogFile >= 0)
+		mIndexFile = open((fileName + ".index").c_str(), O_RDWR | O_CREAT, 0666);
+	if (mIndexFile < 0)
+	{
+		if (mLogFile >= 0)
+			close(mLogFile);
+		throw Exception("Cannot open result cache file \"" + fileName + "\".");
+	}
+
+	// The first process to open the log writes its header
+	bool valid;
+	{
+		Lock lock(mLogFile, LOCK_EX);
+		char magic[sizeof (LOG_MAGIC) - 1];
+		if (getFileSize(mLogFile) == 0)
+		{
+			writeAt(mLogFile, LOG_MAGIC, LOG_HEADER_SIZE, 0);
+			valid = true;
+		} else
+			valid = readAt(mLogFile, magic, sizeof (magic), 0) && memcmp(magic, LOG_MAGIC, sizeof (magic)) == 0;
+	}
+	if (!valid)
+	{
+		close(mLogFile);
+		close(mIndexFile);
+		throw Exception("\"" + fileName + "\" is not a result cache file.");
+	}
+#endif
+}
+
+ResultCache::~ResultCache()
+{
+#ifndef _WIN32
+	close(mLogFile);
+	close(mIndexFile);
+#endif
+}
+
+bool ResultCache::find(const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result& result) const
+{
+	Lock lock(mLogFile, LOCK_SH);
+	// What the index does not cover yet is looked for in the log itself
+	uint64_t logSize = getLogSize();
+	IndexHeader header;
+	if (readIndexHeader(header) && header.indexedSize <= logSize)
+		return findInIndex(header, tbox, query, result) || findInLog(header.indexedSize, logSize, tbox, query, result);
+	return findInLog(LOG_HEADER_SIZE, logSize, tbox, query, result);
+}
+
+void ResultCache::store(const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result result)
+{
+	if (result == Reasoner::RESULT_UNKNOWN)
+		return;
+	Lock lock(mLogFile, LOCK_EX);
+	IndexHeader header;
+	updateIndex(header);
+	// Another process may have stored it meanwhile
+	Reasoner::Result knownResult;
+	if (findInIndex(header, tbox, query, knownResult))
+		return;
+
+	char record[RECORD_SIZE];
+	writeHex(record, tbox.first);
+	writeHex(record + 16, tbox.second);
+	record[32] = ' ';
+	writeHex(record + 33, query.first);
+	writeHex(record + 49, query.second);
+	record[65] = ' ';
+	record[66] = result == Reasoner::RESULT_SATISFIABLE ? 'S' : 'U';
+	record[67] = '\n';
+#ifndef _WIN32
+	writeAt(mLogFile, record, RECORD_SIZE, header.indexedSize);
+#endif
+	// The header goes last, a process dying before that leaves records that
+	// are indexed again, harmlessly, by the next writer
+	insertIntoIndex(header, getTag(tbox, query), header.indexedSize);
+	header.indexedSize += RECORD_SIZE;
+	writeIndexHeader(header);
+}
+
+bool ResultCache::readIndexHeader(IndexHeader& header) const
+{
+#ifdef _WIN32
+	return false;
+#else
+	return readAt(mIndexFile, &header, sizeof (header), 0) && memcmp(header.magic, INDEX_MAGIC, sizeof (INDEX_MAGIC)) == 0 &&
+		header.slotCount >= MIN_SLOT_COUNT && (header.slotCount & (header.slotCount - 1)) == 0 &&
+		header.indexedSize >= LOG_HEADER_SIZE && (header.indexedSize - LOG_HEADER_SIZE) % RECORD_SIZE == 0 &&
+		getFileSize(mIndexFile) == sizeof (header) + header.slotCount * sizeof (IndexSlot);
+#endif
+}
+
+uint64_t ResultCache::getLogSize() const
+{
+#ifdef _WIN32
+	return 0;
+#else
+	// Whole records only, the last one may still be being written
+	uint64_t size = getFileSize(mLogFile);
+	return size < LOG_HEADER_SIZE ? LOG_HEADER_SIZE : size - (size - LOG_HEADER_SIZE) % RECORD_SIZE;
+#endif
+}
+
+bool ResultCache::readRecord(uint64_t offset, Fingerprint& tbox, Fingerprint& query, Reasoner::Result& result) const
+{
+#ifdef _WIN32
+	return false;
+#else
+	char record[RECORD_SIZE];
+	return readAt(mLogFile, record, RECORD_SIZE, offset) && parseRecord(record, tbox, query, result);
+#endif
+}
+
+bool ResultCache::findInLog(uint64_t begin, uint64_t end, const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result& result) const
+{
+#ifndef _WIN32
+	vector<char> buffer(SCAN_RECORD_COUNT * RECORD_SIZE);
+	while (begin < end)
+	{
+		size_t size = (size_t) min<uint64_t>(buffer.size(), end - begin);
+		if (!readAt(mLogFile, &buffer[0], size, begin))
+			return false;
+		for (size_t offset = 0; offset < size; offset += RECORD_SIZE)
+		{
+			Fingerprint recordTbox, recordQuery;
+			if (parseRecord(&buffer[offset], recordTbox, recordQuery, result) && recordTbox == tbox && recordQuery == query)
+				return true;
+		}
+		begin += size;
+	}
+#endif
+	return false;
+}
+
+bool ResultCache::findInIndex(const IndexHeader& header, const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result& result) const
+{
+#ifndef _WIN32
+	uint64_t tag = getTag(tbox, query);
+	for (uint64_t i = tag & (header.slotCount - 1);; i = (i + 1) & (header.slotCount - 1))
+	{
+		IndexSlot slot;
+		if (!readAt(mIndexFile, &slot, sizeof (slot), sizeof (header) + i * sizeof (slot)) || !slot.first)
+			return false;
+		Fingerprint recordTbox, recordQuery;
+		if (slot.first == tag && slot.second < header.indexedSize && readRecord(slot.second, recordTbox, recordQuery, result) &&
+			recordTbox == tbox && recordQuery == query)
+			return true;
+	}
+#endif
+	return false;
+}
+
+void ResultCache::updateIndex(IndexHeader& header)
+{
+#ifndef _WIN32
+	// A record torn by a process that died while writing it is dropped
+	uint64_t end = getLogSize();
+	if (getFileSize(mLogFile) != end && ftruncate(mLogFile, end) < 0)
+		throw Exception("Cannot write the result cache.");
+
+	// Room at half load for every record of the log and the one to store,
+	// the index being rebuilt from the log when short of it
+	bool valid = readIndexHeader(header) && header.indexedSize <= end;
+	uint64_t recordCount = valid ? header.recordCount + (end - header.indexedSize) / RECORD_SIZE : (end - LOG_HEADER_SIZE) / RECORD_SIZE;
+	if (!valid || (recordCount + 1) * 2 > header.slotCount)
+	{
+		uint64_t slotCount = MIN_SLOT_COUNT;
+		while (slotCount < (recordCount + 1) * 4)
+			slotCount *= 2;
+		rebuildIndex(header, slotCount);
+	}
+
+	vector<char> buffer(SCAN_RECORD_COUNT * RECORD_SIZE);
+	while (header.indexedSize < end)
+	{
+		size_t size = (size_t) min<uint64_t>(buffer.size(), end - header.indexedSize);
+		if (!readAt(mLogFile, &buffer[0], size, header.indexedSize))
+			throw Exception("Cannot read the result cache.");
+		for (size_t offset = 0; offset < size; offset += RECORD_SIZE)
+		{
+			Fingerprint tbox, query;
+			Reasoner::Result result;
+			if (parseRecord(&buffer[offset], tbox, query, result))
+				insertIntoIndex(header, getTag(tbox, query), header.indexedSize + offset);
+		}
+		header.indexedSize += size;
+	}
+	writeIndexHeader(header);
+#endif
+}
+
+void ResultCache::insertIntoIndex(IndexHeader& header, uint64_t tag, uint64_t offset)
+{
+#ifndef _WIN32
+	for (uint64_t i = tag & (header.slotCount - 1);; i = (i + 1) & (header.slotCount - 1))
+	{
+		IndexSlot slot;
+		uint64_t slotOffset = sizeof (header) + i * sizeof (slot);
+		if (!readAt(mIndexFile, &slot, sizeof (slot), slotOffset))
+			throw Exception("Cannot read the result cache.");
+		if (slot.first && slot.second == offset)
+			return;
+		if (!slot.first)
+		{
+			slot = IndexSlot(tag, offset);
+			writeAt(mIndexFile, &slot, sizeof (slot), slotOffset);
+			++header.recordCount;
+			return;
+		}
+	}
+#endif
+}
+
+void ResultCache::rebuildIndex(IndexHeader& header, uint64_t slotCount)
+{
+#ifndef _WIN32
+	memcpy(header.magic, INDEX_MAGIC, sizeof (INDEX_MAGIC));
+	header.slotCount = slotCount;
+	header.recordCount = 0;
+	header.indexedSize = LOG_HEADER_SIZE;
+	// Truncated first so that every slot reads back as free
+	if (ftruncate(mIndexFile, 0) < 0 || ftruncate(mIndexFile, sizeof (header) + slotCount * sizeof (IndexSlot)) < 0)
+		throw Exception("Cannot write the result cache.");
+	writeIndexHeader(header);
+#endif
+}
+
+void ResultCache::writeIndexHeader(const IndexHeader& header)
+{
+#ifndef _WIN32
+	writeAt(mIndexFile, &header, sizeof (header), 0);
+#endif
+}
+
+}
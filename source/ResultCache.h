@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include "Reasoner.h"
+#include <stdint.h>
+
+namespace tinyreason
+{
+
+/**
+ * Definitive answers kept on disk, so that the same question asked again by
+ * another process, or after a restart, is not checked again. An answer is
+ * keyed by the fingerprint of the Tbox and that of the query: structural
+ * hashes of the concepts, made of symbol names rather than IDs so they are
+ * the same in every process, and indifferent to the order of the axioms, of
+ * the concepts queried and to the order and grouping of the operands of
+ * conjunctions and disjunctions, which are flattened and sorted.
+ *
+ * The file named is an append-only log of fixed size text records, one per
+ * answer. "<fileName>.index" is an open addressing hash table of their
+ * offsets, which can always be rebuilt from the log: it records how much of
+ * the log it covers, so the records appended by a process that died before
+ * indexing them are indexed by the next writer. Lookups hold a shared flock
+ * on the log and writes an exclusive one, so worker processes on the same
+ * host can share the files. An instance is not to be shared between threads.
+ */
+class ResultCache {
+public:
+	typedef std::pair<uint64_t, uint64_t> Fingerprint;
+
+	static Fingerprint getFingerprint(const SymbolDictionary& symbolDictionary, const std::vector<const Concept*>& concepts,
+		const std::set<Symbol>& transitiveRoles = std::set<Symbol>());
+
+	ResultCache(const std::string& fileName);
+	~ResultCache();
+	const std::string& getFileName() const {
+		return mFileName;
+	}
+	bool find(const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result& result) const;
+	// Unknown results are not stored
+	void store(const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result result);
+private:
+	struct IndexHeader;
+	class Lock;
+
+	// Not copyable, it owns the files
+	ResultCache(const ResultCache&);
+	ResultCache& operator=(const ResultCache&);
+
+	bool readIndexHeader(IndexHeader& header) const;
+	uint64_t getLogSize() const;
+	bool readRecord(uint64_t offset, Fingerprint& tbox, Fingerprint& query, Reasoner::Result& result) const;
+	bool findInLog(uint64_t begin, uint64_t end, const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result& result) const;
+	bool findInIndex(const IndexHeader& header, const Fingerprint& tbox, const Fingerprint& query, Reasoner::Result& result) const;
+	void updateIndex(IndexHeader& header);
+	void insertIntoIndex(IndexHeader& header, uint64_t tag, uint64_t offset);
+	void rebuildIndex(IndexHeader& header, uint64_t slotCount);
+	void writeIndexHeader(const IndexHeader& header);
+
+	std::string mFileName;
+	int mLogFile;
+	int mIndexFile;
+};
+
+}
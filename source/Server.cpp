@@ -0,0 +1,349 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "Server.h"
+#include "Concept.h"
+#include "Model.h"
+#include <new>
+#include <cstring>
+#include <cerrno>
+#ifndef _WIN32
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace std;
+
+namespace tinyreason
+{
+
+Server::Server(const SymbolDictionary* pSymbolDictionary, const ConceptManager* pConceptManager, const Reasoner* pReasoner) :
+mpSymbolDictionary(pSymbolDictionary),
+mpConceptManager(pConceptManager),
+mpReasoner(pReasoner),
+mpResultCache(0),
+mRequestCount(0) { }
+
+void Server::setResultCache(ResultCache* pResultCache)
+{
+	mpResultCache = pResultCache;
+	if (mpResultCache)
+		mTboxFingerprint = ResultCache::getFingerprint(*mpSymbolDictionary, mpReasoner->getTboxConcepts());
+}
+
+void Server::serve(std::istream& inStream, std::ostream& outStream)
+{
+	string request;
+	while (getline(inStream, request))
+	{
+		if (request.empty() || request[0] == '#')
+			continue;
+		handleRequest(request, outStream);
+		outStream.flush();
+	}
+}
+
+void Server::serveUnixSocket(const std::string& path)
+{
+#ifdef _WIN32
+	throw Exception("Unix domain sockets are not supported on this platform.");
+#else
+	sockaddr_un address;
+	memset(&address, 0, sizeof (address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof (address.sun_path))
+		throw Exception("Socket path \"" + path + "\" is too long.");
+	strcpy(address.sun_path, path.c_str());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		throw Exception("Cannot create socket.");
+	unlink(path.c_str());
+	if (bind(listener, (sockaddr*) & address, sizeof (address)) < 0 || listen(listener, 16) < 0)
+	{
+		close(listener);
+		throw Exception("Cannot listen on socket \"" + path + "\".");
+	}
+	// A client going away must not take the server down with it
+	signal(SIGPIPE, SIG_IGN);
+
+	// Clients are multiplexed, each one with the bytes received but not yet
+	// making up a whole line.
+	vector<pollfd> fds(1);
+	vector<string> pending(1);
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+	char buffer[4096];
+	do
+	{
+		for (size_t i = 0; i < fds.size(); ++i)
+			fds[i].revents = 0;
+		if (poll(&fds[0], fds.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[0].revents & POLLIN)
+		{
+			int client = accept(listener, 0, 0);
+			if (client >= 0)
+			{
+				pollfd clientfd = {client, POLLIN, 0};
+				fds.push_back(clientfd);
+				pending.push_back("");
+			}
+		}
+		for (size_t i = 1; i < fds.size(); ++i)
+		{
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			ssize_t count = read(fds[i].fd, buffer, sizeof (buffer));
+			bool connected = count > 0;
+			if (connected)
+			{
+				pending[i].append(buffer, count);
+				size_t end;
+				while (connected && (end = pending[i].find('\n')) != string::npos)
+				{
+					string request = pending[i].substr(0, end);
+					pending[i].erase(0, end + 1);
+					if (request.empty() || request[0] == '#')
+						continue;
+					ostringstream response;
+					handleRequest(request, response);
+					const string& bytes = response.str();
+					for (size_t written = 0; connected && written < bytes.size();)
+					{
+						ssize_t n = write(fds[i].fd, bytes.data() + written, bytes.size() - written);
+						connected = n > 0;
+						written += connected ? n : 0;
+					}
+				}
+			}
+			if (!connected)
+			{
+				close(fds[i].fd);
+				fds.erase(fds.begin() + i);
+				pending.erase(pending.begin() + i);
+				--i;
+			}
+		}
+	} while (true);
+	close(listener);
+	unlink(path.c_str());
+#endif
+}
+
+void Server::handleRequest(const std::string& request, std::ostream& outStream)
+{
+	size_t requestID = ++mRequestCount;
+	outStream << "BEGIN " << requestID << "\n";
+	// The concepts of the request are deleted once it is answered, the Tbox stays
+	size_t epoch = mpConceptManager->beginEpoch();
+	try
+	{
+		// Written once complete, so a failing request answers with the error alone
+		ostringstream response;
+		unsigned long long startTime = getMicroseconds();
+
+		istringstream requestStream(request);
+		string options, conceptString;
+		requestStream >> options;
+		getline(requestStream, conceptString);
+		Reasoner::Limits limits = mDefaultLimits;
+		if (options.find(',') != string::npos)
+		{
+			limits.parse(options.substr(options.find(',') + 1));
+			options.erase(options.find(','));
+		}
+
+		bool printExampleModelStructure = false,
+			verbose = false,
+			showParsedResult = false,
+			showComplexConcepts = false,
+			dumpToDOT = false,
+			useConceptIDs = false,
+			printJSONModel = false,
+			explainUnsatisfiability = false;
+		for (size_t i = 0; i < options.size(); ++i)
+		{
+			switch (options[i])
+			{
+				case 'e':
+					printExampleModelStructure = true;
+					break;
+				case 'v':
+					verbose = true;
+					break;
+				case 'p':
+					showParsedResult = true;
+					break;
+				case 'c':
+					showComplexConcepts = true;
+					break;
+				case 'D':
+					dumpToDOT = true;
+					break;
+				case 'i':
+					useConceptIDs = true;
+					break;
+				case 'j':
+					printJSONModel = true;
+					break;
+				case 'x':
+					explainUnsatisfiability = true;
+					break;
+			}
+		}
+
+		vector<const Concept*> concepts;
+		vector<Symbol> transitiveRoles;
+		mpConceptManager->parseAssertions(conceptString, concepts, transitiveRoles);
+
+		// Transitive roles given with the request only hold for it
+		Reasoner reasoner(*mpReasoner);
+		reasoner.setTransitiveRoles(transitiveRoles);
+		ostringstream log;
+		reasoner.setLogStream(log);
+
+		Model example;
+		Reasoner::Statistics statistics;
+		Reasoner::Result result;
+		// A cached answer will do unless the request must show how it got there
+		ResultCache::Fingerprint queryFingerprint;
+		bool cached = false;
+		if (mpResultCache)
+		{
+			queryFingerprint = ResultCache::getFingerprint(*mpSymbolDictionary, concepts, reasoner.getTransitiveRoles());
+			cached = !verbose && mpResultCache->find(mTboxFingerprint, queryFingerprint, result) && (result == Reasoner::RESULT_SATISFIABLE ?
+				!printExampleModelStructure && !dumpToDOT && !printJSONModel : !explainUnsatisfiability);
+		}
+		if (!cached)
+		{
+			result = reasoner.checkSatisfiability(concepts, limits, &example, verbose, &statistics);
+			if (mpResultCache)
+				mpResultCache->store(mTboxFingerprint, queryFingerprint, result);
+		}
+		bool satisfiable = result == Reasoner::RESULT_SATISFIABLE;
+
+		if (result == Reasoner::RESULT_UNKNOWN)
+			response << "RESULT UNKNOWN " << Reasoner::getLimitName(statistics.limitReached) << "\n";
+		else
+			response << "RESULT " << (satisfiable ? "SATISFIABLE" : "UNSATISFIABLE") << "\n";
+		response << "TIME " << getMicroseconds() - startTime << "\n";
+		response << "STATS completeTrees=" << statistics.completeTreeCount << " incompleteTrees=" << statistics.incompleteTreeCount <<
+		   " createdTrees=" << statistics.createdTreeCount << " expansions=" << statistics.expansionCount <<
+		   " clashes=" << statistics.clashCount << " duplications=" << statistics.duplicationCount <<
+		   " createdNodes=" << statistics.createdNodeCount << " peakOpenTrees=" << statistics.peakOpenTreeCount <<
+		   " peakBytes=" << statistics.peakByteCount << " evictedTrees=" << statistics.evictedTreeCount <<
+		   " conceptBytes=" << statistics.conceptByteCount << " learnedNogoods=" << statistics.learnedNogoodCount <<
+		   " nogoodClashes=" << statistics.nogoodClashCount;
+		if (mpResultCache)
+			response << " cached=" << cached;
+		response << "\n";
+		// Shared by the parsed concepts and the models, each concept is rendered once
+		ConceptWriter writer(*mpSymbolDictionary, useConceptIDs);
+		if (showParsedResult)
+			for (size_t i = 0; i < concepts.size(); ++i)
+			{
+				ostringstream parsed;
+				writer.write(parsed, concepts[i]);
+				writeTagged(response, "PARSED", parsed.str());
+			}
+		writeTagged(response, "LOG", log.str());
+		if (satisfiable && printExampleModelStructure)
+		{
+			ostringstream model;
+			example.dumpToString(writer, model, showComplexConcepts);
+			writeTagged(response, "MODEL", model.str());
+		}
+		if (satisfiable && dumpToDOT)
+		{
+			ostringstream model;
+			example.dumpToDOT(writer, model, showComplexConcepts);
+			writeTagged(response, "DOT", model.str());
+		}
+		if (satisfiable && printJSONModel)
+		{
+			ostringstream model;
+			CompactModel(example, writer).writeJSON(model);
+			writeTagged(response, "JSON", model.str());
+		}
+		if (result == Reasoner::RESULT_UNSATISFIABLE && explainUnsatisfiability)
+		{
+			Reasoner::Explanation explanation;
+			reasoner.explain(concepts, limits, explanation);
+			ostringstream text;
+			for (size_t i = 0; i < explanation.tboxAxioms.size(); ++i)
+			{
+				text << "tbox " << explanation.tboxAxioms[i] << " ";
+				writer.write(text, reasoner.getTboxConcepts()[explanation.tboxAxioms[i]]);
+				text << "\n";
+			}
+			for (size_t i = 0; i < explanation.concepts.size(); ++i)
+			{
+				text << "concept " << explanation.concepts[i] << " ";
+				writer.write(text, concepts[explanation.concepts[i]]);
+				text << "\n";
+			}
+			writeTagged(response, "EXPLANATION", text.str());
+		}
+		outStream << response.str();
+	} catch (Exception& e)
+	{
+		outStream << "RESULT ERROR " << e.what() << "\n";
+	} catch (std::bad_alloc&)
+	{
+		// What the request allocated is freed with it, the next ones may fit
+		outStream << "RESULT ERROR Out of memory.\n";
+	} catch (std::exception& e)
+	{
+		outStream << "RESULT ERROR " << e.what() << "\n";
+	}
+	mpConceptManager->endEpoch(epoch);
+	outStream << "END " << requestID << "\n";
+}
+
+void Server::writeTagged(std::ostream& outStream, const char* tag, const std::string& text)
+{
+	size_t begin = 0;
+	while (begin < text.size())
+	{
+		size_t end = text.find('\n', begin);
+		if (end == string::npos)
+			end = text.size();
+		outStream << tag << " " << text.substr(begin, end - begin) << "\n";
+		begin = end + 1;
+	}
+}
+
+}
@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include "SymbolDictionary.h"
+#include "ConceptManager.h"
+#include "Reasoner.h"
+#include "ResultCache.h"
+
+namespace tinyreason
+{
+
+/**
+ * Answers satisfiability queries against a Tbox loaded once, over a line
+ * protocol. Every request is a single line made of the options (as on the
+ * command line, or '-') followed by the concepts to test:
+ *
+ *     ev Man and hasChild some Woman
+ *
+ * Every response is a frame of tagged lines:
+ *
+ *     BEGIN <request number>
+ *     RESULT SATISFIABLE | UNSATISFIABLE | UNKNOWN <limit> | ERROR <message>
+ *     TIME <microseconds>
+ *     STATS <name>=<value> ...
+ *     PARSED | LOG | MODEL | DOT <text>    (as asked by the options)
+ *     END <request number>
+ *
+ * The options may be followed by limits overriding the server's defaults for
+ * this request, as on the command line ("e,time=100,trees=5000"). A request
+ * stopped by a limit is answered UNKNOWN with the statistics gathered so far.
+ *
+ * With a ResultCache, a request whose answer is cached and that asks for no
+ * log, model or explanation is not checked; its STATS line then ends with
+ * "cached=1", and with "cached=0" otherwise.
+ *
+ * Requests are answered in order, so clients may pipeline them.
+ */
+class Server {
+public:
+	Server(const SymbolDictionary* pSymbolDictionary, const ConceptManager* pConceptManager, const Reasoner* pReasoner);
+	void serve(std::istream& inStream, std::ostream& outStream);
+	void serveUnixSocket(const std::string& path);
+	void setDefaultLimits(const Reasoner::Limits& limits) {
+		mDefaultLimits = limits;
+	}
+	void setResultCache(ResultCache* pResultCache);
+private:
+	void handleRequest(const std::string& request, std::ostream& outStream);
+	static void writeTagged(std::ostream& outStream, const char* tag, const std::string& text);
+
+	const SymbolDictionary* mpSymbolDictionary;
+	const ConceptManager* mpConceptManager;
+	const Reasoner* mpReasoner;
+	Reasoner::Limits mDefaultLimits;
+	ResultCache* mpResultCache;
+	ResultCache::Fingerprint mTboxFingerprint;
+	size_t mRequestCount;
+};
+
+}
@@ -0,0 +1,633 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "Snapshot.h"
+#include "Concept.h"
+#include "ConceptManager.h"
+#include "SymbolDictionary.h"
+#include <cstring>
+#include <new>
+#include <stdint.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+namespace tinyreason
+{
+
+namespace
+{
+const char SNAPSHOT_MAGIC[8] = {'T', 'R', 'S', 'N', 'A', 'P', 0, 0};
+const uint32_t SNAPSHOT_VERSION = 3;
+
+// The address every snapshot is laid out for. It must be the same in every
+// process mapping the file since concepts point to each other directly.
+const uintptr_t SNAPSHOT_BASE_ADDRESS = sizeof (void*) == 8 ? (uintptr_t) 0x2a0000000000ULL : (uintptr_t) 0x50000000UL;
+
+// Concept slots reserved for the built-in concepts
+const size_t BOTTOM_CONCEPT_INDEX = 0;
+const size_t TOP_CONCEPT_INDEX = 1;
+
+enum SectionIndex {
+	SECTION_SYMBOL_NAME_OFFSETS, // uint64_t[symbol count + 1], offsets into SECTION_SYMBOL_NAMES
+	SECTION_SYMBOL_NAMES, // zero terminated names
+	SECTION_SYMBOLS_BY_NAME, // Symbol[], sorted by name
+	SECTION_CONCEPTS, // Concept[]
+	SECTION_POSITIVE_ATOMIC_CONCEPTS, // const Concept*[], sorted by symbol
+	SECTION_NEGATIVE_ATOMIC_CONCEPTS, // const Concept*[], sorted by symbol
+	SECTION_CONJUNCTIONS, // const Concept*[], sorted by (concept 1, concept 2)
+	SECTION_DISJUNCTIONS, // const Concept*[], sorted by (concept 1, concept 2)
+	SECTION_EXISTENTIAL_RESTRICTIONS, // const Concept*[], sorted by (role, qualification)
+	SECTION_UNIVERSAL_RESTRICTIONS, // const Concept*[], sorted by (role, qualification)
+	SECTION_TBOX, // const Concept*[]
+	SECTION_TRANSITIVE_ROLES, // Symbol[]
+	SECTION_COUNT
+};
+
+typedef pair<uintptr_t, uintptr_t> ConceptKey;
+
+ConceptKey getConceptKey(const Concept* pConcept)
+{
+	switch (pConcept->getType())
+	{
+		case Concept::TYPE_POSITIVE_ATOMIC:
+		case Concept::TYPE_NEGATIVE_ATOMIC:
+			return ConceptKey(pConcept->getSymbol(), 0);
+		case Concept::TYPE_CONJUNCTION:
+		case Concept::TYPE_DISJUNCTION:
+			return ConceptKey((uintptr_t) pConcept->getConcept1(), (uintptr_t) pConcept->getConcept2());
+		default:
+			return ConceptKey(pConcept->getRole(), (uintptr_t) pConcept->getQualificationConcept());
+	}
+}
+
+struct CompareConceptKeys {
+	bool operator()(const Concept* pConcept1, const Concept* pConcept2) const {
+		return getConceptKey(pConcept1) < getConceptKey(pConcept2);
+	}
+	bool operator()(const Concept* pConcept, const ConceptKey& key) const {
+		return getConceptKey(pConcept) < key;
+	}
+};
+
+struct CompareSymbolNames {
+	const uint64_t* pOffsets;
+	const char* pNames;
+	bool operator()(Symbol symbol1, Symbol symbol2) const {
+		return strcmp(pNames + pOffsets[symbol1], pNames + pOffsets[symbol2]) < 0;
+	}
+	bool operator()(Symbol symbol, const string& name) const {
+		return strcmp(pNames + pOffsets[symbol], name.c_str()) < 0;
+	}
+};
+
+// The size of the elements counted by each section
+size_t getElementSize(size_t section)
+{
+	switch (section)
+	{
+		case SECTION_SYMBOL_NAME_OFFSETS:
+			return sizeof (uint64_t);
+		case SECTION_SYMBOL_NAMES:
+			return 1;
+		case SECTION_SYMBOLS_BY_NAME:
+		case SECTION_TRANSITIVE_ROLES:
+			return sizeof (Symbol);
+		case SECTION_CONCEPTS:
+			return sizeof (Concept);
+		default:
+			return sizeof (const Concept*);
+	}
+}
+
+size_t align(size_t offset)
+{
+	return (offset + 7) & ~(size_t) 7;
+}
+
+// FNV-1a, so that damage leaving the sections well formed is noticed as well
+uint64_t getChecksum(const char* pData, size_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ (unsigned char) pData[i]) * 1099511628211ULL;
+	return hash;
+}
+
+// Returns the address the given concept will have once the snapshot is mapped
+const Concept* relocate(const Concept* pConcept, const map<const Concept*, size_t>& conceptIndices, uintptr_t conceptsAddress)
+{
+	size_t index;
+	if (pConcept->isTop())
+		index = TOP_CONCEPT_INDEX;
+	else if (pConcept->isBottom())
+		index = BOTTOM_CONCEPT_INDEX;
+	else
+		index = conceptIndices.find(pConcept)->second;
+	return (const Concept*) (conceptsAddress + index * sizeof (Concept));
+}
+}
+
+struct Snapshot::Section {
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct Snapshot::Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t pointerSize;
+	uint32_t conceptSize;
+	uint32_t sectionCount;
+	uint64_t baseAddress;
+	uint64_t fileSize;
+	uint64_t checksum; // of everything after the header
+	Section sections[SECTION_COUNT];
+};
+
+void Snapshot::write(const std::string& fileName, const SymbolDictionary& symbolDictionary, const ConceptManager& conceptManager,
+	const std::vector<const Concept*>& tbox, const std::vector<Symbol>& transitiveRoles)
+{
+	// Number every concept reachable from the concept manager caches and from
+	// the tbox, subconcepts first so that opening can rule out cycles in one
+	// pass. Built-in concepts take the reserved slots.
+	vector<const Concept*> concepts(2);
+	concepts[BOTTOM_CONCEPT_INDEX] = Concept::getBottomConcept();
+	concepts[TOP_CONCEPT_INDEX] = Concept::getTopConcept();
+	map<const Concept*, size_t> conceptIndices;
+
+	vector<const Concept*> stack(tbox.begin(), tbox.end());
+	const ConceptManager::SymbolToConceptMap * atomicMaps[] = {&conceptManager.mPositiveAtomicConcepts, &conceptManager.mNegativeAtomicConcepts};
+	for (size_t i = 0; i < 2; ++i)
+		for (ConceptManager::SymbolToConceptMap::const_iterator it = atomicMaps[i]->begin(); it != atomicMaps[i]->end(); ++it)
+			stack.push_back(it->second);
+	const ConceptManager::ConceptPairToConceptMap * pairMaps[] = {&conceptManager.mConjunctionConcepts, &conceptManager.mDisjunctionConcepts};
+	for (size_t i = 0; i < 2; ++i)
+		for (ConceptManager::ConceptPairToConceptMap::const_iterator it = pairMaps[i]->begin(); it != pairMaps[i]->end(); ++it)
+			stack.push_back(it->second);
+	const ConceptManager::SymbolConceptPairToConceptMap * restrictionMaps[] = {&conceptManager.mExistentialConcepts, &conceptManager.mUniversalConcepts};
+	for (size_t i = 0; i < 2; ++i)
+		for (ConceptManager::SymbolConceptPairToConceptMap::const_iterator it = restrictionMaps[i]->begin(); it != restrictionMaps[i]->end(); ++it)
+			stack.push_back(it->second);
+	if (conceptManager.mpSnapshot)
+	{
+		const Snapshot* pSource = conceptManager.mpSnapshot;
+		const Concept* pSourceConcepts = pSource->getSection<Concept>(SECTION_CONCEPTS);
+		for (size_t i = 0; i < pSource->getConceptCount(); ++i)
+			stack.push_back(pSourceConcepts + i);
+	}
+
+	while (!stack.empty())
+	{
+		const Concept* pConcept = stack.back();
+		if (pConcept->isTop() || pConcept->isBottom() || conceptIndices.find(pConcept) != conceptIndices.end())
+		{
+			stack.pop_back();
+			continue;
+		}
+		size_t pending = stack.size();
+		switch (pConcept->getType())
+		{
+			case Concept::TYPE_CONJUNCTION:
+			case Concept::TYPE_DISJUNCTION:
+				stack.push_back(pConcept->getConcept1());
+				stack.push_back(pConcept->getConcept2());
+				break;
+			case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+			case Concept::TYPE_UNIVERSAL_RESTRICTION:
+				stack.push_back(pConcept->getQualificationConcept());
+				break;
+			default:
+				break;
+		}
+		// Numbered once its subconcepts are, it is on top of the stack again by then
+		for (size_t i = pending; i < stack.size(); )
+		{
+			const Concept* pSubconcept = stack[i];
+			if (pSubconcept->isTop() || pSubconcept->isBottom() || conceptIndices.find(pSubconcept) != conceptIndices.end())
+				stack.erase(stack.begin() + i);
+			else
+				++i;
+		}
+		if (stack.size() == pending)
+		{
+			conceptIndices[pConcept] = concepts.size();
+			concepts.push_back(pConcept);
+			stack.pop_back();
+		}
+	}
+
+	// Symbol names
+	Symbol symbolCount = symbolDictionary.getSymbolCount();
+	string names;
+	vector<uint64_t> nameOffsets;
+	for (Symbol s = 0; s < symbolCount; ++s)
+	{
+		nameOffsets.push_back(names.size());
+		names += symbolDictionary.toName(s);
+		names += '\0';
+	}
+	nameOffsets.push_back(names.size());
+
+	// Section layout
+	Header header;
+	memset(&header, 0, sizeof (header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof (SNAPSHOT_MAGIC));
+	header.version = SNAPSHOT_VERSION;
+	header.pointerSize = sizeof (void*);
+	header.conceptSize = sizeof (Concept);
+	header.sectionCount = SECTION_COUNT;
+	header.baseAddress = SNAPSHOT_BASE_ADDRESS;
+
+	vector<size_t> byType[6];
+	for (size_t i = 0; i < concepts.size(); ++i)
+		byType[concepts[i]->getType()].push_back(i);
+
+	size_t sectionSizes[SECTION_COUNT];
+	header.sections[SECTION_SYMBOL_NAME_OFFSETS].count = nameOffsets.size();
+	sectionSizes[SECTION_SYMBOL_NAME_OFFSETS] = nameOffsets.size() * sizeof (uint64_t);
+	header.sections[SECTION_SYMBOL_NAMES].count = names.size();
+	sectionSizes[SECTION_SYMBOL_NAMES] = names.size();
+	header.sections[SECTION_SYMBOLS_BY_NAME].count = symbolCount;
+	sectionSizes[SECTION_SYMBOLS_BY_NAME] = symbolCount * sizeof (Symbol);
+	header.sections[SECTION_CONCEPTS].count = concepts.size();
+	sectionSizes[SECTION_CONCEPTS] = concepts.size() * sizeof (Concept);
+	for (size_t t = 0; t < 6; ++t)
+	{
+		header.sections[SECTION_POSITIVE_ATOMIC_CONCEPTS + t].count = byType[t].size();
+		sectionSizes[SECTION_POSITIVE_ATOMIC_CONCEPTS + t] = byType[t].size() * sizeof (const Concept*);
+	}
+	header.sections[SECTION_TBOX].count = tbox.size();
+	sectionSizes[SECTION_TBOX] = tbox.size() * sizeof (const Concept*);
+	header.sections[SECTION_TRANSITIVE_ROLES].count = transitiveRoles.size();
+	sectionSizes[SECTION_TRANSITIVE_ROLES] = transitiveRoles.size() * sizeof (Symbol);
+
+	size_t offset = align(sizeof (Header));
+	for (size_t i = 0; i < SECTION_COUNT; ++i)
+	{
+		header.sections[i].offset = offset;
+		offset = align(offset + sectionSizes[i]);
+	}
+	header.fileSize = offset;
+
+	vector<char> image(offset, 0);
+	char* pImage = &image[0];
+	memcpy(pImage, &header, sizeof (header));
+	memcpy(pImage + header.sections[SECTION_SYMBOL_NAME_OFFSETS].offset, &nameOffsets[0], sectionSizes[SECTION_SYMBOL_NAME_OFFSETS]);
+	memcpy(pImage + header.sections[SECTION_SYMBOL_NAMES].offset, names.data(), names.size());
+
+	Symbol* pSymbolsByName = (Symbol*) (pImage + header.sections[SECTION_SYMBOLS_BY_NAME].offset);
+	for (Symbol s = 0; s < symbolCount; ++s)
+		pSymbolsByName[s] = s;
+	CompareSymbolNames compareNames = {&nameOffsets[0], names.c_str()};
+	sort(pSymbolsByName, pSymbolsByName + symbolCount, compareNames);
+
+	// Concepts are written as they'll be found once mapped, pointing to each
+	// other at their final addresses.
+	const uintptr_t conceptsAddress = SNAPSHOT_BASE_ADDRESS + header.sections[SECTION_CONCEPTS].offset;
+	Concept* pImageConcepts = (Concept*) (pImage + header.sections[SECTION_CONCEPTS].offset);
+	for (size_t i = 0; i < concepts.size(); ++i)
+	{
+		const Concept* pConcept = concepts[i];
+		switch (pConcept->getType())
+		{
+			case Concept::TYPE_POSITIVE_ATOMIC:
+			case Concept::TYPE_NEGATIVE_ATOMIC:
+				new (pImageConcepts + i) Concept(i, pConcept->getType() == Concept::TYPE_POSITIVE_ATOMIC, pConcept->getSymbol());
+				break;
+			case Concept::TYPE_CONJUNCTION:
+			case Concept::TYPE_DISJUNCTION:
+				new (pImageConcepts + i) Concept(i, pConcept->getType(),
+					relocate(pConcept->getConcept1(), conceptIndices, conceptsAddress),
+					relocate(pConcept->getConcept2(), conceptIndices, conceptsAddress));
+				break;
+			default:
+				new (pImageConcepts + i) Concept(i, pConcept->getType(), pConcept->getRole(),
+					relocate(pConcept->getQualificationConcept(), conceptIndices, conceptsAddress));
+				break;
+		}
+	}
+
+	// Lookup indices are sorted by the relocated keys, which is what lookups
+	// will compare against.
+	for (size_t t = 0; t < 6; ++t)
+	{
+		vector<const Concept*> sorted;
+		for (size_t i = 0; i < byType[t].size(); ++i)
+			sorted.push_back(pImageConcepts + byType[t][i]);
+		sort(sorted.begin(), sorted.end(), CompareConceptKeys());
+		const Concept** pIndex = (const Concept**) (pImage + header.sections[SECTION_POSITIVE_ATOMIC_CONCEPTS + t].offset);
+		for (size_t i = 0; i < sorted.size(); ++i)
+			pIndex[i] = (const Concept*) (conceptsAddress + (sorted[i] - pImageConcepts) * sizeof (Concept));
+	}
+
+	const Concept** pTbox = (const Concept**) (pImage + header.sections[SECTION_TBOX].offset);
+	for (size_t i = 0; i < tbox.size(); ++i)
+		pTbox[i] = relocate(tbox[i], conceptIndices, conceptsAddress);
+	if (!transitiveRoles.empty())
+		memcpy(pImage + header.sections[SECTION_TRANSITIVE_ROLES].offset, &transitiveRoles[0], sectionSizes[SECTION_TRANSITIVE_ROLES]);
+	((Header*) pImage)->checksum = getChecksum(pImage + sizeof (Header), image.size() - sizeof (Header));
+
+	ofstream file(fileName.c_str(), ios::binary | ios::trunc);
+	file.write(pImage, image.size());
+	if (!file)
+		throw Exception("Cannot write snapshot file \"" + fileName + "\".");
+}
+
+bool Snapshot::isSnapshotFile(const std::string& fileName)
+{
+	char magic[sizeof (SNAPSHOT_MAGIC)];
+	ifstream file(fileName.c_str(), ios::binary);
+	return file.read(magic, sizeof (magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof (magic)) == 0;
+}
+
+Snapshot::Snapshot(const std::string& fileName) :
+mpBase(0), mSize(0), mpHeader(0)
+{
+#ifdef _WIN32
+	throw Exception("Snapshots are not supported on this platform.");
+#else
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw Exception("Cannot open snapshot file \"" + fileName + "\".");
+
+	Header header;
+	if (pread(fd, &header, sizeof (header), 0) != (ssize_t) sizeof (header) || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof (SNAPSHOT_MAGIC)) != 0)
+	{
+		close(fd);
+		throw Exception("\"" + fileName + "\" is not a snapshot file.");
+	}
+	if (header.version != SNAPSHOT_VERSION || header.pointerSize != sizeof (void*) || header.conceptSize != sizeof (Concept) || header.sectionCount != SECTION_COUNT)
+	{
+		close(fd);
+		throw Exception("Snapshot file \"" + fileName + "\" was made by an incompatible build.");
+	}
+	// Every section must lie within the file, a truncated one would be read past its end
+	struct stat status;
+	bool complete = fstat(fd, &status) == 0 && header.fileSize == (uint64_t) status.st_size && header.fileSize >= sizeof (header);
+	for (size_t i = 0; complete && i < SECTION_COUNT; ++i)
+		complete = header.sections[i].offset >= sizeof (header) && header.sections[i].offset <= header.fileSize && header.sections[i].offset % 8 == 0 &&
+			header.sections[i].count <= (header.fileSize - header.sections[i].offset) / getElementSize(i);
+	if (!complete)
+	{
+		close(fd);
+		throw Exception("Snapshot file \"" + fileName + "\" is truncated or damaged.");
+	}
+
+	int flags = MAP_PRIVATE;
+#ifdef MAP_FIXED_NOREPLACE
+	flags |= MAP_FIXED_NOREPLACE;
+#endif
+	mSize = header.fileSize;
+	mpBase = mmap((void*) (uintptr_t) header.baseAddress, mSize, PROT_READ, flags, fd, 0);
+	close(fd);
+	if (mpBase == MAP_FAILED)
+	{
+		mpBase = 0;
+		throw Exception("Cannot map snapshot file \"" + fileName + "\" at its base address.");
+	}
+	if ((uintptr_t) mpBase != header.baseAddress)
+	{
+		// The kernel took the address as a hint only and placed it elsewhere
+		munmap(mpBase, mSize);
+		mpBase = 0;
+		throw Exception("Cannot map snapshot file \"" + fileName + "\" at its base address.");
+	}
+	mpHeader = (const Header*) mpBase;
+	if (header.checksum != getChecksum((const char*) mpBase + sizeof (Header), mSize - sizeof (Header)) || !isValid())
+	{
+		munmap(mpBase, mSize);
+		mpBase = 0;
+		throw Exception("Snapshot file \"" + fileName + "\" is truncated or damaged.");
+	}
+#endif
+}
+
+Snapshot::~Snapshot()
+{
+#ifndef _WIN32
+	if (mpBase)
+		munmap(mpBase, mSize);
+#endif
+}
+
+template<class T>
+const T* Snapshot::getSection(size_t index) const
+{
+	return (const T*) ((const char*) mpBase + mpHeader->sections[index].offset);
+}
+
+size_t Snapshot::getSectionSize(size_t index) const
+{
+	return mpHeader->sections[index].count;
+}
+
+// One pass over the image: names end inside their section, symbols are in
+// range and every pointer is to a concept, a subconcept to an earlier one
+bool Snapshot::isValid() const
+{
+	Symbol symbolCount = getSymbolCount();
+	const uint64_t* pNameOffsets = getSection<uint64_t>(SECTION_SYMBOL_NAME_OFFSETS);
+	const char* pNames = getSection<char>(SECTION_SYMBOL_NAMES);
+	size_t namesSize = getSectionSize(SECTION_SYMBOL_NAMES);
+	if (getSectionSize(SECTION_SYMBOL_NAME_OFFSETS) != symbolCount + 1 || pNameOffsets[0] != 0 || pNameOffsets[symbolCount] != namesSize)
+		return false;
+	for (Symbol s = 0; s < symbolCount; ++s)
+		if (pNameOffsets[s] >= pNameOffsets[s + 1] || pNameOffsets[s + 1] > namesSize || pNames[pNameOffsets[s + 1] - 1] != '\0')
+			return false;
+	const Symbol* pSymbolsByName = getSection<Symbol>(SECTION_SYMBOLS_BY_NAME);
+	for (Symbol s = 0; s < symbolCount; ++s)
+		if (pSymbolsByName[s] >= symbolCount)
+			return false;
+
+	const Concept* pConcepts = getSection<Concept>(SECTION_CONCEPTS);
+	size_t conceptCount = getConceptCount();
+	if (conceptCount <= TOP_CONCEPT_INDEX || !pConcepts[BOTTOM_CONCEPT_INDEX].isBottom() || !pConcepts[TOP_CONCEPT_INDEX].isTop())
+		return false;
+	for (size_t i = 0; i < conceptCount; ++i)
+	{
+		const Concept& concept = pConcepts[i];
+		if (concept.getID() != i)
+			return false;
+		switch (concept.getType())
+		{
+			case Concept::TYPE_POSITIVE_ATOMIC:
+			case Concept::TYPE_NEGATIVE_ATOMIC:
+				if (concept.getSymbol() >= symbolCount)
+					return false;
+				break;
+			case Concept::TYPE_CONJUNCTION:
+			case Concept::TYPE_DISJUNCTION:
+				if (!isConcept(concept.getConcept1(), i) || !isConcept(concept.getConcept2(), i))
+					return false;
+				break;
+			case Concept::TYPE_EXISTENTIAL_RESTRICTION:
+			case Concept::TYPE_UNIVERSAL_RESTRICTION:
+				if (concept.getRole() >= symbolCount || !isConcept(concept.getQualificationConcept(), i))
+					return false;
+				break;
+			default:
+				return false;
+		}
+	}
+
+	// The lookup indices hold the concepts of their own type
+	for (size_t t = 0; t < 6; ++t)
+	{
+		const Concept* const* pIndex = getSection<const Concept*>(SECTION_POSITIVE_ATOMIC_CONCEPTS + t);
+		for (size_t i = 0; i < getSectionSize(SECTION_POSITIVE_ATOMIC_CONCEPTS + t); ++i)
+			if (!isConcept(pIndex[i], conceptCount) || (size_t) pIndex[i]->getType() != t)
+				return false;
+	}
+	const Concept* const* pTbox = getSection<const Concept*>(SECTION_TBOX);
+	for (size_t i = 0; i < getSectionSize(SECTION_TBOX); ++i)
+		if (!isConcept(pTbox[i], conceptCount))
+			return false;
+	const Symbol* pRoles = getSection<Symbol>(SECTION_TRANSITIVE_ROLES);
+	for (size_t i = 0; i < getSectionSize(SECTION_TRANSITIVE_ROLES); ++i)
+		if (pRoles[i] >= symbolCount)
+			return false;
+	return true;
+}
+
+// True when the pointer is to one of the first count concepts of the image
+bool Snapshot::isConcept(const Concept* pConcept, size_t count) const
+{
+	uintptr_t offset = (uintptr_t) pConcept - (uintptr_t) getSection<Concept>(SECTION_CONCEPTS);
+	return offset % sizeof (Concept) == 0 && offset / sizeof (Concept) < count;
+}
+
+Symbol Snapshot::getSymbolCount() const
+{
+	return getSectionSize(SECTION_SYMBOLS_BY_NAME);
+}
+
+bool Snapshot::findSymbol(const std::string& name, Symbol& symbol) const
+{
+	const Symbol* pBegin = getSection<Symbol>(SECTION_SYMBOLS_BY_NAME);
+	const Symbol* pEnd = pBegin + getSymbolCount();
+	CompareSymbolNames compareNames = {getSection<uint64_t>(SECTION_SYMBOL_NAME_OFFSETS), getSection<char>(SECTION_SYMBOL_NAMES)};
+	const Symbol* pFound = lower_bound(pBegin, pEnd, name, compareNames);
+	if (pFound == pEnd || name != getSymbolName(*pFound))
+		return false;
+	symbol = *pFound;
+	return true;
+}
+
+const char* Snapshot::getSymbolName(Symbol symbol) const
+{
+	return getSection<char>(SECTION_SYMBOL_NAMES) + getSection<uint64_t>(SECTION_SYMBOL_NAME_OFFSETS)[symbol];
+}
+
+size_t Snapshot::getConceptCount() const
+{
+	return getSectionSize(SECTION_CONCEPTS);
+}
+
+// A snapshot concept's ID is its index in the concept section
+const Concept* Snapshot::getConcept(ConceptID id) const
+{
+	if (id >= getConceptCount())
+		return 0;
+	return getSection<Concept>(SECTION_CONCEPTS) + id;
+}
+
+const Concept* Snapshot::findAtomicConcept(bool isPositive, Symbol symbol) const
+{
+	return findPair(isPositive ? SECTION_POSITIVE_ATOMIC_CONCEPTS : SECTION_NEGATIVE_ATOMIC_CONCEPTS, (const void*) symbol, 0);
+}
+
+const Concept* Snapshot::findConjunction(const Concept* pConcept1, const Concept* pConcept2) const
+{
+	const Concept* pConcept = findPair(SECTION_CONJUNCTIONS, pConcept1, pConcept2);
+	return pConcept ? pConcept : findPair(SECTION_CONJUNCTIONS, pConcept2, pConcept1);
+}
+
+const Concept* Snapshot::findDisjunction(const Concept* pConcept1, const Concept* pConcept2) const
+{
+	const Concept* pConcept = findPair(SECTION_DISJUNCTIONS, pConcept1, pConcept2);
+	return pConcept ? pConcept : findPair(SECTION_DISJUNCTIONS, pConcept2, pConcept1);
+}
+
+const Concept* Snapshot::findExistentialRestriction(Symbol role, const Concept* pQualificationConcept) const
+{
+	return findPair(SECTION_EXISTENTIAL_RESTRICTIONS, (const void*) role, pQualificationConcept);
+}
+
+const Concept* Snapshot::findUniversalRestriction(Symbol role, const Concept* pQualificationConcept) const
+{
+	return findPair(SECTION_UNIVERSAL_RESTRICTIONS, (const void*) role, pQualificationConcept);
+}
+
+const Concept* Snapshot::findPair(size_t index, const void* pFirst, const Concept* pSecond) const
+{
+	// Concepts in the snapshot refer to its own copies of the built-in concepts
+	const Concept* pConcepts = getSection<Concept>(SECTION_CONCEPTS);
+	if (index != SECTION_POSITIVE_ATOMIC_CONCEPTS && index != SECTION_NEGATIVE_ATOMIC_CONCEPTS)
+	{
+		if (index == SECTION_CONJUNCTIONS || index == SECTION_DISJUNCTIONS)
+		{
+			const Concept* pFirstConcept = (const Concept*) pFirst;
+			if (pFirstConcept->isTop())
+				pFirst = pConcepts + TOP_CONCEPT_INDEX;
+			else if (pFirstConcept->isBottom())
+				pFirst = pConcepts + BOTTOM_CONCEPT_INDEX;
+		}
+		if (pSecond->isTop())
+			pSecond = pConcepts + TOP_CONCEPT_INDEX;
+		else if (pSecond->isBottom())
+			pSecond = pConcepts + BOTTOM_CONCEPT_INDEX;
+	}
+
+	const Concept* const* pBegin = getSection<const Concept*>(index);
+	const Concept* const* pEnd = pBegin + getSectionSize(index);
+	ConceptKey key((uintptr_t) pFirst, (uintptr_t) pSecond);
+	const Concept* const* pFound = lower_bound(pBegin, pEnd, key, CompareConceptKeys());
+	if (pFound == pEnd || getConceptKey(*pFound) != key)
+		return 0;
+	return *pFound;
+}
+
+std::vector<const Concept*> Snapshot::getTboxConcepts() const
+{
+	const Concept* const* pTbox = getSection<const Concept*>(SECTION_TBOX);
+	return vector<const Concept*>(pTbox, pTbox + getSectionSize(SECTION_TBOX));
+}
+
+std::vector<Symbol> Snapshot::getTransitiveRoles() const
+{
+	const Symbol* pRoles = getSection<Symbol>(SECTION_TRANSITIVE_ROLES);
+	return vector<Symbol>(pRoles, pRoles + getSectionSize(SECTION_TRANSITIVE_ROLES));
+}
+
+}
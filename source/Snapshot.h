@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+
+namespace tinyreason
+{
+
+/**
+ * A precompiled knowledge base image. The file holds the symbol names, every
+ * concept interned by a ConceptManager, the Tbox and the transitive roles laid
+ * out exactly as they are in memory once the file is mapped at the base address
+ * recorded in its header. Opening a snapshot is therefore a single mmap and
+ * one pass checking the image is intact: there is nothing to parse and no
+ * pointer to fix up, and every process mapping the same file shares its
+ * physical pages.
+ *
+ * Concepts are looked up by binary search over per-type indices sorted by
+ * their components, so a ConceptManager or a SymbolDictionary built on top of a
+ * snapshot only interns what is not in the snapshot already. The snapshot must
+ * outlive all of them.
+ */
+class Snapshot {
+public:
+	static void write(const std::string& fileName, const SymbolDictionary& symbolDictionary, const ConceptManager& conceptManager,
+		const std::vector<const Concept*>& tbox, const std::vector<Symbol>& transitiveRoles);
+	static bool isSnapshotFile(const std::string& fileName);
+
+	Snapshot(const std::string& fileName);
+	~Snapshot();
+	Symbol getSymbolCount() const;
+	bool findSymbol(const std::string& name, Symbol& symbol) const;
+	const char* getSymbolName(Symbol symbol) const;
+	size_t getConceptCount() const;
+	const Concept* getConcept(ConceptID id) const;
+	const Concept* findAtomicConcept(bool isPositive, Symbol symbol) const;
+	const Concept* findConjunction(const Concept* pConcept1, const Concept* pConcept2) const;
+	const Concept* findDisjunction(const Concept* pConcept1, const Concept* pConcept2) const;
+	const Concept* findExistentialRestriction(Symbol role, const Concept* pQualificationConcept) const;
+	const Concept* findUniversalRestriction(Symbol role, const Concept* pQualificationConcept) const;
+	std::vector<const Concept*> getTboxConcepts() const;
+	std::vector<Symbol> getTransitiveRoles() const;
+private:
+	struct Header;
+	struct Section;
+
+	// Not copyable, it owns the mapping
+	Snapshot(const Snapshot&);
+	Snapshot& operator=(const Snapshot&);
+
+	template<class T>
+	const T* getSection(size_t index) const;
+	size_t getSectionSize(size_t index) const;
+	const Concept* findPair(size_t index, const void* pFirst, const Concept* pSecond) const;
+	bool isValid() const;
+	bool isConcept(const Concept* pConcept, size_t count) const;
+
+	void* mpBase;
+	size_t mSize;
+	const Header* mpHeader;
+};
+
+}
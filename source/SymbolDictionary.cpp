@@ -27,15 +27,23 @@
  ******************************************************************************/
 
 #include "SymbolDictionary.h"
+#include "Snapshot.h"
 
 using namespace std;
 
 namespace tinyreason
 {
 
-SymbolDictionary::SymbolDictionary() :
+SymbolDictionary::SymbolDictionary(const Snapshot* pSnapshot) :
+mpSnapshot(pSnapshot),
 mNextFreeSymbol(0)
 {
+	if (mpSnapshot)
+	{
+		// TOP and BOTTOM strings are already defined in the snapshot
+		mNextFreeSymbol = mpSnapshot->getSymbolCount();
+		return;
+	}
 	// Define TOP and BOTTOM strings
 	get("nothing");
 	get("thing");
@@ -45,7 +53,8 @@ SymbolDictionary::~SymbolDictionary() { }
 
 bool SymbolDictionary::isDefined(const std::string& name) const
 {
-	return mNameToSymbolMap.find(name) != mNameToSymbolMap.end();
+	Symbol symbol;
+	return mNameToSymbolMap.find(name) != mNameToSymbolMap.end() || (mpSnapshot && mpSnapshot->findSymbol(name, symbol));
 }
 
 Symbol SymbolDictionary::get(const std::string& name)
@@ -53,6 +62,9 @@ Symbol SymbolDictionary::get(const std::string& name)
 	NameToSymbolMap::const_iterator it = mNameToSymbolMap.find(name);
 	if (it == mNameToSymbolMap.end())
 	{
+		Symbol symbol;
+		if (mpSnapshot && mpSnapshot->findSymbol(name, symbol))
+			return symbol;
 		mNameToSymbolMap[name] = mNextFreeSymbol;
 		mSymbolToNameMap[mNextFreeSymbol] = name;
 		return mNextFreeSymbol++;
@@ -64,8 +76,12 @@ Symbol SymbolDictionary::toSymbol(const std::string& name) const
 {
 	NameToSymbolMap::const_iterator it = mNameToSymbolMap.find(name);
 	if (it == mNameToSymbolMap.end())
+	{
+		Symbol symbol;
+		if (mpSnapshot && mpSnapshot->findSymbol(name, symbol))
+			return symbol;
 		throw Exception("Undefined symbol \"" + name + "\".");
-	else
+	} else
 		return it->second;
 }
 
@@ -73,10 +89,23 @@ const std::string& SymbolDictionary::toName(Symbol symbol) const
 {
 	SymbolToNameMap::const_iterator it = mSymbolToNameMap.find(symbol);
 	if (it == mSymbolToNameMap.end())
+	{
+		if (mpSnapshot && symbol < mpSnapshot->getSymbolCount())
+			return mSymbolToNameMap[symbol] = mpSnapshot->getSymbolName(symbol);
 		throw Exception("Undefined symbol.");
-	else
+	} else
 		return it->second;
 }
 
+void SymbolDictionary::truncate(Symbol symbolCount)
+{
+	if (symbolCount >= mNextFreeSymbol)
+		return;
+	SymbolToNameMap::iterator first = mSymbolToNameMap.lower_bound(symbolCount);
+	for (SymbolToNameMap::iterator it = first; it != mSymbolToNameMap.end(); ++it)
+		mNameToSymbolMap.erase(it->second);
+	mSymbolToNameMap.erase(first, mSymbolToNameMap.end());
+	mNextFreeSymbol = symbolCount;
 }
 
+}
@@ -33,19 +33,28 @@
 namespace tinyreason
 {
 
+class Snapshot;
+
 class SymbolDictionary {
 public:
-	SymbolDictionary();
+	SymbolDictionary(const Snapshot* pSnapshot = 0);
 	virtual ~SymbolDictionary();
+	Symbol getSymbolCount() const {
+		return mNextFreeSymbol;
+	}
 	bool isDefined(const std::string& name) const;
 	Symbol get(const std::string& name);
 	Symbol toSymbol(const std::string& name) const;
 	const std::string & toName(Symbol symbol) const;
+	// Forgets the symbols from symbolCount on, which are handed out again
+	void truncate(Symbol symbolCount);
 private:
 	typedef std::map<Symbol, std::string> SymbolToNameMap;
 	typedef std::map<std::string, Symbol> NameToSymbolMap;
+	const Snapshot* mpSnapshot;
 	Symbol mNextFreeSymbol;
-	SymbolToNameMap mSymbolToNameMap;
+	// Names of snapshot symbols are copied in here the first time they're asked for
+	mutable SymbolToNameMap mSymbolToNameMap;
 	NameToSymbolMap mNameToSymbolMap;
 };
 
@@ -0,0 +1,145 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "ThreadPool.h"
+#include <unistd.h>
+
+using namespace std;
+
+namespace tinyreason
+{
+
+ThreadPool::ThreadPool(size_t threadCount) :
+mpJob(0), mItemCount(0), mNextItem(0), mBusyThreadCount(0), mGeneration(0), mStopping(false), mFailed(false)
+{
+	pthread_mutex_init(&mMutex, 0);
+	pthread_cond_init(&mWorkCondition, 0);
+	pthread_cond_init(&mDoneCondition, 0);
+	for (size_t i = 1; i < threadCount; ++i)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, 0, threadMain, this) != 0)
+			break; // Run with the threads there are
+		mThreads.push_back(thread);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	pthread_mutex_lock(&mMutex);
+	mStopping = true;
+	pthread_cond_broadcast(&mWorkCondition);
+	pthread_mutex_unlock(&mMutex);
+	for (size_t i = 0; i < mThreads.size(); ++i)
+		pthread_join(mThreads[i], 0);
+	pthread_cond_destroy(&mDoneCondition);
+	pthread_cond_destroy(&mWorkCondition);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void ThreadPool::run(Job& job, size_t itemCount)
+{
+	pthread_mutex_lock(&mMutex);
+	mpJob = &job;
+	mItemCount = itemCount;
+	mNextItem = 0;
+	mBusyThreadCount = mThreads.size();
+	mFailed = false;
+	++mGeneration;
+	pthread_cond_broadcast(&mWorkCondition);
+	pthread_mutex_unlock(&mMutex);
+
+	executeItems(job);
+
+	pthread_mutex_lock(&mMutex);
+	while (mBusyThreadCount)
+		pthread_cond_wait(&mDoneCondition, &mMutex);
+	mpJob = 0;
+	bool failed = mFailed;
+	string failure = mFailure;
+	pthread_mutex_unlock(&mMutex);
+	if (failed)
+		throw Exception(failure);
+}
+
+size_t ThreadPool::getHardwareThreadCount()
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+}
+
+void* ThreadPool::threadMain(void* pThreadPool)
+{
+	((ThreadPool*) pThreadPool)->work();
+	return 0;
+}
+
+void ThreadPool::work()
+{
+	size_t generation = 0;
+	pthread_mutex_lock(&mMutex);
+	while (true)
+	{
+		while (!mStopping && mGeneration == generation)
+			pthread_cond_wait(&mWorkCondition, &mMutex);
+		if (mStopping)
+			break;
+		generation = mGeneration;
+		Job* pJob = mpJob;
+		pthread_mutex_unlock(&mMutex);
+
+		executeItems(*pJob);
+
+		pthread_mutex_lock(&mMutex);
+		if (--mBusyThreadCount == 0)
+			pthread_cond_signal(&mDoneCondition);
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+
+void ThreadPool::executeItems(Job& job)
+{
+	for (size_t item = __sync_fetch_and_add(&mNextItem, 1); item < mItemCount; item = __sync_fetch_and_add(&mNextItem, 1))
+	{
+		try
+		{
+			job.execute(item);
+		} catch (Exception& e)
+		{
+			pthread_mutex_lock(&mMutex);
+			if (!mFailed)
+			{
+				mFailed = true;
+				mFailure = e.what();
+			}
+			pthread_mutex_unlock(&mMutex);
+		}
+	}
+}
+
+}
@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include <pthread.h>
+
+namespace tinyreason
+{
+
+/**
+ * A fixed set of worker threads running the items of a job in parallel. The
+ * items are handed out one at a time from a shared counter, so long and short
+ * items balance themselves. run() returns when every item has been executed,
+ * the calling thread executes items too.
+ */
+class ThreadPool {
+public:
+
+	class Job {
+	public:
+		virtual ~Job() { }
+		virtual void execute(size_t item) = 0;
+	};
+
+	// threadCount includes the thread calling run()
+	ThreadPool(size_t threadCount);
+	~ThreadPool();
+	size_t getThreadCount() const {
+		return mThreads.size() + 1;
+	}
+	// Rethrows the first Exception thrown by an item, after the others are done
+	void run(Job& job, size_t itemCount);
+	static size_t getHardwareThreadCount();
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	static void* threadMain(void* pThreadPool);
+	void work();
+	void executeItems(Job& job);
+
+	std::vector<pthread_t> mThreads;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mWorkCondition;
+	pthread_cond_t mDoneCondition;
+	Job* mpJob;
+	size_t mItemCount;
+	size_t mNextItem;
+	size_t mBusyThreadCount;
+	size_t mGeneration; // counts the calls to run()
+	bool mStopping;
+	bool mFailed;
+	std::string mFailure;
+};
+
+}
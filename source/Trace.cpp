@@ -0,0 +1,374 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#include "Trace.h"
+#include "Concept.h"
+#include "ConceptManager.h"
+#include "ConceptWriter.h"
+#include <cstring>
+
+using namespace std;
+
+namespace tinyreason
+{
+
+namespace
+{
+const char TRACE_MAGIC[8] = {'T', 'R', 'T', 'R', 'A', 'C', 'E', 0};
+const uint32_t TRACE_VERSION = 1;
+// Events kept per thread, must be a power of two
+const uint64_t BUFFER_CAPACITY = 1 << 16;
+
+struct FileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t eventSize;
+	uint32_t bufferCount;
+	uint32_t conceptCount;
+};
+
+struct BufferHeader {
+	uint32_t thread;
+	uint32_t reserved;
+	uint64_t recordedCount;
+	uint64_t storedCount;
+};
+
+struct Buffer {
+	uint32_t thread;
+	uint64_t recordedCount;
+	vector<Trace::Event> events;
+	Buffer* pNext;
+
+	Buffer(uint32_t thread) :
+	thread(thread), recordedCount(0), events(BUFFER_CAPACITY), pNext(0) { }
+};
+
+// Buffers are never freed: a thread may exit before its events are written
+Buffer* volatile spFirstBuffer = 0;
+uint32_t volatile sBufferCount = 0;
+
+Buffer* createBuffer()
+{
+	Buffer* pBuffer = new Buffer(__sync_fetch_and_add(&sBufferCount, 1));
+	do
+		pBuffer->pNext = spFirstBuffer;
+	while (!__sync_bool_compare_and_swap(&spFirstBuffer, pBuffer->pNext, pBuffer));
+	return pBuffer;
+}
+
+const char* EVENT_NAMES[Trace::EVENT_TYPE_COUNT] = {
+	"tree created", "tree chosen", "tree result", "tree duplicated", "node created", "node blocked", "node unblocked",
+	"concept added", "concept skipped", "concept chosen", "concept on blocked node", "rule applied", "clash"
+};
+
+const char* RULE_NAMES[] = {
+	"positive atomic", "negative atomic", "conjunction", "disjunction", "existential restriction", "universal restriction"
+};
+
+template<class T>
+void writeRaw(ostream& outStream, const T& value)
+{
+	outStream.write((const char*) &value, sizeof (T));
+}
+
+template<class T>
+void readRaw(istream& inStream, T& value)
+{
+	if (!inStream.read((char*) &value, sizeof (T)))
+		throw Exception("Truncated trace file.");
+}
+
+struct ThreadEvent {
+	uint32_t thread;
+	Trace::Event event;
+};
+
+struct CompareThreadEventTimes {
+	bool operator()(const ThreadEvent& e1, const ThreadEvent& e2) const {
+		return e1.event.time < e2.event.time;
+	}
+};
+
+typedef map<uint32_t, string> ConceptNameMap;
+
+string getConceptName(const ConceptNameMap& conceptNames, uint32_t concept)
+{
+	ConceptNameMap::const_iterator it = conceptNames.find(concept);
+	return it == conceptNames.end() ? "#" + toString(concept) : it->second;
+}
+
+string escapeJSON(const string& text)
+{
+	string result;
+	for (size_t i = 0; i < text.size(); ++i)
+	{
+		if (text[i] == '"' || text[i] == '\\')
+			result += '\\';
+		result += text[i];
+	}
+	return result;
+}
+
+// Renders an event as the line the verbose Logger prints for it
+void writeText(ostream& outStream, const Trace::Event& e, const ConceptNameMap& conceptNames)
+{
+	const string node = toString(e.tree) + "." + toString(e.node);
+	switch (e.type)
+	{
+		case Trace::EVENT_TREE_CREATED:
+			outStream << "> Completion Tree " << e.tree << " created.";
+			break;
+		case Trace::EVENT_TREE_CHOSEN:
+			outStream << "> Completion Tree " << e.tree << " chosen to be expanded.";
+			break;
+		case Trace::EVENT_TREE_RESULT:
+			outStream << "> In Completion Tree " << e.tree << ": " <<
+			   (e.result == 0 ? "expansion not be possible, model found!" : e.result == 1 ? "expansion ok!" : "clash found!");
+			break;
+		case Trace::EVENT_TREE_DUPLICATED:
+			outStream << "> In Completion Tree " << e.tree << ": duplicated into Completion Tree " << e.argument << ".";
+			break;
+		case Trace::EVENT_NODE_CREATED:
+			outStream << "> Node " << node << " created.";
+			break;
+		case Trace::EVENT_NODE_BLOCKED:
+			outStream << "> In node " << node << ": is now blocked by node" << e.argument << ".";
+			break;
+		case Trace::EVENT_NODE_UNBLOCKED:
+			outStream << "> In node " << node << ": no ancestor node can block this node. Node is now free.";
+			break;
+		case Trace::EVENT_CONCEPT_ADDED:
+			outStream << "> In node " << node << ": concept \"" << getConceptName(conceptNames, e.concept) << "\" added to this node.";
+			break;
+		case Trace::EVENT_CONCEPT_SKIPPED:
+			outStream << "> In node " << node << ": concept \"" << getConceptName(conceptNames, e.concept) << "\" skipped as already present in this node.";
+			break;
+		case Trace::EVENT_CONCEPT_CHOSEN:
+			outStream << "> In node " << node << ": concept \"" << getConceptName(conceptNames, e.concept) << "\" chosen to be expanded.";
+			break;
+		case Trace::EVENT_CONCEPT_BLOCKED:
+			outStream << "> In node " << node << ": node is blocked, thus concept is skipped.";
+			break;
+		case Trace::EVENT_RULE_APPLIED:
+			outStream << "> In node " << node << ": concept \"" << getConceptName(conceptNames, e.concept) << "\" expanded by the " <<
+			   (e.argument < sizeof (RULE_NAMES) / sizeof (RULE_NAMES[0]) ? RULE_NAMES[e.argument] : "unknown") << " rule.";
+			break;
+		case Trace::EVENT_CLASH:
+			outStream << "> In node " << node << ": concept \"" << getConceptName(conceptNames, e.concept) << "\" clashes.";
+			break;
+		default:
+			outStream << "> Unknown event " << e.type << ".";
+			break;
+	}
+}
+
+void writeChromeEvent(ostream& outStream, uint32_t thread, uint64_t startTime, const Trace::Event& e, const ConceptNameMap& conceptNames)
+{
+	outStream << "{\"pid\":1,\"tid\":" << thread << ",\"ts\":" << e.time - startTime;
+	// Tree expansions are spans, everything else happens inside them
+	if (e.type == Trace::EVENT_TREE_CHOSEN)
+		outStream << ",\"ph\":\"B\",\"name\":\"expand tree " << e.tree << "\"}";
+	else if (e.type == Trace::EVENT_TREE_RESULT)
+		outStream << ",\"ph\":\"E\",\"args\":{\"result\":\"" << (e.result == 0 ? "complete" : e.result == 1 ? "ok" : "clash") << "\"}}";
+	else
+	{
+		outStream << ",\"ph\":\"i\",\"s\":\"t\",\"name\":\"" << (e.type < Trace::EVENT_TYPE_COUNT ? EVENT_NAMES[e.type] : "unknown") <<
+		   "\",\"args\":{\"tree\":" << e.tree;
+		if (e.node != Trace::NONE)
+			outStream << ",\"node\":" << e.node;
+		if (e.concept != Trace::NONE)
+			outStream << ",\"concept\":\"" << escapeJSON(getConceptName(conceptNames, e.concept)) << "\"";
+		if (e.argument != Trace::NONE)
+			outStream << ",\"argument\":" << e.argument;
+		outStream << "}}";
+	}
+}
+}
+
+bool Trace::isEnabled()
+{
+#ifdef TINYREASON_TRACE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Trace::record(EventType type, uint32_t tree, uint32_t node, uint32_t concept, uint32_t argument, uint16_t result)
+{
+	static __thread Buffer* tpBuffer = 0;
+	if (!tpBuffer)
+		tpBuffer = createBuffer();
+	Event& e = tpBuffer->events[tpBuffer->recordedCount & (BUFFER_CAPACITY - 1)];
+	e.time = getMicroseconds();
+	e.tree = tree;
+	e.node = node;
+	e.concept = concept;
+	e.argument = argument;
+	e.type = type;
+	e.result = result;
+	e.reserved = 0;
+	++tpBuffer->recordedCount;
+}
+
+void Trace::clear()
+{
+	for (Buffer* pBuffer = spFirstBuffer; pBuffer; pBuffer = pBuffer->pNext)
+		pBuffer->recordedCount = 0;
+}
+
+void Trace::write(const std::string& fileName, const ConceptManager& conceptManager, const SymbolDictionary& symbolDictionary)
+{
+	// Only the concepts still referenced by some event are rendered
+	set<uint32_t> conceptIDs;
+	uint32_t bufferCount = 0;
+	for (Buffer* pBuffer = spFirstBuffer; pBuffer; pBuffer = pBuffer->pNext, ++bufferCount)
+	{
+		uint64_t storedCount = min(pBuffer->recordedCount, BUFFER_CAPACITY);
+		for (uint64_t i = pBuffer->recordedCount - storedCount; i < pBuffer->recordedCount; ++i)
+			if (pBuffer->events[i & (BUFFER_CAPACITY - 1)].concept != NONE)
+				conceptIDs.insert(pBuffer->events[i & (BUFFER_CAPACITY - 1)].concept);
+	}
+
+	ofstream outStream(fileName.c_str(), ios::binary | ios::trunc);
+	if (!outStream)
+		throw Exception("Cannot create trace file " + fileName + ".");
+
+	FileHeader header;
+	memcpy(header.magic, TRACE_MAGIC, sizeof (header.magic));
+	header.version = TRACE_VERSION;
+	header.eventSize = sizeof (Event);
+	header.bufferCount = bufferCount;
+	header.conceptCount = conceptIDs.size();
+	writeRaw(outStream, header);
+
+	// Shared by the names, which repeat the renderings of their subconcepts
+	ConceptWriter writer(symbolDictionary);
+	for (set<uint32_t>::const_iterator it = conceptIDs.begin(); it != conceptIDs.end(); ++it)
+	{
+		const Concept* pConcept = conceptManager.getConcept(*it);
+		ostringstream text;
+		if (pConcept)
+			writer.write(text, pConcept);
+		else
+			text << "#" << *it;
+		string name = text.str();
+		writeRaw(outStream, *it);
+		writeRaw(outStream, (uint32_t) name.size());
+		outStream.write(name.data(), name.size());
+	}
+
+	for (Buffer* pBuffer = spFirstBuffer; pBuffer; pBuffer = pBuffer->pNext)
+	{
+		BufferHeader bufferHeader;
+		bufferHeader.thread = pBuffer->thread;
+		bufferHeader.reserved = 0;
+		bufferHeader.recordedCount = pBuffer->recordedCount;
+		bufferHeader.storedCount = min(pBuffer->recordedCount, BUFFER_CAPACITY);
+		writeRaw(outStream, bufferHeader);
+		for (uint64_t i = pBuffer->recordedCount - bufferHeader.storedCount; i < pBuffer->recordedCount; ++i)
+			writeRaw(outStream, pBuffer->events[i & (BUFFER_CAPACITY - 1)]);
+	}
+	if (!outStream)
+		throw Exception("Error writing trace file " + fileName + ".");
+}
+
+void Trace::decode(const std::string& fileName, std::ostream& outStream, Format format)
+{
+	ifstream inStream(fileName.c_str(), ios::binary);
+	if (!inStream)
+		throw Exception("Cannot open trace file " + fileName + ".");
+
+	FileHeader header;
+	readRaw(inStream, header);
+	if (memcmp(header.magic, TRACE_MAGIC, sizeof (header.magic)) != 0)
+		throw Exception(fileName + " is not a trace file.");
+	if (header.version != TRACE_VERSION || header.eventSize != sizeof (Event))
+		throw Exception("Trace file " + fileName + " was written by an incompatible build.");
+
+	ConceptNameMap conceptNames;
+	for (uint32_t i = 0; i < header.conceptCount; ++i)
+	{
+		uint32_t id, length;
+		readRaw(inStream, id);
+		readRaw(inStream, length);
+		string name(length, ' ');
+		if (length && !inStream.read(&name[0], length))
+			throw Exception("Truncated trace file.");
+		conceptNames[id] = name;
+	}
+
+	vector<ThreadEvent> events;
+	map<uint32_t, uint64_t> overwrittenCounts;
+	for (uint32_t i = 0; i < header.bufferCount; ++i)
+	{
+		BufferHeader bufferHeader;
+		readRaw(inStream, bufferHeader);
+		overwrittenCounts[bufferHeader.thread] = bufferHeader.recordedCount - bufferHeader.storedCount;
+		for (uint64_t j = 0; j < bufferHeader.storedCount; ++j)
+		{
+			ThreadEvent threadEvent;
+			threadEvent.thread = bufferHeader.thread;
+			readRaw(inStream, threadEvent.event);
+			events.push_back(threadEvent);
+		}
+	}
+	// Each buffer is in order already, this interleaves the threads
+	stable_sort(events.begin(), events.end(), CompareThreadEventTimes());
+
+	if (format == FORMAT_TEXT)
+	{
+		for (map<uint32_t, uint64_t>::const_iterator it = overwrittenCounts.begin(); it != overwrittenCounts.end(); ++it)
+			if (it->second)
+				outStream << "> " << it->second << " earlier events of thread " << it->first << " were overwritten." << endl;
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			if (header.bufferCount > 1)
+				outStream << "[thread " << events[i].thread << "] ";
+			writeText(outStream, events[i].event, conceptNames);
+			outStream << '\n';
+		}
+	} else
+	{
+		uint64_t startTime = events.empty() ? 0 : events.front().event.time;
+		outStream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		for (map<uint32_t, uint64_t>::const_iterator it = overwrittenCounts.begin(); it != overwrittenCounts.end(); ++it)
+			outStream << (it == overwrittenCounts.begin() ? "" : ",") << "\n{\"pid\":1,\"tid\":" << it->first <<
+			   ",\"ph\":\"M\",\"name\":\"thread_name\",\"args\":{\"name\":\"reasoner " << it->first << "\"}}";
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			outStream << ",\n";
+			writeChromeEvent(outStream, events[i].thread, startTime, events[i].event, conceptNames);
+		}
+		outStream << "\n]}" << endl;
+	}
+	outStream.flush();
+}
+
+}
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * Tiny Reason                                                                 *
+ * Copyright (c) 2012, Canio Massimo Tristano <massimo.tristano@gmail.com>     *
+ * All rights reserved.                                                        *
+ *                                                                             *
+ * Redistribution and use in source and binary forms, with or without          *
+ * modification, are permitted provided that the following conditions are met: *
+ *     * Redistributions of source code must retain the above copyright        *
+ *       notice, this list of conditions and the following disclaimer.         *
+ *     * Redistributions in binary form must reproduce the above copyright     *
+ *       notice, this list of conditions and the following disclaimer in the   *
+ *       documentation and/or other materials provided with the distribution.  *
+ *     * Neither the name of the <organization> nor the                        *
+ *       names of its contributors may be used to endorse or promote products  *
+ *       derived from this software without specific prior written permission. *
+ *                                                                             *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  *
+ * ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY      *
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES  *
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;*
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND *
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT  *
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF    *
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ ******************************************************************************/
+
+#pragma once
+
+#include "Common.h"
+#include <stdint.h>
+
+namespace tinyreason
+{
+
+/**
+ * Binary tracing of the reasoning procedure. Events are fixed size records
+ * appended to a ring buffer owned by the recording thread, so recording costs a
+ * timestamp and a few stores: no string is built and nothing is written out
+ * while reasoning. When the buffer is full the oldest events are overwritten.
+ *
+ * Recording goes through TRACE_EVENT, which is compiled in only when
+ * TINYREASON_TRACE is defined ("make TRACE=1"). The file written by write() is
+ * decoded offline, either to the text the verbose Logger prints or to Chrome
+ * trace-event JSON (chrome://tracing, Perfetto).
+ */
+class Trace {
+public:
+
+	enum EventType {
+		EVENT_TREE_CREATED,
+		EVENT_TREE_CHOSEN,
+		EVENT_TREE_RESULT, // result: 0 expansion not possible, 1 ok, 2 clash
+		EVENT_TREE_DUPLICATED, // argument: the new tree
+		EVENT_NODE_CREATED, // argument: the parent node
+		EVENT_NODE_BLOCKED, // argument: the blocking node
+		EVENT_NODE_UNBLOCKED,
+		EVENT_CONCEPT_ADDED,
+		EVENT_CONCEPT_SKIPPED,
+		EVENT_CONCEPT_CHOSEN,
+		EVENT_CONCEPT_BLOCKED,
+		EVENT_RULE_APPLIED, // argument: the concept type
+		EVENT_CLASH,
+		EVENT_TYPE_COUNT
+	};
+
+	enum {
+		NONE = 0xffffffff
+	};
+
+	enum Format {
+		FORMAT_TEXT,
+		FORMAT_CHROME
+	};
+
+	struct Event {
+		uint64_t time; // microseconds
+		uint32_t tree;
+		uint32_t node;
+		uint32_t concept;
+		uint32_t argument;
+		uint16_t type;
+		uint16_t result;
+		uint32_t reserved;
+	};
+
+	static bool isEnabled();
+	static void record(EventType type, uint32_t tree, uint32_t node, uint32_t concept, uint32_t argument = NONE, uint16_t result = 0);
+	static void clear();
+	static void write(const std::string& fileName, const ConceptManager& conceptManager, const SymbolDictionary& symbolDictionary);
+	static void decode(const std::string& fileName, std::ostream& outStream, Format format);
+};
+
+#ifdef TINYREASON_TRACE
+#define TRACE_EVENT(...) Trace::record(__VA_ARGS__)
+#else
+#define TRACE_EVENT(...) ((void) 0)
+#endif
+
+}